@@ -7,32 +7,82 @@ CONFIG += c++17 cmdline
 
 # Sources
 SOURCES += \
+    bulkenrollment.cpp \
     camerahandler.cpp \
     camerascreens.cpp \
     camerasettings.cpp \
     cameraworker.cpp \
+    clipexporter.cpp \
+    clipmuxer.cpp \
+    continuousrecorder.cpp \
     customlabel.cpp \
+    detectionregions.cpp \
     dlib_utils.cpp \
+    embeddingcache.cpp \
+    eventengine.cpp \
+    facedetector.cpp \
+    facegallery.cpp \
+    faceindex.cpp \
+    facequality.cpp \
     faceshandler.cpp \
+    facetracker.cpp \
     focusview.cpp \
+    framehistory.cpp \
+    frameprefetcher.cpp \
+    frequentvisitors.cpp \
+    loadcontroller.cpp \
     main.cpp \
     mainwindow.cpp \
+    motiondetector.cpp \
+    multirewindui.cpp \
+    objectdetector.cpp \
     recordingworker.cpp \
-    rewindui.cpp
+    rewindui.cpp \
+    roieditor.cpp \
+    sightingsindex.cpp \
+    storagemanager.cpp \
+    timelinebar.cpp \
+    trackcorrelator.cpp \
+    unknownclusterer.cpp
 
 # Headers
 HEADERS += \
+    bulkenrollment.h \
     camerahandler.h \
     camerascreens.h \
     camerasettings.h \
     cameraworker.h \
+    clipexporter.h \
+    clipmuxer.h \
+    continuousrecorder.h \
     customlabel.h \
+    detectionregions.h \
     dlib_utils.h \
+    embeddingcache.h \
+    eventengine.h \
+    facedetector.h \
+    facegallery.h \
+    faceindex.h \
+    facequality.h \
     faceshandler.h \
+    facetracker.h \
     focusview.h \
+    framehistory.h \
+    frameprefetcher.h \
+    frequentvisitors.h \
+    loadcontroller.h \
     mainwindow.h \
+    motiondetector.h \
+    multirewindui.h \
+    objectdetector.h \
     recordingworker.h \
-    rewindui.h
+    rewindui.h \
+    roieditor.h \
+    sightingsindex.h \
+    storagemanager.h \
+    timelinebar.h \
+    trackcorrelator.h \
+    unknownclusterer.h
 
 # Forms
 FORMS += \
@@ -0,0 +1,198 @@
+#include "bulkenrollment.h"
+#include "dlib_utils.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <opencv2/opencv.hpp>
+
+BulkEnrollmentWorker::BulkEnrollmentWorker(const QString &source, const QString &databasePath, QObject *parent)
+    : QObject(parent), source(source), databasePath(databasePath)
+{
+    qRegisterMetaType<QVector<FaceGallery::Entry>>();
+}
+
+void BulkEnrollmentWorker::cancel()
+{
+    cancelled = true;
+}
+
+QVector<BulkEnrollmentWorker::Item> BulkEnrollmentWorker::readSource(const QString &source, QStringList &errors)
+{
+    QVector<Item> items;
+    QFileInfo sourceInfo(source);
+
+    if (sourceInfo.isDir()) {
+        // Folder import: the file name is the person's name, e.g. John_Smith.jpg
+        QDir folder(source);
+        const QFileInfoList files = folder.entryInfoList({"*.jpg", "*.jpeg", "*.png", "*.bmp"}, QDir::Files, QDir::Name);
+        for (const QFileInfo &file : files) {
+            items.append({file.absoluteFilePath(), file.completeBaseName().replace('_', ' '), QVariant(), QVariant()});
+        }
+        return items;
+    }
+
+    QFile csv(source);
+    if (!csv.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        errors.append(source + ": " + csv.errorString());
+        return items;
+    }
+
+    QTextStream in(&csv);
+    int lineNumber = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        QStringList fields = line.split(',');
+        for (QString &field : fields) {
+            field = field.trimmed();
+            if (field.size() >= 2 && field.startsWith('"') && field.endsWith('"')) {
+                field = field.mid(1, field.size() - 2);
+            }
+        }
+
+        if (lineNumber == 1 && fields.first().compare("image_path", Qt::CaseInsensitive) == 0) {
+            continue; // Header row
+        }
+
+        if (fields.size() < 2 || fields[0].isEmpty() || fields[1].isEmpty()) {
+            errors.append(QString("%1:%2: expected image_path,name[,age,gender]").arg(source).arg(lineNumber));
+            continue;
+        }
+
+        Item item;
+        item.imagePath = QFileInfo(fields[0]).isRelative() ? sourceInfo.dir().absoluteFilePath(fields[0]) : fields[0];
+        item.name = fields[1];
+
+        if (fields.size() > 2 && !fields[2].isEmpty()) {
+            bool ok;
+            int age = fields[2].toInt(&ok);
+            if (!ok) {
+                errors.append(QString("%1:%2: age must be a valid integer").arg(source).arg(lineNumber));
+                continue;
+            }
+            item.age = age;
+        }
+
+        if (fields.size() > 3 && !fields[3].isEmpty()) {
+            item.gender = fields[3];
+        }
+
+        items.append(item);
+    }
+
+    return items;
+}
+
+void BulkEnrollmentWorker::run()
+{
+    QStringList sourceErrors;
+    QVector<Item> items = readSource(source, sourceErrors);
+    int failed = sourceErrors.size();
+    for (const QString &error : sourceErrors) {
+        emit fileFailed(source, error);
+    }
+
+    QVector<FaceGallery::Entry> enrolled;
+
+    // SQLite connections belong to the thread that opened them
+    const QString connectionName = QString("bulk_enrollment_%1").arg(reinterpret_cast<quintptr>(QThread::currentThread()));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(databasePath);
+
+        if (!db.open()) {
+            emit fileFailed(databasePath, db.lastError().text());
+            failed += items.size();
+            items.clear();
+        }
+
+        struct Result
+        {
+            bool ok = false;
+            std::string error;
+            dlib::matrix<float, 0, 1> encoding;
+        };
+
+        emit progress(0, items.size());
+
+        for (int start = 0; start < items.size() && !cancelled; start += batchSize) {
+            QVector<Item> batch = items.mid(start, batchSize);
+
+            QVector<QFuture<Result>> encodings;
+            for (const Item &item : batch) {
+                encodings.append(QtConcurrent::run(embedding_pool(), [item]() {
+                    Result result;
+                    cv::Mat image = cv::imread(item.imagePath.toStdString());
+                    result.ok = compute_face_encoding(image, result.encoding, nullptr, &result.error);
+                    return result;
+                }));
+            }
+            QVector<Result> results;
+            for (QFuture<Result> &encoding : encodings) {
+                results.append(encoding.result());
+            }
+
+            db.transaction();
+
+            QSqlQuery query(db);
+            query.prepare("INSERT INTO face_encodings (name, age, gender, encoding, image_path) VALUES (:name, :age, :gender, :encoding, :path)");
+
+            QVector<FaceGallery::Entry> batchEntries;
+            for (int i = 0; i < batch.size(); ++i) {
+                const Item &item = batch[i];
+                const Result &result = results[i];
+
+                if (!result.ok) {
+                    ++failed;
+                    emit fileFailed(item.imagePath, QString::fromStdString(result.error));
+                    continue;
+                }
+
+                QByteArray encodingBytes(reinterpret_cast<const char*>(result.encoding.begin()), result.encoding.size() * sizeof(float));
+
+                query.bindValue(":name", item.name);
+                query.bindValue(":age", item.age);
+                query.bindValue(":gender", item.gender);
+                query.bindValue(":encoding", encodingBytes);
+                query.bindValue(":path", item.imagePath);
+
+                if (!query.exec()) {
+                    ++failed;
+                    emit fileFailed(item.imagePath, query.lastError().text());
+                    continue;
+                }
+
+                batchEntries.append({query.lastInsertId().toLongLong(), result.encoding});
+            }
+
+            if (db.commit()) {
+                enrolled += batchEntries;
+            } else {
+                qDebug() << "Error committing enrollment batch:" << db.lastError().text();
+                db.rollback();
+                failed += batchEntries.size();
+                emit fileFailed(databasePath, db.lastError().text());
+            }
+
+            emit progress(qMin(start + batchSize, items.size()), items.size());
+        }
+
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    qDebug() << "Bulk enrollment finished:" << enrolled.size() << "enrolled," << failed << "failed";
+    emit finished(enrolled, failed);
+}
@@ -0,0 +1,51 @@
+#ifndef BULKENROLLMENT_H
+#define BULKENROLLMENT_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <atomic>
+
+#include "facegallery.h"
+
+// Imports a folder of ID photos or a CSV (image_path,name,age,gender) into
+// face_encodings. Meant to live on its own QThread: detection, alignment and
+// embedding run on the embedding pool, rows are inserted in batched
+// transactions and the new identities are reported once at the end.
+class BulkEnrollmentWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Item
+    {
+        QString imagePath;
+        QString name;
+        QVariant age;
+        QVariant gender;
+    };
+
+    BulkEnrollmentWorker(const QString &source, const QString &databasePath, QObject *parent = nullptr);
+
+    static QVector<Item> readSource(const QString &source, QStringList &errors);
+
+public slots:
+    void run();
+    void cancel();
+
+signals:
+    void progress(int done, int total);
+    void fileFailed(const QString &path, const QString &error);
+    void finished(const QVector<FaceGallery::Entry> &faces, int failed);
+
+private:
+    QString source;
+    QString databasePath;
+    std::atomic_bool cancelled{false};
+
+    static const int batchSize = 64;
+};
+
+#endif // BULKENROLLMENT_H
@@ -1,8 +1,11 @@
 #include "camerahandler.h"
 #include "recordingworker.h"
 #include "dlib_utils.h"
+#include "embeddingcache.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QImageReader>
 #include <QThread>
 #include <QMessageBox>
@@ -14,30 +17,32 @@
 #include <QSqlQuery>
 #include <QSqlError>
 
-CameraHandler:: CameraHandler(QObject *parent) : QObject(parent), timer(new QTimer(this)), encodings(*new std::vector<dlib::matrix<float, 0, 1>>())
+CameraHandler:: CameraHandler(QObject *parent) : QObject(parent), timer(new QTimer(this))
 {
     connect(timer, &QTimer::timeout, this, &CameraHandler::updateFrames);
+    connect(&eventEngine, &EventEngine::eventStarted, this, &CameraHandler::startEvent);
+    connect(&eventEngine, &EventEngine::eventEnded, this, &CameraHandler::recordEvent);
     timer->start(30); //FPS
 
     // Connect cleanup timer to cleanupOldFrames method
     connect(&cleanupTimer, &QTimer::timeout, this, &CameraHandler::cleanupOldFrames);
     cleanupTimer.start(24 * 60 * 60 * 1000); // Runs once every day
 
-    std::string faceClassifier = "haarcascade_frontalface_alt2.xml";
-
-    if (!faceCascade.load(faceClassifier)) {
-        qDebug() << "Could not load the classifier";
-        QCoreApplication::exit(-1);
-    }
-
-    qDebug() << "Classifier Loaded!";
-
     // recognizer->read("trained_model.yml");
 
     initialize_network();
     initialize_shape_predictor();
+    gallery.loadIndex(faceIndexPath);
     load_face_encodings("encode");
 
+    // Unknown faces are clustered into visitors on their own thread
+    clusterer = new UnknownClusterer("faces.db");
+    clusterer->moveToThread(&clusterThread);
+    connect(&clusterThread, &QThread::started, clusterer, &UnknownClusterer::start);
+    connect(&clusterThread, &QThread::finished, clusterer, &QObject::deleteLater);
+    clusterThread.start();
+
+    sightings.open();
 
     db = QSqlDatabase::addDatabase("QSQLITE", "cameras_connection");
     db.setDatabaseName("cameras.db");
@@ -53,67 +58,129 @@ CameraHandler:: CameraHandler(QObject *parent) : QObject(parent), timer(new QTim
                         "camera_name TEXT,"
                         "file_name TEXT,"
                         "start_time TEXT,"
-                        "end_time TEXT"
+                        "end_time TEXT,"
+                        "best_face TEXT"
                         ")")) {
             qDebug() << "Error creating table:" << query.lastError().text();
         }
+
+        // Logs written before event face records existed
+        bool hasBestFace = false;
+        QSqlQuery columnsQuery("PRAGMA table_info(camera_logs)", db);
+        while (columnsQuery.next()) {
+            hasBestFace = hasBestFace || columnsQuery.value(1).toString() == "best_face";
+        }
+        if (!hasBestFace && !query.exec("ALTER TABLE camera_logs ADD COLUMN best_face TEXT")) {
+            qDebug() << "Error adding best_face column:" << query.lastError().text();
+        }
+
+        // Person tracks joined across cameras, with a per camera timeline
+        if (!query.exec("CREATE TABLE IF NOT EXISTS person_events ("
+                        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                        "person_id INTEGER,"
+                        "first_seen TEXT,"
+                        "last_seen TEXT,"
+                        "cameras TEXT,"
+                        "timeline TEXT"
+                        ")")) {
+            qDebug() << "Error creating person_events table:" << query.lastError().text();
+        }
+
+        // Seconds it takes to walk from one camera's view to the other's
+        if (!query.exec("CREATE TABLE IF NOT EXISTS camera_adjacency ("
+                        "camera_a TEXT NOT NULL,"
+                        "camera_b TEXT NOT NULL,"
+                        "min_seconds INTEGER NOT NULL DEFAULT 0,"
+                        "max_seconds INTEGER NOT NULL DEFAULT 60,"
+                        "PRIMARY KEY (camera_a, camera_b)"
+                        ")")) {
+            qDebug() << "Error creating camera_adjacency table:" << query.lastError().text();
+        }
+        correlator.loadAdjacency(db);
+
+        // Disks every kind of recording is spread over, seeded from the
+        // roots in recording_settings
+        ContinuousRecorder::createTables(db);
+        storage.load(db);
+        reloadLoadLimits();
     }
+
+    // Edited limits apply within seconds, without a restart
+    connect(&loadLimitsTimer, &QTimer::timeout, this, &CameraHandler::reloadLoadLimits);
+    loadLimitsTimer.start(10000);
+
+    // Continuous recording writes segments on one thread and enforces
+    // retention on another, a slow delete never holds up a write
+    recorder = new ContinuousRecorder("cameras.db", &storage);
+    recorder->moveToThread(&recorderThread);
+    connect(&recorderThread, &QThread::started, recorder, &ContinuousRecorder::start);
+    connect(&recorderThread, &QThread::finished, recorder, &QObject::deleteLater);
+    recorderThread.start();
+
+    janitor = new RecordingJanitor("cameras.db", &storage);
+    janitor->moveToThread(&janitorThread);
+    connect(&janitorThread, &QThread::started, janitor, &RecordingJanitor::start);
+    connect(&janitorThread, &QThread::finished, janitor, &QObject::deleteLater);
+    janitorThread.start();
 }
 
 CameraHandler:: ~CameraHandler(){
     qDebug() << "Closing Camera Handler";
     closeAllCameras();
-}
-
-void CameraHandler::load_face_encodings(const std::string& folder_path)
-{
-    // Initializing Dlib face detector, shape predictor, and face recognition model
-    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+    gallery.saveIndex(faceIndexPath);
+    objectFuture.waitForFinished();
 
-    // Iterate through all images in the folder
-    std::vector<cv::String> filenames;
-    cv::glob(folder_path, filenames);
-
-    for (const auto& filename : filenames)
-    {
-        // Read the image using OpenCV
-        cv::Mat image = cv::imread(filename);
+    for (const TrackCorrelator::PersonTrack &person : correlator.takeAll()) {
+        TrackCorrelator::logEvent(db, person);
+    }
 
-        // Convert OpenCV image to Dlib's format
-        dlib::cv_image<dlib::bgr_pixel> dlib_img(image);
+    QMetaObject::invokeMethod(clusterer, &UnknownClusterer::stop, Qt::BlockingQueuedConnection);
+    clusterThread.quit();
+    clusterThread.wait();
 
-        // Detect faces in the image
-        std::vector<dlib::rectangle> faces = detector(dlib_img);
+    QMetaObject::invokeMethod(recorder, &ContinuousRecorder::stop, Qt::BlockingQueuedConnection);
+    recorderThread.quit();
+    recorderThread.wait();
 
-        // Check if exactly one face is detected
-        if (faces.size() != 1)
-        {
-            std::cerr << "Error: Expected exactly one face in " << filename << ", but found " << faces.size() << " faces." << std::endl;
-            continue;
-        }
+    QMetaObject::invokeMethod(janitor, &RecordingJanitor::stop, Qt::BlockingQueuedConnection);
+    janitorThread.quit();
+    janitorThread.wait();
+}
 
-        // Get the shape (facial landmarks) of the detected face
-        dlib::full_object_detection shape = sp(dlib_img, faces[0]);
+void CameraHandler::load_face_encodings(const std::string& folder_path)
+{
+    // Encodings are cached by path and content hash, only new or changed
+    // images go through detection and the network again
+    EmbeddingCache cache(QString::fromStdString(folder_path) + ".cache");
+    QVector<EmbeddingCache::Face> faces = cache.sync(QString::fromStdString(folder_path));
 
-        // Generate the face encoding using Dlib's face recognition model
-        dlib::matrix<dlib::rgb_pixel> face_chip;
-        dlib::extract_image_chip(dlib_img, dlib::get_face_chip_details(shape, 150, 0.25), face_chip);
-        dlib::matrix<float, 0, 1> face_encoding = net(face_chip);
+    QVector<FaceGallery::Entry> folderFaces;
+    folderFaces.reserve(faces.size());
 
-        // Store the face encoding
-        encodings.push_back(face_encoding);
+    for (const auto& face : faces)
+    {
+        // Stable negative id from the content hash, database rows are positive
+        quint64 bits = 0;
+        std::memcpy(&bits, face.hash.constData(), qMin<qsizetype>(sizeof(bits), face.hash.size()));
+        qint64 id = -static_cast<qint64>(bits & 0x3fffffffffffffffULL) - 1;
 
-        // Print the filename and the corresponding encoding
-        std::cout << "Filename: " << filename << std::endl;
-        std::cout << "Face Encoding: " << face_encoding << std::endl;
+        folderFaces.append({id, face.encoding});
     }
+
+    gallery.insert(folderFaces);
 }
 
 void CameraHandler::closeAllCameras()
 {
-    for (auto& camera : cameras)
+    // CloseCamera erases from cameras, go by name
+    QStringList names;
+    for (const auto& camera : cameras)
     {
-        CloseCamera(camera.cameraname);
+        names.append(camera.cameraname);
+    }
+    for (const QString &name : names)
+    {
+        CloseCamera(name);
     }
 
     cameras.clear();
@@ -121,13 +188,9 @@ void CameraHandler::closeAllCameras()
 
 void CameraHandler::cleanupOldFrames()
 {
-    QDate currentDate = QDate::currentDate();
+    QDateTime cutoff(QDate::currentDate().addDays(-7), QTime(0, 0));
     for (auto &camera : cameras) {
-        camera.CameraRecording.erase(std::remove_if(camera.CameraRecording.begin(), camera.CameraRecording.end(),
-                                                    [currentDate](const QPair<QDate, QPair<cv::Mat, QTime>> &record) {
-                                                        return record.first < currentDate.addDays(-7);
-                                                    }),
-                                     camera.CameraRecording.end());
+        camera.CameraRecording.removeBefore(cutoff);
     }
 }
 
@@ -173,12 +236,15 @@ void CameraHandler::OpenCamera(const std::string &cameraUrl, const QString &came
             // }
 
             // Ask the user if they want to arm the camera
+            loadCameraSettings(newcamera);
+
             QMessageBox::StandardButton reply;
             reply = QMessageBox::question(nullptr, "Arm Camera?", "Do you want to arm the camera?",
                                               QMessageBox::Yes|QMessageBox::No);
             if (reply == QMessageBox::Yes) {
                 newcamera.armed = true;
             }
+            loadController.setArmed(cameraname, newcamera.armed);
 
             qDebug() << "Opening " << cameraname;
 
@@ -232,6 +298,7 @@ void CameraHandler::OpenCamera_single(const std::string &cameraUrl, const QStrin
     newcamera.videoCapture = videoCapture;
     newcamera.cameraname = cameraname;
     newcamera.cameraUrl = cameraUrl;
+    loadCameraSettings(newcamera);
 
     cameras.push_back(newcamera);
 }
@@ -239,51 +306,58 @@ void CameraHandler::OpenCamera_single(const std::string &cameraUrl, const QStrin
 
 void CameraHandler::CloseCamera(const QString &cameraname)
 {
-    auto it = std::remove_if(cameras.begin(), cameras.end(), [cameraname](const CameraInfo &camera) {
+    // Writes the open event while the camera's frames are still here
+    eventEngine.removeCamera(cameraname);
+
+    auto it = std::find_if(cameras.begin(), cameras.end(), [cameraname](const CameraInfo &camera) {
         return camera.cameraname == cameraname;
     });
 
     if (it != cameras.end())
     {
         qDebug() << "Removing " << it->cameraname;
+        loadController.removeCamera(it->cameraname);
         // Release resources before removing the camera
         it->videoCapture.release();
 
         it->videoWriter.release();
 
         // Capture CameraRecording before erasing the camera
-        QVector<QPair<QDate, QPair<cv::Mat, QTime>>> cameraRecording = it->CameraRecording;
+        QVector<QPair<QDate, QPair<cv::Mat, QTime>>> cameraRecording = it->CameraRecording.frames();
 
         it->CameraRecording.clear();
 
-        cameras.erase(it, cameras.end());
+        cameras.erase(it);
 
         qDebug() << "Saving frames";
 
-        int startFrameindex = 0;
-        qDebug() << startFrameindex;
-        int endFrameindex = cameraRecording.size()-1;
-        qDebug() << endFrameindex;
-
-        RecordingWorker* worker = new RecordingWorker;
-
-        // Move the worker object to a separate thread
-        // Create a new thread
-        QThread* recordingThread = new QThread;
+        if (cameraRecording.isEmpty())
+        {
+            return;
+        }
 
-        // Move the RecordingWorker instance to the new thread
-        worker -> moveToThread(recordingThread);
+        QString fileName = QString("%1_%2_%3_%4.mp4")
+                               .arg(cameraname)
+                               .arg(cameraRecording.first().first.toString())
+                               .arg(cameraRecording.first().second.second.toString("hhmmss"))
+                               .arg(cameraRecording.last().second.second.toString("hhmmss"));
+        QString folder = storage.targetFor(StorageManager::archivePool, cameraname);
+        if (!folder.isEmpty())
+        {
+            fileName = folder + "/" + fileName;
+        }
 
-        // Call recordvideo from the new thread using lambda function
-        QObject::connect(recordingThread, &QThread::started, [=]() {
-            worker -> recordvideo(startFrameindex, endFrameindex, cameraname, cameraRecording);
+        // Days of frames, encoded in parallel segments and joined
+        ClipExporter* exporter = new ClipExporter(cameraRecording, fileName);
+        qint64 mediaMs = QDateTime(cameraRecording.first().first, cameraRecording.first().second.second)
+                             .msecsTo(QDateTime(cameraRecording.last().first, cameraRecording.last().second.second));
+        QDateTime startedAt = QDateTime::currentDateTime();
+        connect(exporter, &ClipExporter::finished, this, [this, cameraname, mediaMs, startedAt](bool ok, const QString &filePath) {
+            storage.recordWrite(cameraname, filePath, ok ? QFileInfo(filePath).size() : 0, mediaMs,
+                                startedAt.msecsTo(QDateTime::currentDateTime()), ok);
         });
-
-        // Connect thread's finished signal to deleteLater() slot to clean up when the thread finishes
-        QObject::connect(recordingThread, &QThread::finished, recordingThread, &QThread::deleteLater);
-
-        // Start the thread
-        recordingThread->start();
+        exporter->showProgress(nullptr, "Saving " + cameraname);
+        exporter->start();
 
     }
 }
@@ -342,6 +416,9 @@ void CameraHandler::updateFrames()
     QVector<QFuture<void>> futures;
     QVector<QFutureWatcher<void>*> watchers;
 
+    QElapsedTimer passTimer;
+    passTimer.start();
+
     for (auto &camera : cameras)
     {
         if (camera.isReconnecting) {
@@ -380,13 +457,29 @@ void CameraHandler::updateFrames()
 
         watchers.append(watcher);
     }
+
+    QDateTime now = QDateTime::currentDateTime();
+    for (const TrackCorrelator::PersonTrack &person : correlator.expire(now)) {
+        TrackCorrelator::logEvent(db, person);
+    }
+
+    runObjectDetection();
+
+    for (const auto &camera : cameras)
+    {
+        eventEngine.update(camera.cameraname, now);
+    }
+
+    loadController.endPass(passTimer.nsecsElapsed() / 1e6);
 }
 
-cv::Mat CameraHandler::facedetection(cv::Mat frame, CameraInfo &camera) {
-    // Resize the input frame to a smaller size for faster processing
+cv::Mat CameraHandler::facedetection(cv::Mat frame, CameraInfo &camera, const QDateTime &currentDateTime) {
+    QElapsedTimer stageTimer;
+    stageTimer.start();
+
+    // Display and recording size, picked by the operator
     cv::Mat resizedFrame;
     cv::resize(frame, resizedFrame, cv::Size(), camera.scaleFactor, camera.scaleFactor);
-    QDateTime currentDateTime = QDateTime::currentDateTime();
     QString formattedDateTime = currentDateTime.toString("yyyy-MM-dd hh:mm:ss.zzz");
 
     double fontSize = 0.5 * camera.scaleFactor;
@@ -397,126 +490,414 @@ cv::Mat CameraHandler::facedetection(cv::Mat frame, CameraInfo &camera) {
 
     if(!camera.armed)
     {
+        loadController.record(camera.cameraname, LoadController::Resize, stageTimer.nsecsElapsed() / 1e6);
         return resizedFrame;
     }
 
-    // Set confidence threshold
-    const double confidenceThreshold = 0.55; // Adjust this value as needed
+    // Objects arrive a pass or more late, they stay up until the next result
+    if (!camera.lastObjects.isEmpty() && camera.objectsAt.msecsTo(currentDateTime) > objectHoldMs)
+    {
+        camera.lastObjects.clear();
+    }
+    for (const QPair<cv::Rect, QString> &object : camera.lastObjects)
+    {
+        cv::rectangle(resizedFrame, object.first, cv::Scalar(0, 255, 255), 1);
+        cv::putText(resizedFrame, object.second.toStdString(), object.first.tl() + cv::Point(2, 12), cv::FONT_HERSHEY_SIMPLEX, fontSize, cv::Scalar(0, 255, 255), thickness);
+    }
 
-    cv::Mat frame_gray;
-    cvtColor(resizedFrame, frame_gray, cv::COLOR_BGR2GRAY);
+    // Under load the controller skips frames, keep the last boxes on screen
+    if (!loadController.shouldDetect(camera.cameraname))
+    {
+        for (const QPair<cv::Rect, bool> &face : camera.lastFaces)
+        {
+            cv::rectangle(resizedFrame, face.first, face.second ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255), 1);
+        }
+        loadController.record(camera.cameraname, LoadController::Resize, stageTimer.nsecsElapsed() / 1e6);
+        return resizedFrame;
+    }
 
-    std::vector<cv::Rect> faces;
-    double scaleFactor = 1.3; // Experiment with different values (e.g., 1.1, 1.2, etc.)
-    int minNeighbors = 1; // Experiment with different values (e.g., 3, 5, 7, etc.)
-    int flags = cv::CASCADE_SCALE_IMAGE;
-    faceCascade.detectMultiScale(frame_gray, faces, scaleFactor, minNeighbors, flags);
+    // Detection runs on its own plane, sized by the load controller rather
+    // than the display scale
+    LoadController::Settings load = loadController.settings(camera.cameraname);
+    double detectionScale = std::min(1.0, static_cast<double>(load.detectionWidth) / frame.cols);
+    cv::Mat detectionPlane;
+    if (detectionScale < 1.0)
+    {
+        cv::resize(frame, detectionPlane, cv::Size(), detectionScale, detectionScale, cv::INTER_AREA);
+    }
+    else
+    {
+        detectionPlane = frame;
+    }
+    loadController.record(camera.cameraname, LoadController::Resize, stageTimer.nsecsElapsed() / 1e6);
+    stageTimer.restart();
 
-    bool match_found = false;
-    // Check the number of detected faces
-    if (faces.empty())
+    // Only the configured detection area is analysed, everything below works
+    // in its bounding box
+    cv::Rect roiRect = camera.regions.boundingRect(detectionPlane.size());
+    if (roiRect.width < 24 || roiRect.height < 24)
     {
-        if (camera.isRecording && camera.persondetected && camera.CameraRecording.length() >= camera.startFrameIndex + 100)
-        {
-            qDebug() << "Person has left the frame";
-            camera.endFrameIndex = camera.CameraRecording.length()-10;
-            qDebug() << "Start = " << camera.startFrameIndex << " End = " << camera.endFrameIndex << "Current = " << camera.CameraRecording.length();
+        return resizedFrame;
+    }
 
-            RecordingWorker* worker = new RecordingWorker;
+    // Detection plane (bounding box) coordinates to the displayed frame
+    double displayScale = camera.scaleFactor / detectionScale;
+    auto toDisplay = [&roiRect, displayScale](const cv::Rect &face) {
+        return cv::Rect(cvRound((face.x + roiRect.x) * displayScale), cvRound((face.y + roiRect.y) * displayScale),
+                        cvRound(face.width * displayScale), cvRound(face.height * displayScale));
+    };
 
-            // Move the worker object to a separate thread
-            // Create a new thread
-            QThread* recordingThread = new QThread;
+    cv::Mat detectionFrame = detectionPlane(roiRect);
+    cv::Mat detectionMask;
+    if (!camera.regions.isEmpty())
+    {
+        detectionMask = camera.regions.mask(detectionPlane.size())(roiRect);
+    }
 
-            // Move the RecordingWorker instance to the new thread
-            worker -> moveToThread(recordingThread);
+    // Static scene, nothing can have entered or left the frame
+    MotionDetector::Result motion = camera.motionDetector.update(detectionFrame, detectionMask);
+    camera.motionScore = motion.score;
+    emit motionScoreUpdated(camera.cameraname, motion.score);
+    if (motion.motion)
+    {
+        camera.CameraRecording.addActivity(currentDateTime, FrameHistory::Motion);
+    }
+    loadController.record(camera.cameraname, LoadController::Motion, stageTimer.nsecsElapsed() / 1e6);
+    stageTimer.restart();
 
-            // Call recordvideo from the new thread using lambda function
-            QObject::connect(recordingThread, &QThread::started, [=]() {
-                worker -> recordvideo(camera.startFrameIndex, camera.endFrameIndex, camera.cameraname, camera.CameraRecording, db);
-            });
+    if (!motion.motion)
+    {
+        camera.lastFaces.clear();
+        camera.lastObjects.clear();
+        camera.faceTracker.update({});
+        if (!eventEngine.isActive(camera.cameraname))
+        {
+            // Scene went quiet without an event, nothing to keep faces for
+            camera.faceTracker.takeEventFaces();
+        }
+        return resizedFrame;
+    }
+
+    // Queue the detection area for the next object batch
+    if (camera.objectCadence > 0 && ++camera.objectPasses >= camera.objectCadence && objectBatch.isEmpty())
+    {
+        camera.objectPasses = 0;
+        objectRequests.append({camera.cameraname, currentDateTime, detectionFrame.clone(),
+                               detectionPlane.size(), roiRect.tl(), displayScale});
+    }
 
-            // Connect thread's finished signal to deleteLater() slot to clean up when the thread finishes
-            QObject::connect(recordingThread, &QThread::finished, recordingThread, &QThread::deleteLater);
+    // Set confidence threshold
+    const double confidenceThreshold = 0.55; // Adjust this value as needed
 
-            // Start the thread
-            recordingThread->start();
+    std::vector<cv::Rect> faces;
+    int minimumSize = camera.faceDetector->minimumSize();
 
-            // No faces detected, reset persondetected
-            camera.persondetected = false;
-            camera.isRecording = false;
-            camera.cooldowntime = camera.endFrameIndex;
+    // Only scan the areas that changed
+    for (const cv::Rect &region : motion.regions)
+    {
+        if (region.width < minimumSize || region.height < minimumSize)
+        {
+            continue; // Too small for the detector to find a face in
+        }
+
+        std::vector<cv::Rect> regionFaces = camera.faceDetector->detect(detectionFrame(region));
+        for (cv::Rect face : regionFaces)
+        {
+            face += region.tl();
+
+            // Drop faces centred in an excluded area
+            cv::Point centre(face.x + face.width / 2, face.y + face.height / 2);
+            if (!camera.regions.contains(centre + roiRect.tl(), detectionPlane.size()))
+            {
+                continue;
+            }
+            faces.push_back(face);
         }
     }
-    else {
+    loadController.record(camera.cameraname, LoadController::Detect, stageTimer.nsecsElapsed() / 1e6);
+    stageTimer.restart();
+
+    // Detection frame coordinates to the source frame, which the tracker and
+    // the landmark fit work in
+    double sourceScale = 1.0 / detectionScale;
+    std::vector<cv::Rect> sourceFaces;
+    for (const cv::Rect &face : faces)
+    {
+        sourceFaces.emplace_back(cvRound((face.x + roiRect.x) * sourceScale), cvRound((face.y + roiRect.y) * sourceScale),
+                                 cvRound(face.width * sourceScale), cvRound(face.height * sourceScale));
+    }
+    std::vector<int> trackIds = camera.faceTracker.update(sourceFaces);
+
+    camera.lastFaces.clear();
+    bool anyUnknown = false;
+    // Check the number of detected faces
+    if (!faces.empty())
+    {
         // At least one face detected
-        for (auto face : faces)
+        camera.CameraRecording.addActivity(currentDateTime, FrameHistory::Faces);
+
+        // Faces are found on the small plane, but landmarks and the chip come
+        // from the full resolution colour frame. Wrapping it does not copy,
+        // sp and extract_image_chip only read pixels around the face.
+        dlib::cv_image<dlib::bgr_pixel> sourceImage(frame);
+
+        for (size_t i = 0; i < faces.size(); ++i)
         {
-            // Convert OpenCV rect to dlib rect
-            dlib::rectangle dlibFaceRect(face.x, face.y, face.x + face.width, face.y + face.height);
+            const cv::Rect &face = faces[i];
+            const cv::Rect &sourceFace = sourceFaces[i];
+            dlib::rectangle dlibFaceRect(sourceFace.x, sourceFace.y, sourceFace.x + sourceFace.width, sourceFace.y + sourceFace.height);
 
-            dlib::cv_image<unsigned char> cimg(frame_gray);
             // Find the landmarks using the 5 landmarks model
-            dlib::full_object_detection shape = sp(cimg, dlibFaceRect);
+            dlib::full_object_detection shape = sp(sourceImage, dlibFaceRect);
             // Extract the face chip
             dlib::matrix<dlib::rgb_pixel> face_chip;
-            extract_image_chip(cimg, get_face_chip_details(shape, 150, 0.25), face_chip);
-            // Get the face encoding
-            dlib::matrix<float, 0, 1> face_encoding = net(face_chip);
-
-            // Compare this face encoding with the known faces
-            double min_distance = confidenceThreshold; // Threshold for recognizing a face
-            for (const auto& known_encoding : encodings) {
-                double distance = length(face_encoding - known_encoding);
-                if (distance < min_distance) {
+            extract_image_chip(sourceImage, get_face_chip_details(shape, 150, 0.25), face_chip);
+
+            // Small, blurred, turned away or badly lit faces never match,
+            // they only cost a pass through the network
+            FaceQuality::Score quality = FaceQuality::assess(shape, face_chip);
+            camera.faceTracker.offerChip(trackIds[i], face_chip, quality.overall);
+            FaceTracker::Track *track = camera.faceTracker.track(trackIds[i]);
+            bool match_found = false;
+
+            if (track && track->matchedId != -1)
+            {
+                // Already recognised earlier in this track
+                match_found = true;
+                correlator.touch(camera.cameraname, trackIds[i], currentDateTime, track->matchedId);
+            }
+            else if (quality.overall >= camera.qualityThreshold)
+            {
+                // Get the face encoding
+                dlib::matrix<float, 0, 1> face_encoding = net(face_chip);
+
+                // Capture time, not when the embedding finished, so the index
+                // and the correlator line up with the recordings
+                const QDateTime &seenAt = currentDateTime;
+                if (track && seenAt.toMSecsSinceEpoch() - track->lastSightingMs >= sightingIntervalMs) {
+                    sightings.append(camera.cameraname, seenAt, face_encoding, chip_to_image(face_chip));
+                    track->lastSightingMs = seenAt.toMSecsSinceEpoch();
+                }
+
+                // Compare this face encoding with the known faces
+                qint64 matchedId = gallery.match(face_encoding, confidenceThreshold);
+                if (matchedId != -1) {
                     match_found = true;
-                    break;
+                    if (track) {
+                        track->matchedId = matchedId;
+                    }
+                }
+                else if (track && quality.overall > track->submittedQuality + 0.1)
+                {
+                    // Unknown, keep the sighting for the visitor clusters. A
+                    // track only resubmits when it finds a clearly better view.
+                    clusterer->submit(camera.cameraname, seenAt, face_encoding,
+                                      chip_to_image(face_chip), quality.overall);
+                    track->submittedQuality = quality.overall;
+                }
+
+                if (track) {
+                    correlator.observe(camera.cameraname, trackIds[i], seenAt, face_encoding, quality.overall, matchedId);
                 }
             }
+            else
+            {
+                correlator.touch(camera.cameraname, trackIds[i], currentDateTime);
+            }
 
             // Draw a rectangle and label on the face
+            cv::Rect displayFace = toDisplay(face);
             if (match_found) {
-                cv::rectangle(resizedFrame, face, cv::Scalar(0, 255, 0), 1);
+                cv::rectangle(resizedFrame, displayFace, cv::Scalar(0, 255, 0), 1);
             } else {
-                cv::rectangle(resizedFrame, face, cv::Scalar(0, 0, 255), 1);
+                cv::rectangle(resizedFrame, displayFace, cv::Scalar(0, 0, 255), 1);
             }
+            camera.lastFaces.append(qMakePair(displayFace, match_found));
+            anyUnknown = anyUnknown || !match_found;
         }
+        loadController.record(camera.cameraname, LoadController::Embed, stageTimer.nsecsElapsed() / 1e6);
 
-        // Print a detection message based on the number of detected faces
-        if (faces.size() >= 1 && !camera.persondetected && !camera.isRecording)
+        // Unrecognised faces start or extend an event, recognised people never
+        // do, also when they share the frame with an unknown face
+        if (anyUnknown)
         {
-            if (camera.CameraRecording.length() - camera.cooldowntime <= 200 && camera.cooldowntime != 0)
-            {
+            eventEngine.trigger(camera.cameraname, "Face", currentDateTime);
+        }
+    }
 
+    return resizedFrame;
+}
+
+void CameraHandler::startEvent(const EventEngine::Event &event)
+{
+    auto it = std::find_if(cameras.begin(), cameras.end(), [&event](const CameraInfo &camera) {
+        return camera.cameraname == event.cameraName;
+    });
+    if (it == cameras.end())
+    {
+        return;
+    }
+    CameraInfo &camera = *it;
+
+    // One worker per event. The clip is staged from the pre-roll on and
+    // follows the live frames, only the encoding is left when the event ends.
+    RecordingWorker* worker = new RecordingWorker;
+    worker->setStorage(&storage);
+
+    QThread* recordingThread = new QThread;
+    worker->moveToThread(recordingThread);
+    QObject::connect(recordingThread, &QThread::finished, worker, &QObject::deleteLater);
+    QObject::connect(recordingThread, &QThread::finished, recordingThread, &QThread::deleteLater);
+    recordingThread->start();
+
+    QString cameraName = event.cameraName;
+    QDateTime start = event.start;
+    QMetaObject::invokeMethod(worker, [worker, cameraName, start]() {
+        worker->startClip(cameraName, start);
+    }, Qt::QueuedConnection);
+
+    camera.eventRecorder = worker;
+    camera.eventStagedUntil = event.start.addMSecs(-1);
+    stageEventFrames(camera, event.lastTrigger);
+}
+
+void CameraHandler::stageEventFrames(CameraInfo &camera, const QDateTime &until)
+{
+    if (!camera.eventRecorder)
+    {
+        return;
+    }
+
+    // Found by time rather than by position so frames dropped from the
+    // front do not shift the clip. The images are shared, not copied.
+    QVector<FrameHistory::Frame> frames = camera.CameraRecording.slice(camera.eventStagedUntil.addMSecs(1), until);
+    if (frames.isEmpty())
+    {
+        return;
+    }
+    camera.eventStagedUntil = QDateTime(frames.last().first, frames.last().second.second);
+
+    RecordingWorker* worker = camera.eventRecorder;
+    QMetaObject::invokeMethod(worker, [worker, frames]() {
+        worker->addFrames(frames);
+    }, Qt::QueuedConnection);
+}
+
+void CameraHandler::recordEvent(const EventEngine::Event &event)
+{
+    auto it = std::find_if(cameras.begin(), cameras.end(), [&event](const CameraInfo &camera) {
+        return camera.cameraname == event.cameraName;
+    });
+    if (it == cameras.end() || !it->eventRecorder)
+    {
+        return;
+    }
+    CameraInfo &camera = *it;
+
+    // The rest of the event, up to the end of its post-roll
+    stageEventFrames(camera, event.end);
+    qDebug() << "Recording the event from" << event.start.toString("hh:mm:ss.zzz")
+             << "to" << event.end.toString("hh:mm:ss.zzz") << "for" << event.cameraName;
+
+    // Best chip of every face track in the event, best first
+    QVector<QImage> eventFaces;
+    for (const FaceTracker::EventFace &face : camera.faceTracker.takeEventFaces())
+    {
+        eventFaces.append(face.chip);
+    }
+
+    RecordingWorker* worker = camera.eventRecorder;
+    QThread* recordingThread = worker->thread();
+    camera.eventRecorder = nullptr;
+
+    QDateTime end = event.end;
+    QString databasePath = db.databaseName();
+    QMetaObject::invokeMethod(worker, [worker, recordingThread, eventFaces, end, databasePath]() {
+        worker->setEventFaces(eventFaces);
+        worker->finishClip(end, databasePath);
+        recordingThread->quit();
+    }, Qt::QueuedConnection);
+}
+
+void CameraHandler::runObjectDetection()
+{
+    // Pick up the batch that was in flight
+    if (!objectBatch.isEmpty() && objectFuture.isFinished())
+    {
+        std::vector<std::vector<ObjectDetector::Detection>> results = objectFuture.result();
+        QDateTime now = QDateTime::currentDateTime();
+
+        for (int i = 0; i < objectBatch.size() && i < static_cast<int>(results.size()); ++i)
+        {
+            const ObjectRequest &request = objectBatch[i];
+            auto it = std::find_if(cameras.begin(), cameras.end(), [&request](const CameraInfo &camera) {
+                return camera.cameraname == request.cameraName;
+            });
+            if (it == cameras.end() || !it->armed)
+            {
+                continue;
             }
-            else
+
+            it->lastObjects.clear();
+            for (const ObjectDetector::Detection &detection : results[i])
             {
-                if (!match_found)
+                // Same rule as faces, objects centred in an excluded area do not count
+                cv::Point centre(detection.box.x + detection.box.width / 2, detection.box.y + detection.box.height / 2);
+                if (!it->regions.contains(centre + request.offset, request.planeSize))
                 {
-                    QDateTime currentDateTime = QDateTime::currentDateTime();
-                    QString formattedDateTime = currentDateTime.toString("yyyy-MM-dd hh:mm:ss.zzz");
-                    qDebug() << "Person detected in the " << camera.cameraname << " camera at " << formattedDateTime;
-                    camera.persondetected = true;
-                    if (camera.CameraRecording.length() >= 100 && !camera.isRecording)
-                    {
-                        camera.startFrameIndex = camera.CameraRecording.length() - 100;
-                        camera.isRecording = true;
-                    }
-                    else if (camera.CameraRecording.length() < 100 && !camera.isRecording)
-                    {
-                        camera.startFrameIndex = 0;
-                        camera.isRecording = true;
-                    }
+                    continue;
                 }
-                else
+                cv::Rect display(cvRound((detection.box.x + request.offset.x) * request.displayScale),
+                                 cvRound((detection.box.y + request.offset.y) * request.displayScale),
+                                 cvRound(detection.box.width * request.displayScale),
+                                 cvRound(detection.box.height * request.displayScale));
+                it->lastObjects.append(qMakePair(display, ObjectDetector::categoryName(detection.category)));
+            }
+            it->objectsAt = now;
+
+            // A recognised face on screen means the person is known, other
+            // categories still count
+            bool recognised = std::any_of(it->lastFaces.begin(), it->lastFaces.end(), [](const QPair<cv::Rect, bool> &face) {
+                return face.second;
+            });
+            for (const QPair<cv::Rect, QString> &object : it->lastObjects)
+            {
+                if (!(recognised && object.second == ObjectDetector::categoryName(ObjectDetector::Person)))
                 {
-                    qDebug() << "Recognized Person";
+                    eventEngine.trigger(it->cameraname, object.second, request.capturedAt);
                 }
             }
         }
+        objectBatch.clear();
     }
 
-    return resizedFrame;
+    if (objectRequests.isEmpty() || !objectBatch.isEmpty())
+    {
+        return;
+    }
+
+    // Loaded on first use, most installations never turn the stage on
+    if (!objectDetector)
+    {
+        objectDetector = std::make_unique<ObjectDetector>();
+    }
+    if (!objectDetector->isLoaded())
+    {
+        objectRequests.clear();
+        return;
+    }
+
+    objectBatch.swap(objectRequests);
+    std::vector<cv::Mat> frames;
+    for (const ObjectRequest &request : objectBatch)
+    {
+        frames.push_back(request.frame);
+    }
+
+    ObjectDetector *detector = objectDetector.get();
+    objectFuture = QtConcurrent::run(&threadPool, [detector, frames]() {
+        return detector->detect(frames);
+    });
 }
 
 void CameraHandler::processFrame(CameraInfo& camera)
@@ -524,26 +905,36 @@ void CameraHandler::processFrame(CameraInfo& camera)
     QDateTime currentDateTime = QDateTime::currentDateTime();
     cv::Mat frame;
     cv::Mat newframe;
+
+    QElapsedTimer captureTimer;
+    captureTimer.start();
     camera.videoCapture.read(frame);
+    loadController.record(camera.cameraname, LoadController::Capture, captureTimer.nsecsElapsed() / 1e6);
 
     if (frame.empty() && !camera.isError) {
+        // Nothing goes into the recording, clips hold the frame before a gap
+        // on screen until the next one
         qDebug() << "Error reading frame from " << camera.cameraname;
         camera.isError = true;
-
-        cv::Mat blackFrame(1, 1, CV_8UC3, cv::Scalar(0, 0, 0));
-
-        // Append the frame buffer to CameraRecording with the current date
-        camera.CameraRecording.append(qMakePair(currentDateTime.date(), qMakePair(blackFrame, currentDateTime.time())));
     }
     else {
-        newframe = facedetection(frame, camera);
+        newframe = facedetection(frame, camera, currentDateTime);
 
         camera.latestFrame = matToImage(newframe);
 
         // Append the frame buffer to CameraRecording with the current date
-        camera.CameraRecording.append(qMakePair(currentDateTime.date(), qMakePair(newframe, currentDateTime.time())));
+        camera.CameraRecording.append(currentDateTime, newframe);
+
+        if (camera.continuousRecording)
+        {
+            recorder->append(camera.cameraname, currentDateTime, newframe);
+        }
     }
 
+    // An open event's clip is staged on disk frame by frame, a crash loses
+    // seconds of it rather than the whole event
+    stageEventFrames(camera, currentDateTime);
+
     // queueSerializationTask(camera);
     emit frameUpdated(camera.latestFrame, camera.cameraname);
 }
@@ -645,6 +1036,112 @@ double CameraHandler::getScalefactor(const QString &cameraName)
 }
 
 
+void CameraHandler::loadCameraSettings(CameraInfo &camera)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT detection_roi, exclusion_mask, detector_backend, quality_threshold, object_cadence, "
+                  "pre_roll, post_roll, min_duration, merge_gap, cooldown, continuous_recording FROM cameradetails WHERE camera_name = :name");
+    query.bindValue(":name", camera.cameraname);
+
+    if (!query.exec())
+    {
+        qDebug() << "Error loading camera settings:" << query.lastError().text();
+    }
+
+    QString backend = FaceDetector::defaultBackend();
+    camera.regions = DetectionRegions();
+    camera.qualityThreshold = FaceQuality::defaultThreshold;
+    camera.objectCadence = 0;
+    camera.continuousRecording = false;
+    EventEngine::Settings eventSettings;
+    if (query.isActive() && query.next())
+    {
+        camera.regions.include = DetectionRegions::parse(query.value(0).toString());
+        camera.regions.exclude = DetectionRegions::parse(query.value(1).toString());
+        if (!query.value(2).toString().isEmpty())
+        {
+            backend = query.value(2).toString();
+        }
+        if (!query.value(3).isNull())
+        {
+            camera.qualityThreshold = query.value(3).toDouble();
+        }
+        camera.objectCadence = std::max(0, query.value(4).toInt());
+
+        // Seconds in the table, unset columns keep the defaults
+        int *eventFields[] = {&eventSettings.preRollMs, &eventSettings.postRollMs, &eventSettings.minDurationMs,
+                              &eventSettings.mergeGapMs, &eventSettings.cooldownMs};
+        for (int i = 0; i < 5; ++i)
+        {
+            if (!query.value(5 + i).isNull())
+            {
+                *eventFields[i] = std::max(0, qRound(query.value(5 + i).toDouble() * 1000));
+            }
+        }
+        camera.continuousRecording = query.value(10).toInt() != 0;
+    }
+
+    eventEngine.setSettings(camera.cameraname, eventSettings);
+
+    // The background model only covered the old area
+    camera.motionDetector.reset();
+    camera.objectPasses = 0;
+    camera.lastObjects.clear();
+
+    if (!camera.faceDetector || camera.faceDetector->name() != backend)
+    {
+        camera.faceDetector = FaceDetector::create(backend);
+        qDebug() << "Face detector for" << camera.cameraname << ":" << camera.faceDetector->name();
+    }
+}
+
+void CameraHandler::reloadCameraSettings(const QString &cameraName)
+{
+    auto it = std::find_if(cameras.begin(), cameras.end(), [cameraName](const CameraInfo &camera) {
+        return camera.cameraname == cameraName;
+    });
+
+    if (it != cameras.end())
+    {
+        loadCameraSettings(*it);
+    }
+
+    // Renamed or removed cameras change the transit windows too
+    correlator.loadAdjacency(db);
+}
+
+void CameraHandler::reloadStorageTargets()
+{
+    // Cameras are placed again on their next file
+    storage.load(db);
+}
+
+void CameraHandler::reloadLoadLimits()
+{
+    if (!db.isOpen()) {
+        return;
+    }
+    ContinuousRecorder::Settings settings = ContinuousRecorder::loadSettings(db);
+    loadController.setLimits(settings.cpuBudget, settings.latencyTargetMs);
+}
+
+double CameraHandler::getMotionScore(const QString &cameraName) const
+{
+    auto it = std::find_if(cameras.begin(), cameras.end(), [cameraName](const CameraInfo &camera) {
+        return camera.cameraname == cameraName;
+    });
+
+    if (it != cameras.end())
+    {
+        return it->motionScore;
+    }
+    else
+    {
+        return 0.0;
+    }
+}
+
+
 void CameraHandler::changeCamerastatus(const QString &cameraName)
 {
     auto it = std::find_if(cameras.begin(), cameras.end(), [cameraName](const CameraInfo &camera) {
@@ -662,9 +1159,15 @@ void CameraHandler::changeCamerastatus(const QString &cameraName)
         {
             it->armed = true;
         }
+        loadController.setArmed(cameraName, it->armed);
     }
 }
 
+void CameraHandler::setFocusedCamera(const QString &cameraName)
+{
+    loadController.setFocusedCamera(cameraName);
+}
+
 void CameraHandler::changeScalefactor(double value, const QString &cameraName)
 {
     auto it = std::find_if(cameras.begin(), cameras.end(), [cameraName](const CameraInfo &camera) {
@@ -688,16 +1191,16 @@ void CameraHandler::printConnectedCameras() const
     }
 }
 
-QVector<QPair<QDate, QPair<cv::Mat, QTime>>> CameraHandler::getFrameBuffer(const QString& cameraname) const {
+HistoryView CameraHandler::getFrameBuffer(const QString& cameraname) const {
     auto it = std::find_if(cameras.begin(), cameras.end(), [cameraname](const CameraInfo& camera) {
         return camera.cameraname == cameraname;
     });
 
     if (it != cameras.end()) {
-        return it->CameraRecording;
+        return it->CameraRecording.view();
     }
 
-    return QVector<QPair<QDate, QPair<cv::Mat, QTime>>>(); // Return empty buffer if not found
+    return HistoryView(); // Return empty view if not found
 }
 
 void CameraHandler::clearFrameBuffer(const QString& cameraname) {
@@ -755,7 +1258,7 @@ void CameraHandler::serialize(const CameraInfo &camera)
         out << camera.CameraRecording.size();
 
         // Serialize each frame (cv::Mat object) and its corresponding QTime
-        for (const auto& framePair : camera.CameraRecording) {
+        for (const auto& framePair : camera.CameraRecording.frames()) {
             out << framePair.first;
 
             // Serialize the QTime
@@ -814,7 +1317,7 @@ void CameraHandler::deserialize(CameraInfo &camera)
             qDebug() << bytesRead;
 
             // Append the frame and its corresponding date to the CameraRecording buffer
-            camera.CameraRecording.append(qMakePair(date, qMakePair(frame, time)));
+            camera.CameraRecording.append(QDateTime(date, time), frame);
 
             // Update progress
             int progress = static_cast<int>((bytesRead * 100) / fileSize);
@@ -829,18 +1332,23 @@ void CameraHandler::deserialize(CameraInfo &camera)
     }
 }
 
-void CameraHandler::add_new_face(dlib::matrix<float, 0, 1> face_encoding)
+void CameraHandler::add_new_face(qint64 id, const dlib::matrix<float, 0, 1> &face_encoding)
 {
     qDebug()<< "Face Added!";
-    encodings.push_back(face_encoding);
+    gallery.insert(id, face_encoding);
+}
+
+void CameraHandler::add_new_faces(const QVector<FaceGallery::Entry> &faces)
+{
+    gallery.insert(faces);
+    qDebug() << faces.size() << "faces added, gallery holds" << gallery.size();
 }
 
-void CameraHandler::delete_face(int num)
+void CameraHandler::delete_face(qint64 id)
 {
-    if (num >= 0 && static_cast<size_t>(num) < encodings.size()) {
-        encodings.erase(encodings.begin() + num); // Erase element at index num
+    if (gallery.remove(id)) {
         qDebug() << "Face Deleted!";
     } else {
-        qDebug() << "Invalid index for deletion.";
+        qDebug() << "Invalid id for deletion:" << id;
     }
 }
@@ -14,6 +14,7 @@
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QFuture>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/face.hpp>
@@ -28,6 +29,25 @@
 #include <dlib/string.h>
 #include <dlib/dnn.h>
 
+#include "facegallery.h"
+#include "motiondetector.h"
+#include "detectionregions.h"
+#include "facedetector.h"
+#include "loadcontroller.h"
+#include "facequality.h"
+#include "facetracker.h"
+#include "unknownclusterer.h"
+#include "continuousrecorder.h"
+#include "storagemanager.h"
+#include "sightingsindex.h"
+#include "trackcorrelator.h"
+#include "objectdetector.h"
+#include "eventengine.h"
+#include "framehistory.h"
+#include "clipexporter.h"
+
+class RecordingWorker;
+
 class CameraHandler: public QObject
 {
     Q_OBJECT
@@ -48,25 +68,34 @@ public:
     QString getCameraName(int index) const;
     std::string getCameraUrl(const QString& cameraname) const;
     bool getCameraError(const QString& cameraname) const;
-    QVector<QPair<QDate, QPair<cv::Mat, QTime>>> getFrameBuffer(const QString& cameraname) const;
+    HistoryView getFrameBuffer(const QString& cameraname) const;
     void changeCamerastatus(const QString &cameraName);
     bool getArmedStatus(const QString &cameraName) const;
     double getScalefactor(const QString &cameraName);
     void changeScalefactor(double value, const QString &cameraName);
+    double getMotionScore(const QString &cameraName) const;
+    void reloadCameraSettings(const QString &cameraName);
+    void reloadStorageTargets();
+    void setFocusedCamera(const QString &cameraName);
 
 public slots:
-    void add_new_face(dlib::matrix<float, 0, 1> face_encoding);
-    void delete_face(int num);
+    void add_new_face(qint64 id, const dlib::matrix<float, 0, 1> &face_encoding);
+    void add_new_faces(const QVector<FaceGallery::Entry> &faces);
+    void delete_face(qint64 id);
 
 signals:
     void frameUpdated(const QImage& frame, const QString& cameraname);
     void cameraOpeningFailed(const QString& cameraname);
     void cameraOpened(const QString& cameraname);
     void removeCamera(const QString& cameraname);
+    void motionScoreUpdated(const QString& cameraname, double score);
 
 private slots:
     void updateFrames();
     void cleanupOldFrames();
+    void reloadLoadLimits();
+    void startEvent(const EventEngine::Event &event);
+    void recordEvent(const EventEngine::Event &event);
 
 private:
 
@@ -85,21 +114,31 @@ private:
         bool isError = false;
         bool isReconnecting = false;
         cv::VideoWriter videoWriter;
-        QVector<QPair<QDate, QPair<cv::Mat, QTime>>> CameraRecording;
+        FrameHistory CameraRecording;
         QVector<QPair<cv::Mat, QTime>> frameBuffer;
         int currentBufferIndex;
-        bool isRecording = false;
-        int startFrameIndex;
-        int endFrameIndex;
-        bool persondetected = false;
-        int cooldowntime = 0;
         bool armed = false;
         double scaleFactor = 0.3;
+        DetectionRegions regions;
+        std::shared_ptr<FaceDetector> faceDetector;
+        FaceTracker faceTracker;
+        double qualityThreshold = FaceQuality::defaultThreshold; // Below this faces skip the embedding
+        MotionDetector motionDetector;
+        double motionScore = 0.0;
+        QVector<QPair<cv::Rect, bool>> lastFaces; // Display coordinates, recognised
+        int objectCadence = 0;                     // Detection passes per object pass, 0 is off
+        int objectPasses = 0;
+        QVector<QPair<cv::Rect, QString>> lastObjects; // Display coordinates, category
+        QDateTime objectsAt;
+        bool continuousRecording = false;          // Every frame also goes to the segment recorder
+        RecordingWorker *eventRecorder = nullptr;  // Stages the open event's clip on its own thread
+        QDateTime eventStagedUntil;                // Capture time of the last frame handed to it
     };
 
     QTimer openTimer; //Camera Connection Timer
     QTimer *timer; //FPS Timer
     QTimer cleanupTimer;
+    QTimer loadLimitsTimer; // Reads the load controller's limits from recording_settings
     QVector<CameraInfo> cameras;
     QThreadPool threadPool;
     bool attemptReconnect(CameraInfo &camera);
@@ -112,7 +151,7 @@ private:
     void deserialize(CameraInfo& camera);
 
 
-    cv::Mat facedetection(cv::Mat frame, CameraInfo &camera);
+    cv::Mat facedetection(cv::Mat frame, CameraInfo &camera, const QDateTime &currentDateTime);
 
     const QString videoFolder = "Recordings1";  // Added for video recording
     void initializeVideoWriter(const QString &cameraname);
@@ -120,7 +159,6 @@ private:
 
 
     cv::Mat detectFaces(const cv::Mat &frame);
-    cv::CascadeClassifier faceCascade; // Declare a CascadeClassifier member
     // Load pre-trained face recognition model
     cv::Ptr<cv::face::LBPHFaceRecognizer> recognizer = cv::face::LBPHFaceRecognizer::create();
 
@@ -128,11 +166,61 @@ private:
 
     bool cameras_armed = false;
 
-    std::vector<dlib::matrix<float, 0, 1>>& encodings;
+    QThread clusterThread;
+    UnknownClusterer *clusterer;
+
+    // Storage pools, quotas and write throughput of every disk recordings go to
+    StorageManager storage;
+
+    // Around the clock segments for cameras that have it on, written and
+    // trimmed to the retention policy on their own threads
+    QThread recorderThread;
+    ContinuousRecorder *recorder;
+    QThread janitorThread;
+    RecordingJanitor *janitor;
+
+    // Every embedded face, searchable across cameras and time. One row per
+    // track every few seconds is enough to answer "when was this person here".
+    SightingsIndex sightings{"sightings"};
+    static const int sightingIntervalMs = 5000;
+
+    // One person walking past several cameras becomes one person event
+    TrackCorrelator correlator;
+
+    // Optional people, vehicle and package stage. Cameras due in a pass are
+    // batched into one inference, which runs off the GUI thread; its results
+    // are picked up by a later pass.
+    struct ObjectRequest
+    {
+        QString cameraName;
+        QDateTime capturedAt;
+        cv::Mat frame;       // Detection area of the detection plane
+        cv::Size planeSize;  // Detection plane the camera's regions apply to
+        cv::Point offset;    // Detection area in the detection plane
+        double displayScale; // Detection plane to displayed frame
+    };
+    std::unique_ptr<ObjectDetector> objectDetector;
+    QVector<ObjectRequest> objectRequests;
+    QVector<ObjectRequest> objectBatch; // In flight
+    QFuture<std::vector<std::vector<ObjectDetector::Detection>>> objectFuture;
+    static const int objectHoldMs = 3000; // Detections count towards an event this long
+    void runObjectDetection();
+
+    // Pre-roll, post-roll, merge gap and cooldown per camera, on capture time
+    EventEngine eventEngine;
+
+    // Hands the camera's frames captured up to the given time to its event clip
+    void stageEventFrames(CameraInfo &camera, const QDateTime &until);
+
+    // Trades detection resolution and cadence for latency under load
+    LoadController loadController;
 
-    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+    // Known faces keyed by faces.db id, encode folder images get negative ids
+    FaceGallery gallery;
+    const QString faceIndexPath = "faces.index";
 
     void load_face_encodings(const std::string& folder_path);
+    void loadCameraSettings(CameraInfo &camera);
 };
 
 #endif
@@ -3,6 +3,7 @@
 #include "ui_camerascreens.h"
 #include "customlabel.h"
 #include "rewindui.h"
+#include "multirewindui.h"
 #include "focusview.h"
 #include <QGridLayout>
 #include <QGroupBox>
@@ -62,6 +63,7 @@ void CameraScreens::initialize()
     // Connect CameraHandler's signal to handleFrameUpdate slot
     connect(&cameraHandler, &CameraHandler::frameUpdated, this, &CameraScreens::handleFrameUpdate);
     connect(this, &CameraScreens::add_new_face, &cameraHandler, &CameraHandler::add_new_face);
+    connect(this, &CameraScreens::add_new_faces, &cameraHandler, &CameraHandler::add_new_faces);
     connect(this, &CameraScreens::delete_face, &cameraHandler, &CameraHandler::delete_face);
 }
 
@@ -121,6 +123,9 @@ void CameraScreens::onImageClicked()
         // Print the name of the clicked camera
         qDebug() << "Clicked Camera: " << cameraName;
 
+        // The selected camera is the last one the load controller degrades
+        cameraHandler.setFocusedCamera(cameraName);
+
 
         if(cameraHandler.getCameraError(cameraName))
         {
@@ -384,6 +389,18 @@ void CameraScreens::addCamera(const QString& cameraUrl, const QString& cameraNam
     handleCameraOpened();
 }
 
+void CameraScreens::reloadCameraSettings(const QString& cameraName)
+{
+    qDebug() << "Reloading camera settings: " << cameraName;
+    cameraHandler.reloadCameraSettings(cameraName);
+}
+
+void CameraScreens::reloadStorageTargets()
+{
+    qDebug() << "Reloading storage targets";
+    cameraHandler.reloadStorageTargets();
+}
+
 void CameraScreens::removeCamera(const QString& cameraName)
 {
     qDebug() << "Removing Camera: " << cameraName;
@@ -451,3 +468,43 @@ void CameraScreens::handleTabCloseRequested(int index)
         qDebug() << "Cannot close default tab";
     }
 }
+
+void CameraScreens::on_multi_rewind_button_clicked()
+{
+    if (!tabWidget)
+    {
+        return;
+    }
+
+    QStringList cameraNames;
+    for (int i = 0; i < cameraHandler.getNumberOfConnectedCameras(); ++i)
+    {
+        cameraNames.append(cameraHandler.getCameraName(i));
+    }
+
+    QStringList chosen = MultiRewindUi::chooseCameras(cameraNames, this);
+    if (chosen.isEmpty())
+    {
+        return;
+    }
+
+    // Views onto the live histories, nothing is copied
+    QVector<QPair<QString, HistoryView>> histories;
+    for (const QString &cameraName : chosen)
+    {
+        histories.append(qMakePair(cameraName, cameraHandler.getFrameBuffer(cameraName)));
+    }
+
+    int newIndex = tabWidget->addTab(new MultiRewindUi(histories, parentWidget), chosen.join(", "));
+    tabWidget->setCurrentIndex(newIndex);
+    QTabBar* tabBar = tabWidget->findChild<QTabBar*>();
+    if (tabBar)
+    {
+        QWidget* closeButton = tabBar->tabButton(newIndex, QTabBar::RightSide);
+        if (closeButton)
+        {
+            closeButton->resize(0, 0);
+            closeButton->setVisible(false);
+        }
+    }
+}
@@ -26,12 +26,15 @@ public:
     ~CameraScreens();
 
 signals:
-    void add_new_face(dlib::matrix<float, 0, 1> face_encoding);
-    void delete_face(int num);
+    void add_new_face(qint64 id, const dlib::matrix<float, 0, 1> &face_encoding);
+    void add_new_faces(const QVector<FaceGallery::Entry> &faces);
+    void delete_face(qint64 id);
 
 public slots:
     void addCamera(const QString& cameraUrl, const QString& cameraName);
     void removeCamera(const QString& cameraName);
+    void reloadCameraSettings(const QString& cameraName);
+    void reloadStorageTargets();
     void on_one_camera_clicked();
     void on_four_camera_clicked();
     void on_sixteen_camera_clicked();
@@ -58,6 +61,8 @@ private slots:
 
     void handleTabCloseRequested(int index);
 
+    void on_multi_rewind_button_clicked();
+
 private:
     Ui::CameraScreens *ui;
     QTimer *timer;
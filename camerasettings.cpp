@@ -1,11 +1,17 @@
 #include "camerasettings.h"
 #include "ui_camerasettings.h"
+#include "roieditor.h"
+#include "facedetector.h"
+#include "facequality.h"
+#include "eventengine.h"
+#include "storagemanager.h"
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlTableModel>
 #include <QMessageBox>
 #include <QDesktopServices>
+#include <QFileDialog>
 
 
 CameraSettings::CameraSettings(QWidget *parent)
@@ -24,11 +30,31 @@ CameraSettings::CameraSettings(QWidget *parent)
     model = new QSqlTableModel(this);
     logModel = new QSqlTableModel(this);
 
+    // Storage targets are edited in place, every change goes to the
+    // database at once and the camera handler reloads them when the
+    // edits pause
+    storageModel = new QSqlTableModel(this, db);
+    storageModel->setEditStrategy(QSqlTableModel::OnFieldChange);
+    storageEditTimer = new QTimer(this);
+    storageEditTimer->setSingleShot(true);
+    storageEditTimer->setInterval(1500);
+    connect(storageEditTimer, &QTimer::timeout, this, &CameraSettings::storage_changed);
+    connect(storageModel, &QSqlTableModel::dataChanged, this, [this]() { storageEditTimer->start(); });
+    ui->storage_pool_combobox->addItems({StorageManager::eventsPool, StorageManager::continuousPool, StorageManager::archivePool});
+
+    for (const QString &backend : FaceDetector::backends()) {
+        ui->detector_combobox->addItem(FaceDetector::displayName(backend), backend);
+    }
+    ui->quality_spinbox->setValue(FaceQuality::defaultThreshold);
+    reset_event_timing();
+
     update_table();
     update_log_table();
+    update_storage_table();
 
     ui->tableitem_edit->setEnabled(false);
     ui->tableitem_delete->setEnabled(false);
+    ui->tableitem_regions->setEnabled(false);
     connect(ui->connectedcameras_tableView, &QTableView::clicked, this, &CameraSettings::on_connectedcameras_tableView_clicked);
     connect(ui->logs_tableView, &QTableView::doubleClicked, this, &CameraSettings::openFile);
 }
@@ -64,6 +90,11 @@ void CameraSettings::update_table()
     for (int i = 0; i < model->columnCount(); ++i) {
         ui->connectedcameras_tableView->horizontalHeader()->setSectionResizeMode(i, QHeaderView::Stretch);
     }
+
+    // Per-camera detection settings are not shown in the table
+    for (int i = 6; i < model->columnCount(); ++i) {
+        ui->connectedcameras_tableView->setColumnHidden(i, true);
+    }
 }
 
 
@@ -76,6 +107,15 @@ void CameraSettings::on_addbutton_clicked()
     QString ip_address = ui->ip_address->text();
     QString username = ui->username->text();
     QString password = ui->password->text();
+    QString detector_backend = ui->detector_combobox->currentData().toString();
+    double quality_threshold = ui->quality_spinbox->value();
+    int object_cadence = ui->object_spinbox->value();
+    double pre_roll = ui->preroll_spinbox->value();
+    double post_roll = ui->postroll_spinbox->value();
+    double min_duration = ui->minduration_spinbox->value();
+    double merge_gap = ui->mergegap_spinbox->value();
+    double cooldown = ui->cooldown_spinbox->value();
+    int continuous_recording = ui->continuous_checkbox->isChecked() ? 1 : 0;
 
     if(name_camera.isEmpty() || url_camera.isEmpty())
     {
@@ -98,12 +138,21 @@ void CameraSettings::on_addbutton_clicked()
             if (reply == QMessageBox::Yes) {
                 // User wants to update the camera, proceed with the update
                 QSqlQuery updateQuery;
-                updateQuery.prepare("UPDATE cameradetails SET camera_name = :name, camera_url = :url, port = :port, ip_address = :ip_address, username = :username, password = :password WHERE camera_name = :name OR camera_url = :url");
+                updateQuery.prepare("UPDATE cameradetails SET camera_name = :name, camera_url = :url, port = :port, ip_address = :ip_address, username = :username, password = :password, detector_backend = :detector_backend, quality_threshold = :quality_threshold, object_cadence = :object_cadence, pre_roll = :pre_roll, post_roll = :post_roll, min_duration = :min_duration, merge_gap = :merge_gap, cooldown = :cooldown, continuous_recording = :continuous_recording WHERE camera_name = :name OR camera_url = :url");
                 updateQuery.bindValue(":url", url_camera);
                 updateQuery.bindValue(":port", port);
                 updateQuery.bindValue(":ip_address", ip_address);
                 updateQuery.bindValue(":username", username);
                 updateQuery.bindValue(":password", password);
+                updateQuery.bindValue(":detector_backend", detector_backend);
+                updateQuery.bindValue(":quality_threshold", quality_threshold);
+                updateQuery.bindValue(":object_cadence", object_cadence);
+                updateQuery.bindValue(":pre_roll", pre_roll);
+                updateQuery.bindValue(":post_roll", post_roll);
+                updateQuery.bindValue(":min_duration", min_duration);
+                updateQuery.bindValue(":merge_gap", merge_gap);
+                updateQuery.bindValue(":cooldown", cooldown);
+                updateQuery.bindValue(":continuous_recording", continuous_recording);
                 updateQuery.bindValue(":name", name_camera);
 
                 if (!updateQuery.exec()) {
@@ -112,6 +161,7 @@ void CameraSettings::on_addbutton_clicked()
                 } else {
                     qDebug() << "Updated";
                     emit add_camera({url_camera, name_camera});
+                    emit settings_changed(name_camera);
                     update_table();
                     update_log_table();
                 }
@@ -122,13 +172,22 @@ void CameraSettings::on_addbutton_clicked()
         else {
             // Camera doesn't exist, insert new row
             QSqlQuery insertQuery;
-            insertQuery.prepare("INSERT INTO cameradetails(camera_name, camera_url, port, ip_address, username, password) VALUES (:name, :url, :port, :ip_address, :username, :password)");
+            insertQuery.prepare("INSERT INTO cameradetails(camera_name, camera_url, port, ip_address, username, password, detector_backend, quality_threshold, object_cadence, pre_roll, post_roll, min_duration, merge_gap, cooldown, continuous_recording) VALUES (:name, :url, :port, :ip_address, :username, :password, :detector_backend, :quality_threshold, :object_cadence, :pre_roll, :post_roll, :min_duration, :merge_gap, :cooldown, :continuous_recording)");
             insertQuery.bindValue(":name", name_camera);
             insertQuery.bindValue(":url", url_camera);
             insertQuery.bindValue(":port", port);
             insertQuery.bindValue(":ip_address", ip_address);
             insertQuery.bindValue(":username", username);
             insertQuery.bindValue(":password", password);
+            insertQuery.bindValue(":detector_backend", detector_backend);
+            insertQuery.bindValue(":quality_threshold", quality_threshold);
+            insertQuery.bindValue(":object_cadence", object_cadence);
+            insertQuery.bindValue(":pre_roll", pre_roll);
+            insertQuery.bindValue(":post_roll", post_roll);
+            insertQuery.bindValue(":min_duration", min_duration);
+            insertQuery.bindValue(":merge_gap", merge_gap);
+            insertQuery.bindValue(":cooldown", cooldown);
+            insertQuery.bindValue(":continuous_recording", continuous_recording);
 
             if (!insertQuery.exec()) {
                 qDebug() << "Error executing insert query:" << insertQuery.lastError().text();
@@ -179,6 +238,21 @@ void CameraSettings::on_clearbutton_clicked()
     ui->ip_address->clear();
     ui->camera_name->clear();
     ui->url_address->clear();
+    ui->detector_combobox->setCurrentIndex(0);
+    ui->quality_spinbox->setValue(FaceQuality::defaultThreshold);
+    ui->object_spinbox->setValue(0);
+    ui->continuous_checkbox->setChecked(false);
+    reset_event_timing();
+}
+
+void CameraSettings::reset_event_timing()
+{
+    EventEngine::Settings defaults;
+    ui->preroll_spinbox->setValue(defaults.preRollMs / 1000.0);
+    ui->postroll_spinbox->setValue(defaults.postRollMs / 1000.0);
+    ui->minduration_spinbox->setValue(defaults.minDurationMs / 1000.0);
+    ui->mergegap_spinbox->setValue(defaults.mergeGapMs / 1000.0);
+    ui->cooldown_spinbox->setValue(defaults.cooldownMs / 1000.0);
 }
 
 void CameraSettings::on_connectedcameras_tableView_clicked(const QModelIndex &index)
@@ -190,10 +264,12 @@ void CameraSettings::on_connectedcameras_tableView_clicked(const QModelIndex &in
             // Enable the "Edit" and "Delete" buttons
             ui->tableitem_edit->setEnabled(true);
             ui->tableitem_delete->setEnabled(true);
+            ui->tableitem_regions->setEnabled(true);
         } else {
             // Disable the buttons if only a cell within the row is selected
             ui->tableitem_edit->setEnabled(false);
             ui->tableitem_delete->setEnabled(false);
+            ui->tableitem_regions->setEnabled(false);
         }
     }
     else
@@ -201,6 +277,7 @@ void CameraSettings::on_connectedcameras_tableView_clicked(const QModelIndex &in
         // No row selected, disable the buttons
         ui->tableitem_edit->setEnabled(false);
         ui->tableitem_delete->setEnabled(false);
+        ui->tableitem_regions->setEnabled(false);
     }
 }
 
@@ -227,6 +304,10 @@ void CameraSettings::on_tableitem_edit_clicked()
             QString ipAddress = model->data(model->index(selectedRow, 3)).toString();
             QString username = model->data(model->index(selectedRow, 4)).toString();
             QString password = model->data(model->index(selectedRow, 5)).toString();
+            QString detectorBackend = model->data(model->index(selectedRow, model->fieldIndex("detector_backend"))).toString();
+            QVariant qualityThreshold = model->data(model->index(selectedRow, model->fieldIndex("quality_threshold")));
+            int objectCadence = model->data(model->index(selectedRow, model->fieldIndex("object_cadence"))).toInt();
+            bool continuousRecording = model->data(model->index(selectedRow, model->fieldIndex("continuous_recording"))).toInt() != 0;
 
             // Set the values to the textboxes
             ui->camera_name->setText(cameraName);
@@ -235,6 +316,24 @@ void CameraSettings::on_tableitem_edit_clicked()
             ui->ip_address->setText(ipAddress);
             ui->username->setText(username);
             ui->password->setText(password);
+            int detectorIndex = ui->detector_combobox->findData(detectorBackend);
+            ui->detector_combobox->setCurrentIndex(detectorIndex >= 0 ? detectorIndex : 0);
+            ui->quality_spinbox->setValue(qualityThreshold.isNull() ? FaceQuality::defaultThreshold : qualityThreshold.toDouble());
+            ui->object_spinbox->setValue(objectCadence);
+            ui->continuous_checkbox->setChecked(continuousRecording);
+
+            // Unset timing columns mean the defaults
+            reset_event_timing();
+            const QList<QPair<QString, QDoubleSpinBox *>> timing = {
+                {"pre_roll", ui->preroll_spinbox}, {"post_roll", ui->postroll_spinbox},
+                {"min_duration", ui->minduration_spinbox}, {"merge_gap", ui->mergegap_spinbox},
+                {"cooldown", ui->cooldown_spinbox}};
+            for (const auto &field : timing) {
+                QVariant value = model->data(model->index(selectedRow, model->fieldIndex(field.first)));
+                if (!value.isNull()) {
+                    field.second->setValue(value.toDouble());
+                }
+            }
 
             // Disable the "Edit" button
             ui->tableitem_edit->setEnabled(false);
@@ -281,6 +380,7 @@ void CameraSettings::on_tableitem_delete_clicked()
                 ui->tableitem_edit->setEnabled(false);
                 // Disable the "Delete" button
                 ui->tableitem_delete->setEnabled(false);
+                ui->tableitem_regions->setEnabled(false);
             }
         }
     }
@@ -290,6 +390,47 @@ void CameraSettings::on_tableitem_delete_clicked()
     }
 }
 
+void CameraSettings::on_tableitem_regions_clicked()
+{
+    QModelIndexList selectedRows = ui->connectedcameras_tableView->selectionModel()->selectedRows();
+    if (selectedRows.isEmpty()) {
+        qDebug() << "No row selected to edit regions";
+        return;
+    }
+
+    int row = selectedRows.at(0).row();
+    QString cameraName = model->data(model->index(row, 0)).toString();
+    QString cameraUrl = model->data(model->index(row, 1)).toString();
+
+    QSqlQuery selectQuery;
+    selectQuery.prepare("SELECT detection_roi, exclusion_mask FROM cameradetails WHERE camera_name = :name");
+    selectQuery.bindValue(":name", cameraName);
+    if (!selectQuery.exec() || !selectQuery.next()) {
+        qDebug() << "Error loading detection regions:" << selectQuery.lastError().text();
+        QMessageBox::critical(this, "Error", "Error loading detection regions: " + selectQuery.lastError().text());
+        return;
+    }
+
+    RoiEditor editor(cameraName, cameraUrl, selectQuery.value(0).toString(), selectQuery.value(1).toString(), this);
+    if (editor.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    QSqlQuery updateQuery;
+    updateQuery.prepare("UPDATE cameradetails SET detection_roi = :roi, exclusion_mask = :mask WHERE camera_name = :name");
+    updateQuery.bindValue(":roi", editor.includeText());
+    updateQuery.bindValue(":mask", editor.excludeText());
+    updateQuery.bindValue(":name", cameraName);
+
+    if (!updateQuery.exec()) {
+        qDebug() << "Error saving detection regions:" << updateQuery.lastError().text();
+        QMessageBox::critical(this, "Error", "Error saving detection regions: " + updateQuery.lastError().text());
+    } else {
+        qDebug() << "Detection regions updated for" << cameraName;
+        emit settings_changed(cameraName);
+    }
+}
+
 void CameraSettings::update_log_table()
 {
     logModel->setTable("camera_logs");
@@ -301,6 +442,7 @@ void CameraSettings::update_log_table()
     logModel->setHeaderData(2, Qt::Horizontal, "File Name");
     logModel->setHeaderData(3, Qt::Horizontal, "Start Time");
     logModel->setHeaderData(4, Qt::Horizontal, "End Time");
+    logModel->setHeaderData(5, Qt::Horizontal, "Best Face");
 
     // Set the model for the table view
     ui->logs_tableView->setModel(logModel);
@@ -344,6 +486,77 @@ void CameraSettings::populate_camera_names()
 void CameraSettings::on_update_pushButton_clicked()
 {
     update_log_table();
+    update_storage_table();
+}
+
+void CameraSettings::update_storage_table()
+{
+    storageModel->setTable("storage_targets");
+    storageModel->setHeaderData(1, Qt::Horizontal, "Pool");
+    storageModel->setHeaderData(2, Qt::Horizontal, "Folder");
+    storageModel->setHeaderData(3, Qt::Horizontal, "Quota (GB)");
+    storageModel->setHeaderData(4, Qt::Horizontal, "Enabled");
+    storageModel->select();
+
+    ui->storage_tableView->setModel(storageModel);
+    ui->storage_tableView->setColumnHidden(0, true);
+    for (int i = 1; i < storageModel->columnCount(); ++i) {
+        ui->storage_tableView->horizontalHeader()->setSectionResizeMode(i, i == 2 ? QHeaderView::Stretch : QHeaderView::ResizeToContents);
+    }
+}
+
+void CameraSettings::on_storage_add_button_clicked()
+{
+    QString folder = QFileDialog::getExistingDirectory(this, "Storage Target");
+    if (folder.isEmpty()) {
+        return;
+    }
+
+    QSqlQuery insertQuery(db);
+    insertQuery.prepare("INSERT INTO storage_targets (pool, path) VALUES (:pool, :path)");
+    insertQuery.bindValue(":pool", ui->storage_pool_combobox->currentText());
+    insertQuery.bindValue(":path", folder);
+    if (!insertQuery.exec()) {
+        qDebug() << "Error adding storage target:" << insertQuery.lastError().text();
+        QMessageBox::critical(this, "Error", "Error adding storage target: " + insertQuery.lastError().text());
+        return;
+    }
+
+    update_storage_table();
+    storageEditTimer->stop();
+    emit storage_changed();
+}
+
+void CameraSettings::on_storage_remove_button_clicked()
+{
+    // Cells are edited in place, the current one picks the row
+    QModelIndex index = ui->storage_tableView->currentIndex();
+    if (!index.isValid()) {
+        QMessageBox::warning(this, "No Selection", "Please select a storage target to remove.");
+        return;
+    }
+
+    // Recordings already on the target stay where they are
+    QString folder = storageModel->data(storageModel->index(index.row(), 2)).toString();
+    QMessageBox::StandardButton reply = QMessageBox::question(this, "Confirm Removal",
+                                                              "Stop recording to " + folder + "? Files already there are kept.",
+                                                              QMessageBox::Yes | QMessageBox::No);
+    if (reply != QMessageBox::Yes) {
+        return;
+    }
+
+    QSqlQuery deleteQuery(db);
+    deleteQuery.prepare("DELETE FROM storage_targets WHERE id = :id");
+    deleteQuery.bindValue(":id", storageModel->data(storageModel->index(index.row(), 0)));
+    if (!deleteQuery.exec()) {
+        qDebug() << "Error removing storage target:" << deleteQuery.lastError().text();
+        QMessageBox::critical(this, "Error", "Error removing storage target: " + deleteQuery.lastError().text());
+        return;
+    }
+
+    update_storage_table();
+    storageEditTimer->stop();
+    emit storage_changed();
 }
 
 
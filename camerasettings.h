@@ -1,6 +1,7 @@
 #ifndef CAMERASETTINGS_H
 #define CAMERASETTINGS_H
 
+#include <QTimer>
 #include <QWidget>
 #include <QtSql/QSqlTableModel>
 
@@ -19,6 +20,8 @@ public:
 signals:
     void add_camera(const std::pair<QString, QString> camera);
     void delete_camera(const QString &cameraName);
+    void settings_changed(const QString &cameraName);
+    void storage_changed();
 
 
 private slots:
@@ -40,6 +43,8 @@ private slots:
 
     void on_tableitem_delete_clicked();
 
+    void on_tableitem_regions_clicked();
+
     void on_update_pushButton_clicked();
 
     void populate_camera_names();
@@ -48,14 +53,24 @@ private slots:
 
     void openFile(const QModelIndex &index);
 
+    void update_storage_table();
+
+    void on_storage_add_button_clicked();
+
+    void on_storage_remove_button_clicked();
+
 private:
     Ui::CameraSettings *ui;
     QSqlTableModel *model;
     QSqlTableModel *logModel;
+    QSqlTableModel *storageModel;
+    QTimer *storageEditTimer; // Reloads the targets once edits settle
     QSqlDatabase db;
     bool rtsp = false;
     bool mp4 = false;
 
+    void reset_event_timing();
+
 };
 
 #endif // CAMERASETTINGS_H
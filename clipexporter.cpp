@@ -0,0 +1,220 @@
+#include "clipexporter.h"
+#include "clipmuxer.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QProgressDialog>
+#include <QTextStream>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+
+ClipExporter::ClipExporter(const QVector<Frame> &frames, const QString &filePath, QObject *parent)
+    : QObject(parent), frames(frames), filePath(filePath)
+{
+    partsPath = filePath + ".parts";
+
+    if (!frames.isEmpty()) {
+        frameSize = frames.first().second.first.size();
+    }
+
+    encodePool.setMaxThreadCount(QThread::idealThreadCount());
+
+    progressTimer = new QTimer(this);
+    connect(progressTimer, &QTimer::timeout, this, &ClipExporter::reportProgress);
+}
+
+ClipExporter::~ClipExporter()
+{
+    encodePool.waitForDone();
+}
+
+void ClipExporter::start()
+{
+    if (frameSize.empty()) {
+        qDebug() << "Nothing to export to" << filePath;
+        QMetaObject::invokeMethod(this, [this]() { finish(false); }, Qt::QueuedConnection);
+        return;
+    }
+
+    ranges = segments();
+    totalWork = frames.size() * (ranges.size() > 1 ? 3 : 2);
+
+    elapsed.start();
+    progressTimer->start(250);
+    QtConcurrent::run([this]() { run(); });
+}
+
+void ClipExporter::cancel()
+{
+    cancelled.storeRelaxed(1);
+}
+
+QProgressDialog *ClipExporter::showProgress(QWidget *parent, const QString &title)
+{
+    QProgressDialog *dialog = new QProgressDialog(title, "Cancel", 0, 100, parent);
+    dialog->setWindowTitle(title);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->setAutoClose(false);
+    dialog->setAutoReset(false);
+    dialog->setMinimumDuration(0);
+
+    connect(dialog, &QProgressDialog::canceled, this, &ClipExporter::cancel);
+    connect(this, &ClipExporter::progress, dialog, [dialog, title](int done, int total, qint64 remainingMs) {
+        int percent = total > 0 ? static_cast<int>(100LL * done / total) : 0;
+        dialog->setValue(percent);
+        QString text = QString("%1\n%2% done").arg(title).arg(percent);
+        if (remainingMs >= 0) {
+            text += QString(", about %1 s left").arg((remainingMs + 999) / 1000);
+        }
+        dialog->setLabelText(text);
+    });
+    connect(this, &ClipExporter::finished, dialog, &QProgressDialog::close);
+    dialog->show();
+    return dialog;
+}
+
+QVector<QPair<int, int>> ClipExporter::segments() const
+{
+    // Cut on capture time, a segment is a minute of footage whatever the
+    // frame rate was
+    QVector<QPair<int, int>> result;
+    int first = 0;
+    QDateTime segmentStart(frames[0].first, frames[0].second.second);
+    for (int i = 1; i < frames.size(); ++i) {
+        QDateTime time(frames[i].first, frames[i].second.second);
+        if (segmentStart.msecsTo(time) >= segmentMs) {
+            result.append(qMakePair(first, i - 1));
+            first = i;
+            segmentStart = time;
+        }
+    }
+    result.append(qMakePair(first, static_cast<int>(frames.size()) - 1));
+    return result;
+}
+
+bool ClipExporter::encodeSegment(int first, int last, const QString &path)
+{
+    // The last frame lasts until the next segment starts, so the joined clip
+    // keeps the time between segments
+    ClipMuxer muxer(path);
+    muxer.setFrameSize(frameSize); // The joined segments are stream copied, one size for all
+    if (last + 1 < frames.size()) {
+        muxer.setEnd(QDateTime(frames[last + 1].first, frames[last + 1].second.second));
+    }
+    muxer.setCancelFlag(&cancelled);
+    muxer.setProgressCounter(&written);
+    return muxer.write(frames, first, last);
+}
+
+bool ClipExporter::concatenate(const QStringList &parts)
+{
+    QString listPath = partsPath + "/segments.txt";
+    QFile list(listPath);
+    if (!list.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Error writing segment list:" << list.errorString();
+        return false;
+    }
+    QTextStream out(&list);
+    for (const QString &part : parts) {
+        out << "file '" << QFileInfo(part).fileName() << "'\n";
+    }
+    list.close();
+
+    // Stream copy, the segments were encoded with the same settings and
+    // frame size and carry their own timestamps
+    QProcess ffmpeg;
+    ffmpeg.start("ffmpeg", {"-y", "-v", "error", "-nostats", "-progress", "pipe:1",
+                            "-f", "concat", "-safe", "0", "-i", listPath,
+                            "-c", "copy", "-movflags", "+faststart", filePath});
+    if (!ffmpeg.waitForStarted()) {
+        qDebug() << "Could not run ffmpeg to join the segments";
+        return false;
+    }
+
+    // Joined frames are estimated from the time copied so far
+    qint64 totalMs = std::max<qint64>(1, QDateTime(frames.first().first, frames.first().second.second)
+                                             .msecsTo(QDateTime(frames.last().first, frames.last().second.second)));
+    while (!ffmpeg.waitForFinished(pollMs) && ffmpeg.state() != QProcess::NotRunning) {
+        while (ffmpeg.canReadLine()) {
+            QByteArray line = ffmpeg.readLine().trimmed();
+            if (line.startsWith("out_time_us=")) {
+                qint64 copiedMs = line.mid(12).toLongLong() / 1000;
+                joined.storeRelaxed(static_cast<int>(std::min<qint64>(frames.size(), frames.size() * copiedMs / totalMs)));
+            }
+        }
+        if (cancelled.loadRelaxed()) {
+            ffmpeg.kill();
+            ffmpeg.waitForFinished();
+            return false;
+        }
+    }
+    joined.storeRelaxed(frames.size());
+    if (ffmpeg.exitStatus() != QProcess::NormalExit || ffmpeg.exitCode() != 0) {
+        qDebug() << "ffmpeg failed to join the segments:" << ffmpeg.readAllStandardError();
+        return false;
+    }
+    return true;
+}
+
+void ClipExporter::run()
+{
+    if (ranges.size() == 1) {
+        bool ok = encodeSegment(ranges[0].first, ranges[0].second, filePath);
+        QMetaObject::invokeMethod(this, [this, ok]() { finish(ok); }, Qt::QueuedConnection);
+        return;
+    }
+
+    QDir().mkpath(partsPath);
+    QStringList parts;
+    QVector<QFuture<bool>> encodes;
+    for (int i = 0; i < ranges.size(); ++i) {
+        QString part = QString("%1/segment_%2.mp4").arg(partsPath).arg(i, 5, 10, QChar('0'));
+        parts.append(part);
+        int first = ranges[i].first;
+        int last = ranges[i].second;
+        encodes.append(QtConcurrent::run(&encodePool, [this, first, last, part]() {
+            return encodeSegment(first, last, part);
+        }));
+    }
+
+    bool ok = true;
+    for (QFuture<bool> &encode : encodes) {
+        ok = encode.result() && ok;
+    }
+    if (ok && !cancelled.loadRelaxed()) {
+        ok = concatenate(parts);
+    }
+    QDir(partsPath).removeRecursively();
+
+    QMetaObject::invokeMethod(this, [this, ok]() { finish(ok); }, Qt::QueuedConnection);
+}
+
+void ClipExporter::reportProgress()
+{
+    qint64 done = written.loadRelaxed() + joined.loadRelaxed();
+    qint64 remainingMs = -1;
+    if (done > 0) {
+        remainingMs = elapsed.elapsed() * std::max<qint64>(0, totalWork - done) / done;
+    }
+    emit progress(static_cast<int>(done), totalWork, remainingMs);
+}
+
+void ClipExporter::finish(bool ok)
+{
+    progressTimer->stop();
+    if (cancelled.loadRelaxed()) {
+        ok = false;
+        QFile::remove(filePath);
+        qDebug() << "Export cancelled:" << filePath;
+    } else if (ok) {
+        qDebug() << "Video recording saved: " << filePath << "in" << elapsed.elapsed() << "ms";
+    } else {
+        qDebug() << "Export failed:" << filePath;
+    }
+    emit finished(ok, filePath);
+    deleteLater();
+}
@@ -0,0 +1,76 @@
+#ifndef CLIPEXPORTER_H
+#define CLIPEXPORTER_H
+
+#include <QAtomicInt>
+#include <QDate>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QThreadPool>
+#include <QTime>
+#include <QTimer>
+#include <QVector>
+#include <opencv2/opencv.hpp>
+
+class QProgressDialog;
+class QWidget;
+
+// Writes a long range of frames to one MP4 using every core. The range is
+// cut into segments of a minute of capture time. Each segment is encoded
+// by its own ClipMuxer, so it starts on a keyframe, at the size of the
+// range's first frame. ffmpeg's concat demuxer then joins the segments
+// without re-encoding. Ranges that fit in one segment are written straight
+// to the file.
+//
+// Progress covers the whole job: staging, the encodes and the join. Cancel
+// stops the ffmpeg runs as well.
+//
+// Lives on the GUI thread and deletes itself once finished has been emitted.
+class ClipExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Frame = QPair<QDate, QPair<cv::Mat, QTime>>;
+
+    ClipExporter(const QVector<Frame> &frames, const QString &filePath, QObject *parent = nullptr);
+    ~ClipExporter();
+
+    void start();
+    void cancel();
+
+    // Progress dialog with an ETA, its Cancel button cancels the export
+    QProgressDialog *showProgress(QWidget *parent, const QString &title);
+
+signals:
+    void progress(int done, int total, qint64 remainingMs); // In units of work, not frames
+    void finished(bool ok, const QString &filePath);
+
+private:
+    QVector<Frame> frames;
+    QString filePath;
+    QString partsPath;
+    cv::Size frameSize;
+
+    QThreadPool encodePool;
+    QVector<QPair<int, int>> ranges;
+    int totalWork = 0;  // Staging and encoding each frame, then joining
+    QAtomicInt written; // Frames staged and encoded
+    QAtomicInt joined;  // Frames joined so far, by the time copied
+    QAtomicInt cancelled;
+    QTimer *progressTimer;
+    QElapsedTimer elapsed;
+
+    static const int segmentMs = 60000;
+    static const int pollMs = 250;
+
+    QVector<QPair<int, int>> segments() const;
+    bool encodeSegment(int first, int last, const QString &path);
+    bool concatenate(const QStringList &parts);
+    void run();
+    void reportProgress();
+    void finish(bool ok);
+};
+
+#endif // CLIPEXPORTER_H
@@ -0,0 +1,472 @@
+#include "clipmuxer.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QProcess>
+#include <QSettings>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+
+ClipMuxer::ClipMuxer(const QString &filePath)
+    : filePath(filePath)
+{
+}
+
+void ClipMuxer::setEnd(const QDateTime &time)
+{
+    end = time;
+}
+
+void ClipMuxer::setFrameSize(const cv::Size &size)
+{
+    frameSize = size;
+}
+
+void ClipMuxer::setCancelFlag(const QAtomicInt *flag)
+{
+    cancelled = flag;
+}
+
+void ClipMuxer::setProgressCounter(QAtomicInt *counter)
+{
+    written = counter;
+}
+
+void ClipMuxer::setRecoveryInfo(const QString &kind, const QString &cameraName)
+{
+    this->kind = kind;
+    this->cameraName = cameraName;
+}
+
+bool ClipMuxer::write(const QVector<Frame> &frames, int first, int last)
+{
+    if (first < 0 || last >= frames.size() || first > last) {
+        qDebug() << "Invalid frame indexes for recording.";
+        return false;
+    }
+
+    for (int i = first; i <= last; ++i) {
+        if (cancelled && cancelled->loadRelaxed()) {
+            return false;
+        }
+        if (written) {
+            written->fetchAndAddRelaxed(1);
+        }
+        if (!add(QDateTime(frames[i].first, frames[i].second.second), frames[i].second.first)) {
+            return false;
+        }
+    }
+    if (!finish()) {
+        return false;
+    }
+
+    // Skipped frames were never encoded, the count still has to add up
+    if (written) {
+        written->fetchAndAddRelaxed(std::max(0, last - first + 1 - encoded));
+    }
+    return true;
+}
+
+bool ClipMuxer::add(const QDateTime &time, const cv::Mat &frame)
+{
+    // Frames from a clock that stepped back are skipped, a duration has to
+    // be positive
+    if (!times.isEmpty() && time <= times.last()) {
+        return true;
+    }
+    // The encoder takes one size per clip, frames from after a change of
+    // the camera's scale are brought to the size the clip started with or
+    // was given
+    cv::Mat still = frame;
+    if (frameSize.empty()) {
+        frameSize = frame.size();
+    } else if (frame.size() != frameSize) {
+        cv::resize(frame, still, frameSize, 0, 0, cv::INTER_AREA);
+    }
+
+    if (!stills && !openStaging()) {
+        return false;
+    }
+
+    QString file = QString("%1.jpg").arg(files.size(), 6, 10, QChar('0'));
+    if (!cv::imwrite(stills->filePath(file).toStdString(), still, {cv::IMWRITE_JPEG_QUALITY, 95})) {
+        qDebug() << "Error writing frame" << files.size() << "for" << filePath;
+        return false;
+    }
+    files.append(file);
+    times.append(time);
+
+    // Only listed once the still is on disk, recovery trusts the list
+    QTextStream out(&timesFile);
+    out << file << ' ' << time.toMSecsSinceEpoch() << '\n';
+    out.flush();
+    timesFile.flush();
+    return true;
+}
+
+bool ClipMuxer::openStaging()
+{
+    stills = std::make_unique<QTemporaryDir>(filePath + ".frames-XXXXXX");
+    if (!stills->isValid()) {
+        qDebug() << "Error creating a folder for the frames of" << filePath;
+        stills.reset();
+        return false;
+    }
+
+    QSettings manifest(stills->filePath("manifest.ini"), QSettings::IniFormat);
+    manifest.setValue("file", QFileInfo(filePath).absoluteFilePath());
+    manifest.setValue("kind", kind);
+    manifest.setValue("camera", cameraName);
+    manifest.setValue("session", session());
+    manifest.sync();
+
+    timesFile.setFileName(stills->filePath("times.txt"));
+    if (!timesFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Error writing frame times:" << timesFile.errorString();
+        stills.reset();
+        return false;
+    }
+    return true;
+}
+
+bool ClipMuxer::finish()
+{
+    if (files.isEmpty()) {
+        qDebug() << "No frames to write to" << filePath;
+        return false;
+    }
+    timesFile.close();
+
+    qint64 lastMs = nominalFrameMs;
+    if (end.isValid() && times.last().msecsTo(end) > 0) {
+        lastMs = times.last().msecsTo(end);
+    }
+    wallClock = times.first().msecsTo(times.last()) + lastMs;
+
+    QFile list(stills->filePath("frames.ffconcat"));
+    if (!list.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Error writing frame list:" << list.errorString();
+        return false;
+    }
+    QTextStream out(&list);
+    out << "ffconcat version 1.0\n";
+    for (int i = 0; i < files.size(); ++i) {
+        qint64 durationMs = i + 1 < files.size() ? times[i].msecsTo(times[i + 1]) : lastMs;
+        out << "file '" << files[i] << "'\n";
+        out << "duration " << QString::number(durationMs / 1000.0, 'f', 3) << "\n";
+    }
+    // The demuxer ignores the last duration unless the file is listed again
+    out << "file '" << files.last() << "'\n";
+    list.close();
+
+    if (!encode(stills->path())) {
+        return false;
+    }
+
+    // The clip has to be as long as the time it covers
+    probed = probeDurationMs(filePath);
+    qint64 tolerance = std::max<qint64>(500, wallClock / 50);
+    if (probed < 0 || std::abs(probed - wallClock) > tolerance) {
+        qDebug() << "Clip length" << probed << "ms does not match the wall clock" << wallClock << "ms:" << filePath;
+    }
+    return true;
+}
+
+bool ClipMuxer::encode(const QString &folder)
+{
+    // Fragmented, so a file cut off mid-write still plays up to its last
+    // fragment. faststart does not apply, the index is in every fragment.
+    QString partPath = filePath + ".part";
+
+    // Described next to the part file as well, a part left without its
+    // stills can still be registered
+    QString infoPath = partPath + ".ini";
+    if (!kind.isEmpty() && !times.isEmpty()) {
+        QSettings info(infoPath, QSettings::IniFormat);
+        info.setValue("kind", kind);
+        info.setValue("camera", cameraName);
+        info.setValue("start", times.first().toMSecsSinceEpoch());
+        info.sync();
+    }
+
+    QProcess ffmpeg;
+    ffmpeg.start("ffmpeg", {"-y", "-v", "error", "-nostats", "-progress", "pipe:1",
+                            "-f", "concat", "-safe", "0", "-i", folder + "/frames.ffconcat",
+                            "-fps_mode", "vfr", "-vf", "scale=trunc(iw/2)*2:trunc(ih/2)*2",
+                            "-c:v", "libx264", "-preset", "veryfast", "-pix_fmt", "yuv420p",
+                            "-force_key_frames", QString("expr:gte(t,n_forced*%1)").arg(fragmentSeconds),
+                            "-movflags", "+frag_keyframe+empty_moov+default_base_moof",
+                            "-frag_duration", QString::number(fragmentSeconds * 1000000),
+                            "-f", "mp4", partPath});
+    if (!ffmpeg.waitForStarted()) {
+        qDebug() << "Could not run ffmpeg to write" << filePath;
+        QFile::remove(infoPath);
+        return false;
+    }
+    while (!ffmpeg.waitForFinished(pollMs) && ffmpeg.state() != QProcess::NotRunning) {
+        countEncoded(ffmpeg);
+        if (cancelled && cancelled->loadRelaxed()) {
+            ffmpeg.kill();
+            ffmpeg.waitForFinished();
+            QFile::remove(partPath);
+            QFile::remove(infoPath);
+            return false;
+        }
+    }
+    countEncoded(ffmpeg);
+    if (ffmpeg.exitStatus() != QProcess::NormalExit || ffmpeg.exitCode() != 0) {
+        qDebug() << "ffmpeg failed to write" << filePath << ":" << ffmpeg.readAllStandardError();
+        QFile::remove(partPath);
+        QFile::remove(infoPath);
+        return false;
+    }
+
+    QFile::remove(filePath);
+    if (!QFile::rename(partPath, filePath)) {
+        qDebug() << "Error moving" << partPath << "into place";
+        return false;
+    }
+    QFile::remove(infoPath);
+    return true;
+}
+
+void ClipMuxer::countEncoded(QProcess &ffmpeg)
+{
+    // -progress writes key=value blocks, frame= is the running total. The
+    // last still is listed twice, it is not counted twice.
+    int frame = encoded;
+    while (ffmpeg.canReadLine()) {
+        QByteArray line = ffmpeg.readLine().trimmed();
+        if (line.startsWith("frame=")) {
+            frame = std::min<int>(line.mid(6).toInt(), files.size());
+        }
+    }
+    if (written && frame > encoded) {
+        written->fetchAndAddRelaxed(frame - encoded);
+    }
+    encoded = std::max(encoded, frame);
+}
+
+qint64 ClipMuxer::probeDurationMs(const QString &path)
+{
+    QProcess ffprobe;
+    ffprobe.start("ffprobe", {"-v", "error", "-show_entries", "format=duration",
+                              "-of", "default=noprint_wrappers=1:nokey=1", path});
+    if (!ffprobe.waitForStarted() || !ffprobe.waitForFinished()) {
+        return -1;
+    }
+    bool ok = false;
+    double seconds = ffprobe.readAllStandardOutput().trimmed().toDouble(&ok);
+    return ok ? static_cast<qint64>(seconds * 1000) : -1;
+}
+
+QString ClipMuxer::session()
+{
+    // Staging folders of this run are still being written to
+    static const QString id = QString("%1-%2").arg(QCoreApplication::applicationPid()).arg(QDateTime::currentMSecsSinceEpoch());
+    return id;
+}
+
+QVector<ClipMuxer::Recovered> ClipMuxer::recover(const QString &folder, bool subfolders)
+{
+    QVector<Recovered> recovered;
+    QDirIterator::IteratorFlags flags = subfolders ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags;
+
+    // Staged stills first, they give the whole clip
+    QStringList staging;
+    QDirIterator dirs(folder, {"*.frames-*"}, QDir::Dirs | QDir::NoDotAndDotDot, flags);
+    while (dirs.hasNext()) {
+        staging.append(dirs.next());
+    }
+    for (const QString &path : staging) {
+        QSettings manifest(path + "/manifest.ini", QSettings::IniFormat);
+        QString owner = manifest.value("session").toString();
+        if (owner == session()
+            || (owner.isEmpty() && QFileInfo(path).lastModified().secsTo(QDateTime::currentDateTime()) < 60)) {
+            continue; // Staged by this run, or just created and not described yet
+        }
+        Recovered clip = recoverStaging(path);
+        QDir(path).removeRecursively();
+        if (!clip.filePath.isEmpty()) {
+            recovered.append(clip);
+        }
+    }
+
+    // Then files cut off while ffmpeg was writing them, without stills
+    QStringList parts;
+    QDirIterator files(folder, {"*.part"}, QDir::Files, flags);
+    while (files.hasNext()) {
+        parts.append(files.next());
+    }
+    for (const QString &part : parts) {
+        QString target = part.left(part.size() - 5);
+        if (QFileInfo(part).lastModified().secsTo(QDateTime::currentDateTime()) < 60) {
+            continue; // Possibly being written by this run
+        }
+
+        Recovered clip;
+        {
+            QSettings info(part + ".ini", QSettings::IniFormat);
+            clip.kind = info.value("kind").toString();
+            clip.cameraName = info.value("camera").toString();
+            clip.start = QDateTime::fromMSecsSinceEpoch(info.value("start", -1).toLongLong());
+        }
+        QFile::remove(part + ".ini");
+
+        if (!truncateToFragments(part) || QFileInfo::exists(target) || !QFile::rename(part, target)) {
+            qDebug() << "Removing unrecoverable" << part;
+            QFile::remove(part);
+            continue;
+        }
+        if (clip.kind.isEmpty() || clip.start.toMSecsSinceEpoch() < 0) {
+            // Without a description the clip cannot be registered, but it plays
+            qDebug() << "Recovered" << target << "up to its last fragment, it is not registered";
+            continue;
+        }
+
+        clip.filePath = target;
+        clip.end = clip.start.addMSecs(std::max<qint64>(0, probeDurationMs(target)));
+        clip.bytes = QFileInfo(target).size();
+        qDebug() << "Recovered" << target << "up to its last fragment, from" << clip.start.toString("hh:mm:ss")
+                 << "to" << clip.end.toString("hh:mm:ss");
+        recovered.append(clip);
+    }
+    return recovered;
+}
+
+ClipMuxer::Recovered ClipMuxer::recoverStaging(const QString &folder)
+{
+    Recovered clip;
+    QSettings manifest(folder + "/manifest.ini", QSettings::IniFormat);
+    QString kind = manifest.value("kind").toString();
+    QString target = manifest.value("file").toString();
+    if (kind.isEmpty() || target.isEmpty()) {
+        // Pieces of an export, nothing to register them under
+        qDebug() << "Dropping interrupted staging" << folder;
+        if (!target.isEmpty()) {
+            QFile::remove(target + ".part");
+            QFile::remove(target + ".part.ini");
+        }
+        return clip;
+    }
+
+    // Every complete line of the time list names a still that is on disk
+    QFile timesFile(folder + "/times.txt");
+    QStringList stills;
+    QVector<QDateTime> times;
+    if (timesFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        while (!timesFile.atEnd()) {
+            QByteArray line = timesFile.readLine();
+            if (!line.endsWith('\n')) {
+                break;
+            }
+            QList<QByteArray> fields = line.trimmed().split(' ');
+            bool ok = false;
+            qint64 ms = fields.size() == 2 ? fields[1].toLongLong(&ok) : 0;
+            if (!ok || !QFileInfo::exists(folder + "/" + fields[0])) {
+                break;
+            }
+            stills.append(QString::fromUtf8(fields[0]));
+            times.append(QDateTime::fromMSecsSinceEpoch(ms));
+        }
+    }
+
+    ClipMuxer muxer(target);
+    muxer.setRecoveryInfo(kind, manifest.value("camera").toString());
+    bool ok = false;
+    if (!stills.isEmpty() && muxer.openStaging()) {
+        // Moved into a staging folder of this run, so a crash during
+        // recovery leaves them for the next one
+        QTextStream out(&muxer.timesFile);
+        ok = true;
+        for (int i = 0; ok && i < stills.size(); ++i) {
+            QString file = QString("%1.jpg").arg(i, 6, 10, QChar('0'));
+            ok = QFile::rename(folder + "/" + stills[i], muxer.stills->filePath(file));
+            muxer.files.append(file);
+            muxer.times.append(times[i]);
+            out << file << ' ' << times[i].toMSecsSinceEpoch() << '\n';
+        }
+        out.flush();
+        ok = ok && muxer.finish();
+    }
+
+    // No stills left, or they would not encode: a part file still plays up
+    // to its last complete fragment
+    if (!ok && QFileInfo::exists(target + ".part") && truncateToFragments(target + ".part")) {
+        QFile::remove(target);
+        ok = QFile::rename(target + ".part", target);
+        qint64 probedMs = probeDurationMs(target);
+        if (ok && !times.isEmpty()) {
+            times = {times.first(), times.first().addMSecs(std::max<qint64>(0, probedMs))};
+        }
+    }
+    QFile::remove(target + ".part.ini");
+    if (!ok) {
+        qDebug() << "Could not recover" << target;
+        QFile::remove(target + ".part");
+        return clip;
+    }
+    if (times.isEmpty()) {
+        qDebug() << "Recovered" << target << "without capture times, it is not registered";
+        return clip;
+    }
+
+    clip.kind = kind;
+    clip.cameraName = manifest.value("camera").toString();
+    clip.filePath = target;
+    clip.start = times.first();
+    clip.end = muxer.wallClockMs() > 0 ? times.first().addMSecs(muxer.wallClockMs()) : times.last();
+    clip.bytes = QFileInfo(target).size();
+    qDebug() << "Recovered" << target << "from" << clip.start.toString("hh:mm:ss") << "to" << clip.end.toString("hh:mm:ss");
+    return clip;
+}
+
+bool ClipMuxer::truncateToFragments(const QString &path)
+{
+    // Walks the top level boxes: ftyp and moov, then moof and mdat pairs.
+    // Everything after the last complete mdat is cut off.
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    qint64 size = file.size();
+    qint64 offset = 0;
+    qint64 goodEnd = 0;
+    bool haveMoov = false;
+    bool haveMoof = false;
+    while (offset + 8 <= size) {
+        file.seek(offset);
+        QByteArray header = file.read(16);
+        qint64 boxSize = qFromBigEndian<quint32>(header.constData());
+        QByteArray type = header.mid(4, 4);
+        if (boxSize == 1 && header.size() == 16) {
+            boxSize = static_cast<qint64>(qFromBigEndian<quint64>(header.constData() + 8));
+        }
+        if (boxSize < 8 || offset + boxSize > size) {
+            break;
+        }
+        offset += boxSize;
+
+        if (type == "moov") {
+            haveMoov = true;
+        } else if (type == "moof") {
+            haveMoof = true;
+        } else if (type == "mdat" && haveMoov && haveMoof) {
+            goodEnd = offset;
+            haveMoof = false;
+        }
+    }
+
+    if (goodEnd == 0) {
+        return false;
+    }
+    if (goodEnd < size && !file.resize(goodEnd)) {
+        return false;
+    }
+    return true;
+}
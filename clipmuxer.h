@@ -0,0 +1,119 @@
+#ifndef CLIPMUXER_H
+#define CLIPMUXER_H
+
+#include <QAtomicInt>
+#include <QDate>
+#include <QDateTime>
+#include <QFile>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTime>
+#include <QVector>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+class QProcess;
+
+// Writes frames to an MP4 at their capture times instead of a fixed rate.
+// The frames go to ffmpeg's concat demuxer as stills, each with its own
+// duration up to the next frame, and come out as variable frame rate H.264.
+// Capture drift no longer changes the playback speed.
+//
+// Read errors leave gaps, not filler: the frame before a gap stays on
+// screen until the next one, so the clip keeps wall clock length. finish()
+// checks that with ffprobe.
+//
+// Crash safety: stills are staged next to the clip in <file>.frames-XXXXXX
+// as they are added, with a manifest and a capture time list flushed after
+// every frame. The MP4 is fragmented, a keyframe and fragment every two
+// seconds, and written to <file>.part until it is complete, described in
+// <file>.part.ini. A process that dies leaves the staging folder or the
+// .part file behind, and recover() turns either back into a playable clip.
+class ClipMuxer
+{
+public:
+    using Frame = QPair<QDate, QPair<cv::Mat, QTime>>;
+
+    struct Recovered
+    {
+        QString kind;       // As given to setRecoveryInfo
+        QString cameraName;
+        QString filePath;
+        QDateTime start;
+        QDateTime end;
+        qint64 bytes = 0;
+    };
+
+    explicit ClipMuxer(const QString &filePath);
+
+    // Shows the last frame until end, otherwise for one frame at 30 fps
+    void setEnd(const QDateTime &end);
+
+    // Size every frame is brought to, by default the first frame's. Clips
+    // that are joined later have to share one.
+    void setFrameSize(const cv::Size &size);
+
+    // Checked between frames and while ffmpeg runs, a set flag stops the
+    // write
+    void setCancelFlag(const QAtomicInt *cancelled);
+
+    // Counts every frame in the range twice, once as it is staged and once
+    // as ffmpeg has encoded it, so a write adds up to twice its length
+    void setProgressCounter(QAtomicInt *written);
+
+    // Kept in the staging manifest, recover() hands them back so the clip
+    // can be registered where it belongs. Clips without a kind are dropped.
+    void setRecoveryInfo(const QString &kind, const QString &cameraName);
+
+    // Frames first..last of frames
+    bool write(const QVector<Frame> &frames, int first, int last);
+
+    // Or one frame at a time as they arrive, then finish()
+    bool add(const QDateTime &time, const cv::Mat &frame);
+    bool finish();
+    bool isEmpty() const { return files.isEmpty(); }
+    QDateTime firstTime() const { return times.isEmpty() ? QDateTime() : times.first(); }
+    QDateTime lastTime() const { return times.isEmpty() ? QDateTime() : times.last(); }
+
+    // Length of the footage by capture times, and as read back from the file
+    qint64 wallClockMs() const { return wallClock; }
+    qint64 probedMs() const { return probed; }
+
+    static qint64 probeDurationMs(const QString &path);
+
+    // Finishes clips an earlier run left behind in folder, and with
+    // subfolders anywhere under it
+    static QVector<Recovered> recover(const QString &folder, bool subfolders);
+
+private:
+    QString filePath;
+    QDateTime end;
+    const QAtomicInt *cancelled = nullptr;
+    QAtomicInt *written = nullptr;
+    qint64 wallClock = 0;
+    qint64 probed = -1;
+    int encoded = 0; // Frames ffmpeg reported, as counted in written
+
+    QString kind;
+    QString cameraName;
+    std::unique_ptr<QTemporaryDir> stills;
+    QFile timesFile;
+    QStringList files;
+    QVector<QDateTime> times;
+    cv::Size frameSize;
+
+    static const int nominalFrameMs = 33;
+    static const int fragmentSeconds = 2;
+    static const int pollMs = 250;
+
+    bool openStaging();
+    bool encode(const QString &folder);
+    void countEncoded(QProcess &ffmpeg);
+    static QString session();
+    static bool truncateToFragments(const QString &path);
+    static Recovered recoverStaging(const QString &folder);
+};
+
+#endif // CLIPMUXER_H
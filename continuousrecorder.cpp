@@ -0,0 +1,549 @@
+#include "continuousrecorder.h"
+#include "clipmuxer.h"
+#include "recordingworker.h"
+#include "storagemanager.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+
+namespace {
+
+QString folderName(const QString &cameraName)
+{
+    // Camera names are free text, keep them out of the path syntax
+    QString name = cameraName;
+    name.replace(QRegularExpression(R"([\\/:*?"<>|])"), "_");
+    return name.isEmpty() ? "_" : name;
+}
+
+QSqlDatabase openConnection(const QString &prefix, const QString &databasePath, QString &connectionName)
+{
+    // SQLite connections belong to the thread that opened them
+    connectionName = QString("%1_%2").arg(prefix).arg(reinterpret_cast<quintptr>(QThread::currentThread()));
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(databasePath);
+    if (!db.open()) {
+        qDebug() << prefix << ": failed to open" << databasePath << db.lastError().text();
+        return db;
+    }
+
+    // The frame loop and the UI use their own connections while this one writes
+    QSqlQuery query(db);
+    query.exec("PRAGMA journal_mode=WAL");
+    ContinuousRecorder::createTables(db);
+    return db;
+}
+
+} // namespace
+
+const QString ContinuousRecorder::segmentKind = "segment";
+
+ContinuousRecorder::ContinuousRecorder(const QString &databasePath, StorageManager *storage, QObject *parent)
+    : QObject(parent), databasePath(databasePath), storage(storage)
+{
+    encodePool.setMaxThreadCount(encodeThreads);
+    stagePool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+}
+
+void ContinuousRecorder::append(const QString &cameraName, const QDateTime &capturedAt, const cv::Mat &frame)
+{
+    QMutexLocker locker(&pendingMutex);
+    if (pending.size() >= maxPending) {
+        ++droppedFrames[pending.first().cameraName];
+        pending.removeFirst();
+    }
+    pending.append({cameraName, capturedAt, frame});
+}
+
+bool ContinuousRecorder::createTables(QSqlDatabase db)
+{
+    QSqlQuery query(db);
+    if (!query.exec("CREATE TABLE IF NOT EXISTS recording_settings ("
+                    "key TEXT PRIMARY KEY NOT NULL,"
+                    "value TEXT"
+                    ")")
+        || !query.exec("CREATE TABLE IF NOT EXISTS recording_segments ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "camera_name TEXT NOT NULL,"
+                       "start_ms INTEGER NOT NULL,"
+                       "end_ms INTEGER NOT NULL,"
+                       "file_name TEXT NOT NULL,"
+                       "size_bytes INTEGER NOT NULL DEFAULT 0"
+                       ")")
+        || !query.exec("CREATE INDEX IF NOT EXISTS recording_segments_camera_start ON recording_segments (camera_name, start_ms)")
+        || !query.exec("CREATE INDEX IF NOT EXISTS recording_segments_start ON recording_segments (start_ms)")) {
+        qDebug() << "ContinuousRecorder: error creating tables:" << query.lastError().text();
+        return false;
+    }
+
+    // Defaults the user can edit in place
+    Settings defaults;
+    const QList<QPair<QString, QString>> values = {
+        {"storage_root", defaults.storageRoot},
+        {"events_root", defaults.eventsRoot},
+        {"segment_seconds", QString::number(defaults.segmentSeconds)},
+        {"retention_days", QString::number(defaults.retentionDays)},
+        {"quota_gb", QString::number(defaults.quotaGb)},
+        {"cpu_budget", QString::number(defaults.cpuBudget)},
+        {"latency_target_ms", QString::number(defaults.latencyTargetMs)}};
+    for (const auto &value : values) {
+        query.prepare("INSERT OR IGNORE INTO recording_settings (key, value) VALUES (:key, :value)");
+        query.bindValue(":key", value.first);
+        query.bindValue(":value", value.second);
+        if (!query.exec()) {
+            qDebug() << "ContinuousRecorder: error writing default" << value.first << ":" << query.lastError().text();
+        }
+    }
+    return true;
+}
+
+ContinuousRecorder::Settings ContinuousRecorder::loadSettings(QSqlDatabase db)
+{
+    Settings settings;
+    QSqlQuery query("SELECT key, value FROM recording_settings", db);
+    while (query.next()) {
+        QString key = query.value(0).toString();
+        QString value = query.value(1).toString().trimmed();
+        if (key == "storage_root" && !value.isEmpty()) {
+            settings.storageRoot = value;
+        } else if (key == "events_root" && !value.isEmpty()) {
+            settings.eventsRoot = value;
+        } else if (key == "segment_seconds") {
+            settings.segmentSeconds = std::clamp(value.toInt(), 10, 3600);
+        } else if (key == "retention_days") {
+            settings.retentionDays = std::max(0, value.toInt());
+        } else if (key == "quota_gb") {
+            settings.quotaGb = std::max(0.0, value.toDouble());
+        } else if (key == "cpu_budget") {
+            settings.cpuBudget = std::clamp(value.toDouble(), 0.1, 64.0);
+        } else if (key == "latency_target_ms") {
+            settings.latencyTargetMs = std::clamp(value.toDouble(), 10.0, 5000.0);
+        }
+    }
+    return settings;
+}
+
+void ContinuousRecorder::start()
+{
+    db = openConnection("continuous_recorder", databasePath, connectionName);
+    if (db.isOpen()) {
+        settings = loadSettings(db);
+    }
+    qDebug() << "ContinuousRecorder: writing" << settings.segmentSeconds << "s segments";
+
+    drainTimer = new QTimer(this);
+    connect(drainTimer, &QTimer::timeout, this, &ContinuousRecorder::processPending);
+    drainTimer->start(500);
+}
+
+void ContinuousRecorder::stop()
+{
+    if (drainTimer) {
+        drainTimer->stop();
+    }
+
+    // Whatever is open is written as a short segment
+    processPending();
+    for (auto it = openSegments.begin(); it != openSegments.end(); ++it) {
+        if (it->muxer) {
+            closeSegment(it.key(), *it, QDateTime());
+        }
+    }
+    openSegments.clear();
+    encodePool.waitForDone();
+    catalogEncoded();
+
+    if (db.isOpen()) {
+        db.close();
+    }
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+qint64 ContinuousRecorder::segmentMs() const
+{
+    return static_cast<qint64>(settings.segmentSeconds) * 1000;
+}
+
+void ContinuousRecorder::processPending()
+{
+    catalogEncoded();
+    reportDropped();
+
+    QVector<Pending> frames;
+    {
+        QMutexLocker locker(&pendingMutex);
+        frames.swap(pending);
+    }
+
+    // Every camera has its entry before any is staged, the tasks hold
+    // references into the hash
+    QMap<QString, QVector<int>> byCamera;
+    for (int i = 0; i < frames.size(); ++i) {
+        byCamera[frames[i].cameraName].append(i);
+        openSegments[frames[i].cameraName];
+    }
+
+    // A camera's frames in order on one thread, the cameras side by side
+    QVector<QFuture<void>> staging;
+    for (auto it = byCamera.cbegin(); it != byCamera.cend(); ++it) {
+        QString cameraName = it.key();
+        QVector<int> indexes = it.value();
+        OpenSegment *segment = &openSegments[cameraName];
+        staging.append(QtConcurrent::run(&stagePool, [this, &frames, cameraName, indexes, segment]() {
+            for (int i : indexes) {
+                stageFrame(cameraName, *segment, frames[i]);
+            }
+        }));
+    }
+    for (QFuture<void> &stage : staging) {
+        stage.waitForFinished();
+    }
+
+    // Cameras that stopped sending frames, or had recording switched off,
+    // still get their last segment once its slot is over
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = openSegments.begin(); it != openSegments.end(); ++it) {
+        if (it->muxer && now > it->slot + segmentMs() + closeGraceMs) {
+            closeSegment(it.key(), *it, QDateTime());
+        }
+    }
+}
+
+void ContinuousRecorder::stageFrame(const QString &cameraName, OpenSegment &segment, const Pending &frame)
+{
+    qint64 ms = frame.capturedAt.toMSecsSinceEpoch();
+    qint64 slot = ms - ms % segmentMs();
+
+    if (segment.muxer && slot != segment.slot) {
+        // The last frame lasts until the slot ends, the next file starts
+        // with the first frame of its own slot
+        QDateTime end = QDateTime::fromMSecsSinceEpoch(std::min(ms, segment.slot + segmentMs()));
+        closeSegment(cameraName, segment, slot > segment.slot ? end : QDateTime());
+    }
+    if (!segment.muxer && !openSegment(cameraName, segment, frame.capturedAt)) {
+        return;
+    }
+    segment.slot = slot;
+
+    // Staged on disk right away, a crash loses at most this drain
+    if (!segment.muxer->add(frame.capturedAt, frame.frame)) {
+        qDebug() << "ContinuousRecorder: dropping segment" << segment.filePath;
+        segment.muxer.reset();
+    }
+}
+
+void ContinuousRecorder::reportDropped()
+{
+    QHash<QString, int> dropped;
+    {
+        QMutexLocker locker(&pendingMutex);
+        QDateTime now = QDateTime::currentDateTime();
+        if (droppedFrames.isEmpty()
+            || (droppedReportedAt.isValid() && droppedReportedAt.secsTo(now) < droppedReportSecs)) {
+            return;
+        }
+        dropped.swap(droppedFrames);
+        droppedReportedAt = now;
+    }
+
+    // The writer fell behind, these frames are missing from the segments
+    for (auto it = dropped.cbegin(); it != dropped.cend(); ++it) {
+        qDebug() << "ContinuousRecorder: write queue full, dropped" << it.value() << "frames of" << it.key();
+    }
+}
+
+bool ContinuousRecorder::openSegment(const QString &cameraName, OpenSegment &segment, const QDateTime &start)
+{
+    // The camera's disk in the continuous pool, the storage root without one
+    QString root = storage ? storage->targetFor(StorageManager::continuousPool, cameraName) : QString();
+    if (root.isEmpty()) {
+        root = settings.storageRoot;
+    }
+    QString folder = QString("%1/%2/%3").arg(root, folderName(cameraName), start.date().toString("yyyy-MM-dd"));
+    if (!QDir().mkpath(folder)) {
+        qDebug() << "ContinuousRecorder: cannot create" << folder;
+        return false;
+    }
+
+    segment.filePath = QString("%1/%2.mp4").arg(folder, start.time().toString("HH-mm-ss"));
+    segment.muxer = std::make_shared<ClipMuxer>(segment.filePath);
+    segment.muxer->setRecoveryInfo(segmentKind, cameraName);
+    return true;
+}
+
+void ContinuousRecorder::closeSegment(const QString &cameraName, OpenSegment &segment, const QDateTime &end)
+{
+    std::shared_ptr<ClipMuxer> muxer;
+    muxer.swap(segment.muxer);
+    if (muxer->isEmpty()) {
+        return; // Only frames from a clock that stepped back
+    }
+
+    if (end.isValid()) {
+        muxer->setEnd(end);
+    }
+
+    // Encoding takes a while, the drain goes on staging the next segments
+    QString filePath = segment.filePath;
+    encodePool.start([this, muxer, cameraName, filePath]() {
+        QElapsedTimer writeTimer;
+        writeTimer.start();
+        bool ok = muxer->finish();
+        qint64 size = ok ? QFileInfo(filePath).size() : 0;
+        if (storage) {
+            storage->recordWrite(cameraName, filePath, size, muxer->wallClockMs(), writeTimer.elapsed(), ok);
+        }
+        if (!ok) {
+            qDebug() << "ContinuousRecorder: failed to write segment" << filePath;
+            QFile::remove(filePath);
+            return;
+        }
+
+        qint64 startMs = muxer->firstTime().toMSecsSinceEpoch();
+        QMutexLocker locker(&encodedMutex);
+        encoded.append({cameraName, startMs, startMs + muxer->wallClockMs(), filePath, size});
+    });
+}
+
+void ContinuousRecorder::catalogEncoded()
+{
+    // The catalog is written over this thread's connection
+    QVector<Encoded> segments;
+    {
+        QMutexLocker locker(&encodedMutex);
+        segments.swap(encoded);
+    }
+    for (const Encoded &segment : segments) {
+        addSegment(db, segment.cameraName, segment.startMs, segment.endMs, segment.filePath, segment.size);
+    }
+}
+
+bool ContinuousRecorder::addSegment(QSqlDatabase db, const QString &cameraName, qint64 startMs, qint64 endMs,
+                                    const QString &filePath, qint64 size)
+{
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO recording_segments (camera_name, start_ms, end_ms, file_name, size_bytes) "
+                  "VALUES (:camera, :start, :end, :file, :size)");
+    query.bindValue(":camera", cameraName);
+    query.bindValue(":start", startMs);
+    query.bindValue(":end", endMs);
+    query.bindValue(":file", filePath);
+    query.bindValue(":size", size);
+    if (!query.exec()) {
+        qDebug() << "ContinuousRecorder: error cataloguing" << filePath << ":" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+RecordingJanitor::RecordingJanitor(const QString &databasePath, StorageManager *storage, QObject *parent)
+    : QObject(parent), databasePath(databasePath), storage(storage)
+{
+}
+
+void RecordingJanitor::start()
+{
+    db = openConnection("recording_janitor", databasePath, connectionName);
+
+    sweepTimer = new QTimer(this);
+    connect(sweepTimer, &QTimer::timeout, this, &RecordingJanitor::sweep);
+    sweepTimer->start(sweepIntervalMs);
+
+    recoverInterrupted();
+    sweep();
+}
+
+void RecordingJanitor::recoverInterrupted()
+{
+    if (!db.isOpen()) {
+        return;
+    }
+
+    // Segments are kept in camera and day folders, event clips and closing
+    // footage right in their target. The archive target is the working
+    // folder by default, which is not walked.
+    QMap<QString, bool> folders; // Path -> with subfolders
+    if (storage) {
+        for (const StorageManager::Target &target : storage->targets(QString())) {
+            folders[target.path] = folders.value(target.path) || target.pool == StorageManager::continuousPool;
+        }
+    }
+    if (folders.isEmpty()) {
+        folders.insert(ContinuousRecorder::loadSettings(db).storageRoot, true);
+    }
+
+    for (auto folder = folders.cbegin(); folder != folders.cend(); ++folder) {
+        for (const ClipMuxer::Recovered &clip : ClipMuxer::recover(folder.key(), folder.value())) {
+            // A crash between the rename and the log leaves a registered clip
+            QSqlQuery existing(db);
+            existing.prepare(clip.kind == ContinuousRecorder::segmentKind
+                                 ? "SELECT COUNT(*) FROM recording_segments WHERE file_name = :file"
+                                 : "SELECT COUNT(*) FROM camera_logs WHERE file_name = :file");
+            existing.bindValue(":file", clip.filePath);
+            if (existing.exec() && existing.next() && existing.value(0).toInt() > 0) {
+                continue;
+            }
+
+            if (clip.kind == ContinuousRecorder::segmentKind) {
+                ContinuousRecorder::addSegment(db, clip.cameraName, clip.start.toMSecsSinceEpoch(),
+                                               clip.end.toMSecsSinceEpoch(), clip.filePath, clip.bytes);
+            } else if (clip.kind == RecordingWorker::eventKind) {
+                RecordingWorker::logRecording(db, clip.cameraName, clip.filePath, clip.start.time(), clip.end.time(), QString());
+            }
+        }
+    }
+}
+
+void RecordingJanitor::stop()
+{
+    if (sweepTimer) {
+        sweepTimer->stop();
+    }
+
+    if (db.isOpen()) {
+        db.close();
+    }
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+void RecordingJanitor::sweep()
+{
+    if (!db.isOpen()) {
+        return;
+    }
+
+    // Read every pass, so changed limits apply without a restart
+    ContinuousRecorder::Settings settings = ContinuousRecorder::loadSettings(db);
+
+    qint64 freed = 0;
+    if (settings.retentionDays > 0) {
+        qint64 cutoff = QDateTime::currentDateTime().addDays(-settings.retentionDays).toMSecsSinceEpoch();
+        freed += removeOldest(cutoff, 0, QString());
+    }
+
+    if (settings.quotaGb > 0) {
+        QSqlQuery query("SELECT COALESCE(SUM(size_bytes), 0) FROM recording_segments", db);
+        qint64 used = query.next() ? query.value(0).toLongLong() : 0;
+        qint64 quota = static_cast<qint64>(settings.quotaGb * 1024 * 1024 * 1024);
+        if (used > quota) {
+            freed += removeOldest(0, used - quota, QString());
+        }
+    }
+
+    // Each disk in the continuous pool also stays within its own quota
+    const QVector<StorageManager::Target> targets = storage ? storage->targets(StorageManager::continuousPool)
+                                                            : QVector<StorageManager::Target>();
+    for (const StorageManager::Target &target : targets) {
+        if (target.quotaBytes == 0) {
+            continue;
+        }
+        QSqlQuery query(db);
+        query.prepare("SELECT COALESCE(SUM(size_bytes), 0) FROM recording_segments WHERE substr(file_name, 1, :length) = :prefix");
+        query.bindValue(":length", target.path.size() + 1);
+        query.bindValue(":prefix", target.path + '/');
+        qint64 used = query.exec() && query.next() ? query.value(0).toLongLong() : 0;
+        if (used > target.quotaBytes) {
+            freed += removeOldest(0, used - target.quotaBytes, target.path + '/');
+        }
+    }
+
+    if (freed > 0) {
+        qDebug() << "RecordingJanitor: freed" << freed / (1024 * 1024) << "MB of recordings";
+    }
+
+    if (storage && ++sweeps % metricsEverySweeps == 0) {
+        storage->logMetrics();
+    }
+}
+
+qint64 RecordingJanitor::removeOldest(qint64 endedBeforeMs, qint64 bytesToFree, const QString &prefix)
+{
+    qint64 freed = 0;
+    int skipped = 0; // Rows left in place, every batch starts after them
+    QDateTime now = QDateTime::currentDateTime();
+    while (true) {
+        QSqlQuery query(db);
+        query.prepare("SELECT id, file_name, size_bytes, end_ms FROM recording_segments "
+                      "WHERE substr(file_name, 1, :length) = :prefix ORDER BY start_ms, id LIMIT :limit OFFSET :offset");
+        query.bindValue(":length", prefix.size());
+        query.bindValue(":prefix", prefix);
+        query.bindValue(":limit", deleteBatch);
+        query.bindValue(":offset", skipped);
+        if (!query.exec()) {
+            qDebug() << "RecordingJanitor: error listing segments:" << query.lastError().text();
+            return freed;
+        }
+
+        QVariantList ids;
+        int rows = 0;
+        bool done = false;
+        while (query.next()) {
+            ++rows;
+            if (query.value(3).toLongLong() >= endedBeforeMs && freed >= bytesToFree) {
+                done = true;
+                break;
+            }
+
+            // A file that would not go lately is left alone for a while, it
+            // must not hold up the ones behind it
+            qint64 id = query.value(0).toLongLong();
+            auto failed = failedDeletes.constFind(id);
+            if (failed != failedDeletes.constEnd() && failed->secsTo(now) < deleteRetrySecs) {
+                ++skipped;
+                continue;
+            }
+
+            QString fileName = query.value(1).toString();
+            if (QFile::exists(fileName) && !QFile::remove(fileName)) {
+                // Likely open in a player
+                qDebug() << "RecordingJanitor: cannot delete" << fileName << "- retrying in" << deleteRetrySecs << "s";
+                failedDeletes.insert(id, now);
+                ++skipped;
+                continue;
+            }
+            failedDeletes.remove(id);
+            // Empty day and camera folders go with their last file
+            QString day = QFileInfo(fileName).absolutePath();
+            if (QDir().rmdir(day)) {
+                QDir().rmdir(QFileInfo(day).absolutePath());
+            }
+
+            ids.append(query.value(0));
+            freed += query.value(2).toLongLong();
+            if (storage) {
+                storage->recordRemoved(fileName, query.value(2).toLongLong());
+            }
+        }
+        query.finish();
+
+        if (!ids.isEmpty()) {
+            db.transaction();
+            QSqlQuery remove(db);
+            remove.prepare("DELETE FROM recording_segments WHERE id = ?");
+            remove.addBindValue(ids);
+            if (!remove.execBatch()) {
+                qDebug() << "RecordingJanitor: error removing segments:" << remove.lastError().text();
+                db.rollback();
+                return freed;
+            }
+            db.commit();
+        }
+
+        if (done || rows < deleteBatch) {
+            return freed;
+        }
+    }
+}
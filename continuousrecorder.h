@@ -0,0 +1,176 @@
+#ifndef CONTINUOUSRECORDER_H
+#define CONTINUOUSRECORDER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+class ClipMuxer;
+class StorageManager;
+
+// Around the clock recording for cameras that have it switched on. Frames are
+// cut into fixed length segments aligned to the wall clock and written as
+// <storage root>/<camera>/<yyyy-MM-dd>/<HH-mm-ss>.mp4, each one listed in the
+// recording_segments table of cameras.db with its time range and size.
+//
+// Lives on its own QThread: the frame loop hands frames over with append(),
+// which only queues them. The worker stages every frame of the open segment
+// on disk through ClipMuxer as it drains the queue, the cameras in parallel,
+// so a crash loses seconds rather than the segment. Frames dropped from a
+// full queue are logged per camera. Once the slot is over the segment is encoded on a
+// small pool, the drain only stages and catalogues what the pool finished.
+// Each camera's segments go to its disk in the continuous storage pool;
+// segment length, retention age and the overall quota come from the
+// recording_settings table, whose storage_root is used without a pool.
+class ContinuousRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Recovery kind of the staged segments
+    static const QString segmentKind;
+
+    struct Settings
+    {
+        QString storageRoot = "Recordings";
+        QString eventsRoot = "C:/FYPPublish/FYPPublish/wwwroot/Anomaly"; // Seeds the events storage pool
+        int segmentSeconds = 60;
+        int retentionDays = 7;
+        double quotaGb = 0.0; // 0 is no quota
+
+        // Limits of the frame loop's load controller, stored here with the
+        // other tunables
+        double cpuBudget = 0.7;         // Share of one core
+        double latencyTargetMs = 100.0; // Longest acceptable pass over all cameras
+    };
+
+    ContinuousRecorder(const QString &databasePath, StorageManager *storage, QObject *parent = nullptr);
+
+    // Thread-safe. Drops the oldest queued frame if the writer falls behind.
+    void append(const QString &cameraName, const QDateTime &capturedAt, const cv::Mat &frame);
+
+    // Creates recording_settings and recording_segments if needed
+    static bool createTables(QSqlDatabase db);
+    static Settings loadSettings(QSqlDatabase db);
+    static bool addSegment(QSqlDatabase db, const QString &cameraName, qint64 startMs, qint64 endMs,
+                           const QString &filePath, qint64 size);
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void processPending();
+
+private:
+    struct Pending
+    {
+        QString cameraName;
+        QDateTime capturedAt;
+        cv::Mat frame;
+    };
+
+    struct OpenSegment
+    {
+        qint64 slot = 0; // Start of the segment's wall clock slot, ms since epoch
+        QString filePath;
+        std::shared_ptr<ClipMuxer> muxer; // Null between segments
+    };
+
+    QString databasePath;
+    StorageManager *storage;
+    QString connectionName;
+    QSqlDatabase db;
+    Settings settings;
+
+    QMutex pendingMutex;
+    QVector<Pending> pending;
+    QHash<QString, int> droppedFrames; // Per camera since the last report
+    QDateTime droppedReportedAt;
+
+    struct Encoded
+    {
+        QString cameraName;
+        qint64 startMs = 0;
+        qint64 endMs = 0;
+        QString filePath;
+        qint64 size = 0;
+    };
+
+    QHash<QString, OpenSegment> openSegments;
+    QTimer *drainTimer = nullptr;
+
+    // Each drain stages the cameras' frames side by side, JPEG encoding
+    // every frame is too slow for one thread with several cameras
+    QThreadPool stagePool;
+
+    // Closed segments are encoded here, the recorder thread catalogues them
+    QThreadPool encodePool;
+    QMutex encodedMutex;
+    QVector<Encoded> encoded;
+
+    static const int maxPending = 3000;
+    static const int closeGraceMs = 5000;
+    static const int encodeThreads = 2;
+    static const int droppedReportSecs = 10;
+
+    qint64 segmentMs() const;
+    bool openSegment(const QString &cameraName, OpenSegment &segment, const QDateTime &start);
+    void closeSegment(const QString &cameraName, OpenSegment &segment, const QDateTime &end);
+    void stageFrame(const QString &cameraName, OpenSegment &segment, const Pending &frame);
+    void reportDropped();
+    void catalogEncoded();
+};
+
+// Enforces the retention policy on its own thread: segments older than the
+// retention age go first, then the oldest until the catalog fits the quota,
+// then the oldest on each disk over its own quota. Files and catalog rows
+// are removed together. Logs the storage metrics every few sweeps.
+//
+// On start it first finishes the event clips and segments a previous run
+// left half written on any storage target and registers them in camera_logs
+// and recording_segments.
+class RecordingJanitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    RecordingJanitor(const QString &databasePath, StorageManager *storage, QObject *parent = nullptr);
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void sweep();
+
+private:
+    QString databasePath;
+    StorageManager *storage;
+    QString connectionName;
+    QSqlDatabase db;
+    QTimer *sweepTimer = nullptr;
+    int sweeps = 0;
+    QHash<qint64, QDateTime> failedDeletes; // Segment id -> last failed delete
+
+    static const int sweepIntervalMs = 60 * 1000;
+    static const int deleteBatch = 200;
+    static const int deleteRetrySecs = 600;
+    static const int metricsEverySweeps = 5;
+
+    // Deletes segments under prefix oldest first while they ended before the
+    // cutoff or until bytesToFree is reached, returns the bytes freed. Files
+    // that cannot be deleted are skipped and retried after a while.
+    qint64 removeOldest(qint64 endedBeforeMs, qint64 bytesToFree, const QString &prefix);
+    void recoverInterrupted();
+};
+
+#endif // CONTINUOUSRECORDER_H
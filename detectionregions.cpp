@@ -0,0 +1,102 @@
+#include "detectionregions.h"
+
+#include <QStringList>
+
+QVector<QPolygonF> DetectionRegions::parse(const QString &text)
+{
+    QVector<QPolygonF> polygons;
+
+    const QStringList polygonTexts = text.split(';', Qt::SkipEmptyParts);
+    for (const QString &polygonText : polygonTexts) {
+        QPolygonF polygon;
+        const QStringList points = polygonText.split(' ', Qt::SkipEmptyParts);
+        for (const QString &pointText : points) {
+            QStringList xy = pointText.split(',');
+            if (xy.size() != 2) {
+                continue;
+            }
+            polygon << QPointF(qBound(0.0, xy[0].toDouble(), 1.0), qBound(0.0, xy[1].toDouble(), 1.0));
+        }
+
+        if (polygon.size() >= 3) {
+            polygons.append(polygon);
+        }
+    }
+
+    return polygons;
+}
+
+QString DetectionRegions::format(const QVector<QPolygonF> &polygons)
+{
+    QStringList polygonTexts;
+    for (const QPolygonF &polygon : polygons) {
+        QStringList points;
+        for (const QPointF &point : polygon) {
+            points << QString::number(point.x(), 'f', 4) + "," + QString::number(point.y(), 'f', 4);
+        }
+        polygonTexts << points.join(' ');
+    }
+    return polygonTexts.join(';');
+}
+
+std::vector<cv::Point> DetectionRegions::toPixels(const QPolygonF &polygon, const cv::Size &frameSize)
+{
+    std::vector<cv::Point> pixels;
+    pixels.reserve(polygon.size());
+    for (const QPointF &point : polygon) {
+        pixels.emplace_back(cvRound(point.x() * frameSize.width), cvRound(point.y() * frameSize.height));
+    }
+    return pixels;
+}
+
+cv::Rect DetectionRegions::boundingRect(const cv::Size &frameSize) const
+{
+    cv::Rect frameRect(cv::Point(0, 0), frameSize);
+    if (include.isEmpty()) {
+        return frameRect;
+    }
+
+    cv::Rect bounds;
+    for (const QPolygonF &polygon : include) {
+        cv::Rect polygonBounds = cv::boundingRect(toPixels(polygon, frameSize));
+        bounds = bounds.empty() ? polygonBounds : (bounds | polygonBounds);
+    }
+    return bounds & frameRect;
+}
+
+const cv::Mat &DetectionRegions::mask(const cv::Size &frameSize) const
+{
+    if (cachedMask.size() == frameSize) {
+        return cachedMask;
+    }
+
+    if (include.isEmpty()) {
+        cachedMask = cv::Mat(frameSize, CV_8UC1, cv::Scalar(255));
+    } else {
+        cachedMask = cv::Mat::zeros(frameSize, CV_8UC1);
+        for (const QPolygonF &polygon : include) {
+            std::vector<std::vector<cv::Point>> pixels = {toPixels(polygon, frameSize)};
+            cv::fillPoly(cachedMask, pixels, cv::Scalar(255));
+        }
+    }
+
+    for (const QPolygonF &polygon : exclude) {
+        std::vector<std::vector<cv::Point>> pixels = {toPixels(polygon, frameSize)};
+        cv::fillPoly(cachedMask, pixels, cv::Scalar(0));
+    }
+
+    return cachedMask;
+}
+
+bool DetectionRegions::contains(const cv::Point &point, const cv::Size &frameSize) const
+{
+    if (isEmpty()) {
+        return true;
+    }
+
+    const cv::Mat &allowed = mask(frameSize);
+    if (point.x < 0 || point.y < 0 || point.x >= allowed.cols || point.y >= allowed.rows) {
+        return false;
+    }
+    return allowed.at<uchar>(point) != 0;
+}
@@ -0,0 +1,38 @@
+#ifndef DETECTIONREGIONS_H
+#define DETECTIONREGIONS_H
+
+#include <QPolygonF>
+#include <QString>
+#include <QVector>
+#include <opencv2/opencv.hpp>
+
+// Per-camera areas of interest and exclusion masks. Polygons are stored
+// normalised to 0..1 so they survive changes of stream or display scale.
+// An empty include list means the whole frame.
+class DetectionRegions
+{
+public:
+    QVector<QPolygonF> include;
+    QVector<QPolygonF> exclude;
+
+    bool isEmpty() const { return include.isEmpty() && exclude.isEmpty(); }
+
+    // "x,y x,y x,y;x,y ..." - polygons separated by ';'
+    static QVector<QPolygonF> parse(const QString &text);
+    static QString format(const QVector<QPolygonF> &polygons);
+
+    // Smallest rectangle holding every include polygon, clipped to the frame
+    cv::Rect boundingRect(const cv::Size &frameSize) const;
+
+    // 255 where detection is allowed; cached per frame size
+    const cv::Mat &mask(const cv::Size &frameSize) const;
+
+    bool contains(const cv::Point &point, const cv::Size &frameSize) const;
+
+private:
+    mutable cv::Mat cachedMask;
+
+    static std::vector<cv::Point> toPixels(const QPolygonF &polygon, const cv::Size &frameSize);
+};
+
+#endif // DETECTIONREGIONS_H
@@ -1,6 +1,28 @@
 #include "dlib_utils.h"
 #include <dlib/opencv.h>
 #include <dlib/image_io.h>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char *networkPath = "dlib_face_recognition_resnet_model_v1.dat";
+const int maxEmbeddingThreads = 4;
+
+// Running a network writes to its layer outputs, so worker copies are made
+// from this one, which nothing runs
+const anet_type &network_prototype()
+{
+    static const anet_type prototype = [] {
+        anet_type loaded;
+        dlib::deserialize(networkPath) >> loaded;
+        return loaded;
+    }();
+    return prototype;
+}
+
+} // namespace
 
 // Define the network and shape predictor
 anet_type net;
@@ -8,10 +30,72 @@ dlib::shape_predictor sp;
 
 void initialize_network()
 {
-    dlib::deserialize("dlib_face_recognition_resnet_model_v1.dat") >> net;
+    dlib::deserialize(networkPath) >> net;
 }
 
 void initialize_shape_predictor()
 {
     dlib::deserialize("shape_predictor_5_face_landmarks.dat") >> sp;
 }
+
+bool compute_face_encoding(const cv::Mat &image, dlib::matrix<float, 0, 1> &face_encoding,
+                           dlib::matrix<dlib::rgb_pixel> *face_chip, std::string *error)
+{
+    // Neither the HOG detector nor the network can be shared between threads
+    thread_local dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+    thread_local anet_type thread_net = network_prototype();
+
+    if (image.empty() || image.channels() != 3) {
+        if (error) *error = "Failed to load the image.";
+        return false;
+    }
+
+    dlib::cv_image<dlib::bgr_pixel> dlib_img(image);
+    std::vector<dlib::rectangle> faces = detector(dlib_img);
+
+    if (faces.size() != 1) {
+        if (error) *error = "Expected exactly one face, but found " + std::to_string(faces.size()) + " faces.";
+        return false;
+    }
+
+    dlib::full_object_detection shape = sp(dlib_img, faces[0]);
+
+    dlib::matrix<dlib::rgb_pixel> chip;
+    dlib::extract_image_chip(dlib_img, dlib::get_face_chip_details(shape, 150, 0.25), chip);
+    face_encoding = thread_net(chip);
+
+    if (face_chip) {
+        *face_chip = chip;
+    }
+    return true;
+}
+
+QThreadPool *embedding_pool()
+{
+    static QThreadPool *pool = [] {
+        QThreadPool *created = new QThreadPool;
+        created->setMaxThreadCount(std::max(1, std::min(QThread::idealThreadCount(), maxEmbeddingThreads)));
+        return created;
+    }();
+    return pool;
+}
+
+QImage chip_to_image(const dlib::matrix<dlib::rgb_pixel> &chip)
+{
+    // rgb_pixel is three packed bytes, so a chip row is an RGB888 row
+    if (chip.size() == 0) {
+        return QImage();
+    }
+    return QImage(reinterpret_cast<const uchar *>(&chip(0, 0)), static_cast<int>(chip.nc()), static_cast<int>(chip.nr()),
+                  static_cast<int>(chip.nc() * 3), QImage::Format_RGB888).copy();
+}
+
+dlib::matrix<dlib::rgb_pixel> image_to_chip(const QImage &image)
+{
+    QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+    dlib::matrix<dlib::rgb_pixel> chip(rgb.height(), rgb.width());
+    for (int row = 0; row < rgb.height(); ++row) {
+        std::memcpy(&chip(row, 0), rgb.constScanLine(row), rgb.width() * 3);
+    }
+    return chip;
+}
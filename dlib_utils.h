@@ -11,6 +11,11 @@
 #include <dlib/string.h>
 #include <dlib/dnn.h>
 
+#include <opencv2/core.hpp>
+#include <QImage>
+#include <QThreadPool>
+#include <string>
+
 
 // (This part should match how you define `anet_type` in your code)
 template <template <int,template<typename>class,int,typename> class block, int N, template<typename>class BN, typename SUBNET>
@@ -50,4 +55,20 @@ extern dlib::shape_predictor sp;
 void initialize_network();
 void initialize_shape_predictor();
 
+// Detects exactly one face in a BGR image and computes its encoding. Safe to
+// call from any thread: each thread keeps its own detector and network,
+// copied from a prototype that is loaded once and never run, not from the
+// net the frame loop uses (call initialize_shape_predictor() first).
+bool compute_face_encoding(const cv::Mat &image, dlib::matrix<float, 0, 1> &face_encoding,
+                           dlib::matrix<dlib::rgb_pixel> *face_chip = nullptr, std::string *error = nullptr);
+
+// Where batches of images are encoded. Bounded, so only a few copies of the
+// network exist, and idle threads expire and free theirs.
+QThreadPool *embedding_pool();
+
+// Deep copies between a face chip and an RGB888 image, for display, the
+// sightings index, event records and enrolling a visitor's chip
+QImage chip_to_image(const dlib::matrix<dlib::rgb_pixel> &chip);
+dlib::matrix<dlib::rgb_pixel> image_to_chip(const QImage &image);
+
 #endif // DLIB_UTILS_H
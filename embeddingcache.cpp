@@ -0,0 +1,228 @@
+#include "embeddingcache.h"
+#include "dlib_utils.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrent/QtConcurrent>
+#include <opencv2/opencv.hpp>
+#include <cstring>
+
+namespace {
+
+const quint32 cacheMagic = 0x43414345; // "ECAC"
+const quint32 cacheVersion = 1;
+const int encodingSize = 128;
+
+}
+
+EmbeddingCache::EmbeddingCache(const QString &cacheFilePath)
+    : cacheFilePath(cacheFilePath), cacheFile(cacheFilePath)
+{
+}
+
+EmbeddingCache::~EmbeddingCache()
+{
+    unmap();
+}
+
+bool EmbeddingCache::map()
+{
+    unmap();
+
+    if (!cacheFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    mappedSize = cacheFile.size();
+    if (mappedSize < static_cast<qint64>(sizeof(FileHeader))) {
+        cacheFile.close();
+        return false;
+    }
+
+    mapped = cacheFile.map(0, mappedSize);
+    if (!mapped) {
+        qDebug() << "Error mapping embedding cache:" << cacheFile.errorString();
+        cacheFile.close();
+        return false;
+    }
+
+    const FileHeader *header = reinterpret_cast<const FileHeader *>(mapped);
+    qint64 recordsEnd = sizeof(FileHeader) + static_cast<qint64>(header->count) * sizeof(DiskRecord);
+    if (header->magic != cacheMagic || header->version != cacheVersion
+        || header->dimensions != encodingSize || recordsEnd > mappedSize) {
+        qDebug() << "Ignoring incompatible embedding cache" << cacheFilePath;
+        unmap();
+        return false;
+    }
+
+    const DiskRecord *diskRecords = reinterpret_cast<const DiskRecord *>(mapped + sizeof(FileHeader));
+    records.reserve(header->count);
+    for (quint32 i = 0; i < header->count; ++i) {
+        const DiskRecord &record = diskRecords[i];
+        if (static_cast<qint64>(record.pathOffset + record.pathLength) > mappedSize) {
+            continue;
+        }
+        QString path = QString::fromUtf8(reinterpret_cast<const char *>(mapped + record.pathOffset), record.pathLength);
+        records.insert(path, &record);
+    }
+
+    return true;
+}
+
+void EmbeddingCache::unmap()
+{
+    records.clear();
+    if (mapped) {
+        cacheFile.unmap(mapped);
+        mapped = nullptr;
+    }
+    mappedSize = 0;
+    if (cacheFile.isOpen()) {
+        cacheFile.close();
+    }
+}
+
+QByteArray EmbeddingCache::hashFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+    return hash.result();
+}
+
+QVector<EmbeddingCache::Face> EmbeddingCache::sync(const QString &folderPath)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    map();
+
+    QDir folder(folderPath);
+    QFileInfoList files = folder.entryInfoList({"*.jpg", "*.jpeg", "*.png", "*.bmp"}, QDir::Files, QDir::Name);
+
+    QVector<Entry> entries;
+    QVector<int> pending;
+    bool changed = files.size() != records.size();
+
+    for (const QFileInfo &info : files) {
+        Entry entry;
+        entry.path = info.absoluteFilePath();
+        entry.fileSize = info.size();
+        entry.modified = info.lastModified().toMSecsSinceEpoch();
+
+        const DiskRecord *record = records.value(entry.path, nullptr);
+        bool reuse = false;
+
+        if (record && record->fileSize == entry.fileSize && record->modified == entry.modified) {
+            // Unchanged on disk, skip hashing entirely
+            entry.hash = QByteArray(record->hash, sizeof(record->hash));
+            reuse = true;
+        } else {
+            entry.hash = hashFile(entry.path);
+            changed = true;
+            reuse = record && entry.hash == QByteArray(record->hash, sizeof(record->hash));
+        }
+
+        if (reuse) {
+            entry.hasFace = record->hasFace;
+            if (entry.hasFace) {
+                entry.encoding.set_size(encodingSize, 1);
+                std::memcpy(entry.encoding.begin(), record->encoding, sizeof(record->encoding));
+            }
+        } else {
+            pending.append(entries.size());
+        }
+
+        entries.append(entry);
+    }
+
+    if (!pending.isEmpty()) {
+        // Detection, landmarks and the network for every new image, spread
+        // over the embedding pool
+        QVector<QFuture<void>> encodings;
+        for (int index : pending) {
+            encodings.append(QtConcurrent::run(embedding_pool(), [&entries, index]() {
+                Entry &entry = entries[index];
+                std::string error;
+                cv::Mat image = cv::imread(entry.path.toStdString());
+                entry.hasFace = compute_face_encoding(image, entry.encoding, nullptr, &error);
+                if (!entry.hasFace) {
+                    qDebug() << "Skipping" << entry.path << ":" << QString::fromStdString(error);
+                }
+            }));
+        }
+        for (QFuture<void> &encoding : encodings) {
+            encoding.waitForFinished();
+        }
+    }
+
+    QVector<Face> faces;
+    for (const Entry &entry : entries) {
+        if (entry.hasFace) {
+            faces.append({entry.path, entry.hash, entry.encoding});
+        }
+    }
+
+    // The mapped records are no longer needed once copied out
+    unmap();
+
+    if (changed && !write(entries)) {
+        qDebug() << "Error writing embedding cache" << cacheFilePath;
+    }
+
+    qDebug() << "Loaded" << faces.size() << "face encodings from" << folderPath
+             << "(" << pending.size() << "re-embedded ) in" << timer.elapsed() << "ms";
+
+    return faces;
+}
+
+bool EmbeddingCache::write(const QVector<Entry> &entries)
+{
+    QSaveFile file(cacheFilePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QVector<QByteArray> paths;
+    paths.reserve(entries.size());
+    for (const Entry &entry : entries) {
+        paths.append(entry.path.toUtf8());
+    }
+
+    FileHeader header = {cacheMagic, cacheVersion, encodingSize, static_cast<quint32>(entries.size())};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    quint64 pathOffset = sizeof(FileHeader) + static_cast<quint64>(entries.size()) * sizeof(DiskRecord);
+    for (int i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+
+        DiskRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.pathOffset = pathOffset;
+        record.pathLength = paths[i].size();
+        record.hasFace = entry.hasFace ? 1 : 0;
+        record.fileSize = entry.fileSize;
+        record.modified = entry.modified;
+        std::memcpy(record.hash, entry.hash.constData(), qMin<qsizetype>(entry.hash.size(), sizeof(record.hash)));
+        if (entry.hasFace && entry.encoding.size() == encodingSize) {
+            std::memcpy(record.encoding, entry.encoding.begin(), sizeof(record.encoding));
+        }
+
+        file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        pathOffset += paths[i].size();
+    }
+
+    for (const QByteArray &path : paths) {
+        file.write(path);
+    }
+
+    return file.commit();
+}
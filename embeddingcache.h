@@ -0,0 +1,76 @@
+#ifndef EMBEDDINGCACHE_H
+#define EMBEDDINGCACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <dlib/matrix.h>
+
+// Persistent cache of face encodings for a folder of images, keyed by image
+// path and content hash. The cache is a single binary file of fixed size
+// records that is memory-mapped on load, so a warm start never touches the
+// detector or the network.
+class EmbeddingCache
+{
+public:
+    struct Face
+    {
+        QString path;
+        QByteArray hash;
+        dlib::matrix<float, 0, 1> encoding;
+    };
+
+    explicit EmbeddingCache(const QString &cacheFilePath);
+    ~EmbeddingCache();
+
+    // Returns an encoding for every image in folder that holds exactly one
+    // face. Only new or changed images are embedded, in parallel.
+    QVector<Face> sync(const QString &folderPath);
+
+private:
+    // On-disk layout, followed by the UTF-8 path strings
+    struct FileHeader
+    {
+        quint32 magic;
+        quint32 version;
+        quint32 dimensions;
+        quint32 count;
+    };
+
+    struct DiskRecord
+    {
+        quint64 pathOffset;
+        quint32 pathLength;
+        quint32 hasFace;
+        qint64 fileSize;
+        qint64 modified;
+        char hash[16];
+        float encoding[128];
+    };
+
+    struct Entry
+    {
+        QString path;
+        QByteArray hash;
+        qint64 fileSize = 0;
+        qint64 modified = 0;
+        bool hasFace = false;
+        dlib::matrix<float, 0, 1> encoding;
+    };
+
+    QString cacheFilePath;
+    QFile cacheFile;
+    uchar *mapped = nullptr;
+    qint64 mappedSize = 0;
+    QHash<QString, const DiskRecord *> records;
+
+    bool map();
+    void unmap();
+    bool write(const QVector<Entry> &entries);
+    static QByteArray hashFile(const QString &filePath);
+};
+
+#endif // EMBEDDINGCACHE_H
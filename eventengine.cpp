@@ -0,0 +1,102 @@
+#include "eventengine.h"
+
+#include <QDebug>
+#include <algorithm>
+
+EventEngine::EventEngine(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void EventEngine::setSettings(const QString &cameraName, const Settings &settings)
+{
+    states[cameraName].settings = settings;
+}
+
+EventEngine::Settings EventEngine::settings(const QString &cameraName) const
+{
+    auto it = states.constFind(cameraName);
+    return it == states.constEnd() ? Settings() : it->settings;
+}
+
+void EventEngine::removeCamera(const QString &cameraName)
+{
+    auto it = states.find(cameraName);
+    if (it == states.end()) {
+        return;
+    }
+    if (it->phase != Idle) {
+        close(*it);
+    }
+    states.erase(it);
+}
+
+void EventEngine::trigger(const QString &cameraName, const QString &analyzer, const QDateTime &capturedAt)
+{
+    State &state = states[cameraName];
+    Event &event = state.event;
+
+    if (state.phase == Idle) {
+        if (state.cooldownUntil.isValid() && capturedAt < state.cooldownUntil) {
+            return;
+        }
+
+        event = Event();
+        event.id = nextId++;
+        event.cameraName = cameraName;
+        event.firstTrigger = capturedAt;
+        event.lastTrigger = capturedAt;
+        event.start = capturedAt.addMSecs(-state.settings.preRollMs);
+        state.phase = Pending;
+    }
+
+    // Analyzers report late (batched object detection), keep the latest
+    // capture time rather than the latest call
+    event.lastTrigger = std::max(event.lastTrigger, capturedAt);
+    if (!event.triggers.contains(analyzer)) {
+        event.triggers.append(analyzer);
+    }
+
+    if (state.phase == Pending && event.firstTrigger.msecsTo(event.lastTrigger) >= state.settings.minDurationMs) {
+        state.phase = Active;
+        qDebug() << event.triggers.join(", ") << "event started on" << cameraName << "at"
+                 << event.firstTrigger.toString("yyyy-MM-dd hh:mm:ss.zzz");
+        emit eventStarted(event);
+    }
+}
+
+void EventEngine::update(const QString &cameraName, const QDateTime &now)
+{
+    auto it = states.find(cameraName);
+    if (it == states.end() || it->phase == Idle) {
+        return;
+    }
+
+    // Quiet for the merge gap, and the post-roll has been captured
+    int quietMs = std::max(it->settings.mergeGapMs, it->settings.postRollMs);
+    if (it->event.lastTrigger.msecsTo(now) > quietMs) {
+        close(*it);
+    }
+}
+
+bool EventEngine::isActive(const QString &cameraName) const
+{
+    auto it = states.constFind(cameraName);
+    return it != states.constEnd() && it->phase != Idle;
+}
+
+void EventEngine::close(State &state)
+{
+    if (state.phase == Pending) {
+        qDebug() << "Dropping event on" << state.event.cameraName << "shorter than"
+                 << state.settings.minDurationMs << "ms";
+        state.phase = Idle;
+        return;
+    }
+
+    state.event.end = state.event.lastTrigger.addMSecs(state.settings.postRollMs);
+    state.cooldownUntil = state.event.end.addMSecs(state.settings.cooldownMs);
+    state.phase = Idle;
+    qDebug() << "Event ended on" << state.event.cameraName << "at" << state.event.lastTrigger.toString("hh:mm:ss.zzz");
+    emit eventEnded(state.event);
+}
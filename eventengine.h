@@ -0,0 +1,87 @@
+#ifndef EVENTENGINE_H
+#define EVENTENGINE_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+// Turns analyzer triggers into events, per camera, on capture timestamps
+// only. Frame counts and buffer positions never enter into it, so the
+// result does not depend on frame rate or on frames being dropped from the
+// front of the buffer.
+//
+// Idle -> Pending on the first trigger (outside the cooldown). Pending ->
+// Active once triggers have spanned the minimum duration, which emits
+// eventStarted. A gap longer than the merge gap (and the post-roll) closes
+// the event: Active emits eventEnded with the clip range including pre and
+// post-roll and starts the cooldown, Pending is dropped as too short.
+class EventEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Settings
+    {
+        int preRollMs = 3000;
+        int postRollMs = 3000;
+        int minDurationMs = 1000;
+        int mergeGapMs = 5000;
+        int cooldownMs = 10000;
+    };
+
+    struct Event
+    {
+        quint64 id = 0;
+        QString cameraName;
+        QDateTime start;        // First trigger minus pre-roll
+        QDateTime end;          // Last trigger plus post-roll, set on eventEnded
+        QDateTime firstTrigger;
+        QDateTime lastTrigger;
+        QStringList triggers;   // Analyzers that contributed, in order
+    };
+
+    explicit EventEngine(QObject *parent = nullptr);
+
+    void setSettings(const QString &cameraName, const Settings &settings);
+    Settings settings(const QString &cameraName) const;
+
+    // Ends an open event with what has been captured so far
+    void removeCamera(const QString &cameraName);
+
+    // An analyzer saw something in the frame captured at capturedAt
+    void trigger(const QString &cameraName, const QString &analyzer, const QDateTime &capturedAt);
+
+    // Advances the camera's clock, closing the event once it went quiet
+    void update(const QString &cameraName, const QDateTime &now);
+
+    bool isActive(const QString &cameraName) const;
+
+signals:
+    void eventStarted(const EventEngine::Event &event);
+    void eventEnded(const EventEngine::Event &event);
+
+private:
+    enum Phase
+    {
+        Idle,
+        Pending,
+        Active
+    };
+
+    struct State
+    {
+        Settings settings;
+        Phase phase = Idle;
+        Event event;
+        QDateTime cooldownUntil;
+    };
+
+    QHash<QString, State> states;
+    quint64 nextId = 1;
+
+    void close(State &state);
+};
+
+#endif // EVENTENGINE_H
@@ -0,0 +1,317 @@
+#include "facedetector.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/opencv.h>
+
+QStringList FaceDetector::backends()
+{
+    return {"haar", "hog", "yunet"};
+}
+
+QString FaceDetector::displayName(const QString &backend)
+{
+    if (backend == "hog") {
+        return "dlib HOG";
+    }
+    if (backend == "yunet") {
+        return "YuNet (DNN)";
+    }
+    return "Haar Cascade";
+}
+
+std::unique_ptr<FaceDetector> FaceDetector::create(const QString &backend)
+{
+    std::unique_ptr<FaceDetector> detector;
+    if (backend == "hog") {
+        detector = std::make_unique<HogFaceDetector>();
+    } else if (backend == "yunet") {
+        detector = std::make_unique<YuNetFaceDetector>();
+    }
+
+    if (detector && detector->isLoaded()) {
+        return detector;
+    }
+
+    if (!backend.isEmpty() && backend != "haar") {
+        qDebug() << "Face detector" << backend << "is not available, using the Haar cascade";
+    }
+    return std::make_unique<HaarFaceDetector>();
+}
+
+HaarFaceDetector::HaarFaceDetector(const std::string &cascadePath, double scaleFactor, int minNeighbors)
+    : scaleFactor(scaleFactor), minNeighbors(minNeighbors)
+{
+    loaded = cascade.load(cascadePath);
+    if (!loaded) {
+        qDebug() << "Could not load the classifier" << QString::fromStdString(cascadePath);
+    }
+}
+
+std::vector<cv::Rect> HaarFaceDetector::detect(const cv::Mat &frame)
+{
+    std::vector<cv::Rect> faces;
+    if (!loaded || frame.empty()) {
+        return faces;
+    }
+
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = frame;
+    }
+
+    cascade.detectMultiScale(gray, faces, scaleFactor, minNeighbors, cv::CASCADE_SCALE_IMAGE);
+    return faces;
+}
+
+struct HogFaceDetector::Private
+{
+    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+};
+
+HogFaceDetector::HogFaceDetector()
+    : d(std::make_unique<Private>())
+{
+}
+
+HogFaceDetector::~HogFaceDetector() = default;
+
+std::vector<cv::Rect> HogFaceDetector::detect(const cv::Mat &frame)
+{
+    std::vector<cv::Rect> faces;
+    if (frame.empty()) {
+        return faces;
+    }
+
+    std::vector<dlib::rectangle> found;
+    if (frame.channels() == 3) {
+        found = d->detector(dlib::cv_image<dlib::bgr_pixel>(frame));
+    } else {
+        found = d->detector(dlib::cv_image<unsigned char>(frame));
+    }
+
+    cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    for (const dlib::rectangle &rect : found) {
+        cv::Rect face(rect.left(), rect.top(), rect.width(), rect.height());
+        face &= frameRect;
+        if (!face.empty()) {
+            faces.push_back(face);
+        }
+    }
+    return faces;
+}
+
+YuNetFaceDetector::YuNetFaceDetector(const std::string &modelPath, float scoreThreshold, float nmsThreshold)
+{
+    if (!QFile::exists(QString::fromStdString(modelPath))) {
+        qDebug() << "YuNet model not found:" << QString::fromStdString(modelPath);
+        return;
+    }
+
+    try {
+        // Plain CPU inference, the input size is set per frame in detect()
+        model = cv::FaceDetectorYN::create(modelPath, "", cv::Size(320, 320), scoreThreshold, nmsThreshold, 5000,
+                                           cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_CPU);
+    } catch (const cv::Exception &e) {
+        qDebug() << "Could not load the YuNet model:" << e.what();
+        model.release();
+    }
+}
+
+std::vector<cv::Rect> YuNetFaceDetector::detect(const cv::Mat &frame)
+{
+    std::vector<cv::Rect> faces;
+    if (model.empty() || frame.empty()) {
+        return faces;
+    }
+
+    if (frame.channels() == 1) {
+        cv::cvtColor(frame, bgr, cv::COLOR_GRAY2BGR);
+    } else {
+        bgr = frame;
+    }
+
+    if (bgr.size() != inputSize) {
+        inputSize = bgr.size();
+        model->setInputSize(inputSize);
+    }
+
+    model->detect(bgr, detections);
+
+    // One row per face: box, five landmarks, score
+    cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    for (int i = 0; i < detections.rows; ++i) {
+        const float *row = detections.ptr<float>(i);
+        cv::Rect face(cvRound(row[0]), cvRound(row[1]), cvRound(row[2]), cvRound(row[3]));
+        face &= frameRect;
+        if (!face.empty()) {
+            faces.push_back(face);
+        }
+    }
+    return faces;
+}
+
+namespace {
+
+bool loadAnnotations(const QString &path, double scale, QHash<int, std::vector<cv::Rect>> &annotations)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QStringList fields = in.readLine().split(',');
+        if (fields.size() != 5) {
+            continue;
+        }
+
+        bool ok = true;
+        int values[5];
+        for (int i = 0; i < 5 && ok; ++i) {
+            values[i] = fields[i].trimmed().toInt(&ok);
+        }
+        if (!ok) {
+            continue; // Header or malformed row
+        }
+
+        annotations[values[0]].emplace_back(cvRound(values[1] * scale), cvRound(values[2] * scale),
+                                            cvRound(values[3] * scale), cvRound(values[4] * scale));
+    }
+    return true;
+}
+
+double overlap(const cv::Rect &a, const cv::Rect &b)
+{
+    double intersection = (a & b).area();
+    double combined = a.area() + b.area() - intersection;
+    return combined > 0 ? intersection / combined : 0.0;
+}
+
+// Greedy one-to-one matching at IoU >= 0.5, returns the number of matches
+int matchFaces(const std::vector<cv::Rect> &expected, const std::vector<cv::Rect> &found)
+{
+    std::vector<bool> used(found.size(), false);
+    int matched = 0;
+
+    for (const cv::Rect &truth : expected) {
+        int best = -1;
+        double bestOverlap = 0.5;
+        for (size_t i = 0; i < found.size(); ++i) {
+            double value = used[i] ? 0.0 : overlap(truth, found[i]);
+            if (value >= bestOverlap) {
+                bestOverlap = value;
+                best = static_cast<int>(i);
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            ++matched;
+        }
+    }
+    return matched;
+}
+
+} // namespace
+
+void FaceDetector::benchmark(const QString &folder, double scale)
+{
+    QDir dir(folder);
+    const QStringList clips = dir.entryList({"*.mp4", "*.avi", "*.mkv", "*.mov"}, QDir::Files, QDir::Name);
+    if (clips.isEmpty()) {
+        qDebug() << "FaceDetector benchmark: no clips in" << folder;
+        return;
+    }
+
+    struct Score
+    {
+        qint64 frames = 0;
+        double milliseconds = 0.0;
+        qint64 scoredFrames = 0;
+        qint64 expected = 0;
+        qint64 detections = 0;
+        qint64 matched = 0;
+    };
+
+    std::vector<std::unique_ptr<FaceDetector>> detectors;
+    for (const QString &backend : backends()) {
+        std::unique_ptr<FaceDetector> detector = create(backend);
+        if (detector->name() != backend || !detector->isLoaded()) {
+            qDebug() << "FaceDetector benchmark: skipping" << backend << "(not available)";
+            continue;
+        }
+        detectors.push_back(std::move(detector));
+    }
+    std::vector<Score> scores(detectors.size());
+
+    for (const QString &clip : clips) {
+        QString clipPath = dir.filePath(clip);
+        QHash<int, std::vector<cv::Rect>> annotations;
+        bool annotated = loadAnnotations(dir.filePath(QFileInfo(clip).completeBaseName() + ".csv"), scale, annotations);
+
+        cv::VideoCapture capture(clipPath.toStdString(), cv::CAP_FFMPEG);
+        if (!capture.isOpened()) {
+            qDebug() << "FaceDetector benchmark: could not open" << clipPath;
+            continue;
+        }
+        qDebug() << "FaceDetector benchmark:" << clip << (annotated ? "(annotated)" : "(timing only)");
+
+        // Each frame is decoded once and handed to every backend, only the
+        // detect() call itself is timed
+        cv::Mat frame;
+        cv::Mat scaled;
+        for (int index = 0; capture.read(frame); ++index) {
+            if (scale != 1.0) {
+                cv::resize(frame, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+            } else {
+                scaled = frame;
+            }
+            const std::vector<cv::Rect> expected = annotations.value(index);
+
+            for (size_t i = 0; i < detectors.size(); ++i) {
+                QElapsedTimer timer;
+                timer.start();
+                std::vector<cv::Rect> found = detectors[i]->detect(scaled);
+                scores[i].milliseconds += timer.nsecsElapsed() / 1e6;
+                ++scores[i].frames;
+
+                if (annotated) {
+                    ++scores[i].scoredFrames;
+                    scores[i].expected += static_cast<qint64>(expected.size());
+                    scores[i].detections += static_cast<qint64>(found.size());
+                    scores[i].matched += matchFaces(expected, found);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < detectors.size(); ++i) {
+        const Score &score = scores[i];
+        if (score.frames == 0) {
+            continue;
+        }
+
+        QString line = QString("%1: %2 ms/frame over %3 frames")
+                           .arg(displayName(detectors[i]->name()))
+                           .arg(score.milliseconds / score.frames, 0, 'f', 2)
+                           .arg(score.frames);
+
+        if (score.scoredFrames > 0) {
+            qint64 falsePositives = score.detections - score.matched;
+            line += QString(", recall %1, false positives %2/frame (%3 of detections)")
+                        .arg(score.expected > 0 ? static_cast<double>(score.matched) / score.expected : 0.0, 0, 'f', 3)
+                        .arg(static_cast<double>(falsePositives) / score.scoredFrames, 0, 'f', 3)
+                        .arg(score.detections > 0 ? static_cast<double>(falsePositives) / score.detections : 0.0, 0, 'f', 3);
+        }
+
+        qDebug().noquote() << "FaceDetector benchmark:" << line;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef FACEDETECTOR_H
+#define FACEDETECTOR_H
+
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Common interface for the face detection backends. Each camera owns its own
+// instance, so implementations may keep per-frame scratch buffers and are not
+// required to be thread-safe.
+class FaceDetector
+{
+public:
+    virtual ~FaceDetector() = default;
+
+    // frame is BGR or 8-bit gray, boxes come back in frame coordinates
+    virtual std::vector<cv::Rect> detect(const cv::Mat &frame) = 0;
+
+    // Smallest input the backend can find a face in
+    virtual int minimumSize() const = 0;
+
+    virtual QString name() const = 0;
+    virtual bool isLoaded() const = 0;
+
+    // Keys stored in cameradetails.detector_backend
+    static QStringList backends();
+    static QString displayName(const QString &backend);
+    static QString defaultBackend() { return "haar"; }
+
+    // Falls back to the Haar cascade when the backend is unknown or its
+    // model file is missing
+    static std::unique_ptr<FaceDetector> create(const QString &backend);
+
+    // Runs every backend over the clips in folder and reports ms/frame,
+    // recall and false positives. A clip "x.mp4" is scored against a sidecar
+    // "x.csv" of "frame,x,y,width,height" rows in source pixels; frames with
+    // no rows have no faces. Clips without a sidecar only report timing.
+    static void benchmark(const QString &folder, double scale = 1.0);
+};
+
+class HaarFaceDetector : public FaceDetector
+{
+public:
+    explicit HaarFaceDetector(const std::string &cascadePath = "haarcascade_frontalface_alt2.xml",
+                              double scaleFactor = 1.3, int minNeighbors = 1);
+
+    std::vector<cv::Rect> detect(const cv::Mat &frame) override;
+    int minimumSize() const override { return 24; }
+    QString name() const override { return "haar"; }
+    bool isLoaded() const override { return loaded; }
+
+private:
+    cv::CascadeClassifier cascade;
+    double scaleFactor;
+    int minNeighbors;
+    bool loaded = false;
+    cv::Mat gray;
+};
+
+class HogFaceDetector : public FaceDetector
+{
+public:
+    HogFaceDetector();
+    ~HogFaceDetector();
+
+    std::vector<cv::Rect> detect(const cv::Mat &frame) override;
+    int minimumSize() const override { return 80; }
+    QString name() const override { return "hog"; }
+    bool isLoaded() const override { return true; }
+
+private:
+    // Keeps dlib out of this header
+    struct Private;
+    std::unique_ptr<Private> d;
+};
+
+class YuNetFaceDetector : public FaceDetector
+{
+public:
+    explicit YuNetFaceDetector(const std::string &modelPath = "face_detection_yunet_2023mar.onnx",
+                               float scoreThreshold = 0.6f, float nmsThreshold = 0.3f);
+
+    std::vector<cv::Rect> detect(const cv::Mat &frame) override;
+    int minimumSize() const override { return 32; }
+    QString name() const override { return "yunet"; }
+    bool isLoaded() const override { return !model.empty(); }
+
+private:
+    cv::Ptr<cv::FaceDetectorYN> model;
+    cv::Size inputSize;
+    cv::Mat bgr;
+    cv::Mat detections;
+};
+
+#endif // FACEDETECTOR_H
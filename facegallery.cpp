@@ -0,0 +1,180 @@
+#include "facegallery.h"
+
+#include <QDebug>
+#include <atomic>
+
+FaceGallery::FaceGallery()
+{
+    auto empty = std::make_shared<Snapshot>();
+    empty->index = std::make_shared<const FaceIndex>();
+    current = std::move(empty);
+}
+
+std::shared_ptr<const FaceGallery::Snapshot> FaceGallery::snapshot() const
+{
+    return std::atomic_load(&current);
+}
+
+void FaceGallery::publish(std::shared_ptr<Snapshot> next, const Snapshot &previous,
+                          const std::vector<std::shared_ptr<const Entry>> &added, bool refreeze)
+{
+    next->positions.clear();
+    next->positions.reserve(static_cast<int>(next->entries.size()));
+    for (int i = 0; i < static_cast<int>(next->entries.size()); ++i) {
+        next->positions.insert(next->entries[i]->id, i);
+    }
+
+    // Removed faces stay in the frozen graph and the waiting list, matches
+    // filter them out through positions
+    next->unindexed = previous.unindexed;
+    next->unindexed.insert(next->unindexed.end(), added.begin(), added.end());
+
+    if (refreeze || static_cast<int>(next->unindexed.size()) >= refreezeThreshold) {
+        // Copied off any lock readers take, matches keep using the old graph
+        // until the swap
+        next->index = std::make_shared<const FaceIndex>(index);
+        next->unindexed.clear();
+    } else {
+        next->index = previous.index;
+    }
+
+    std::atomic_store(&current, std::shared_ptr<const Snapshot>(std::move(next)));
+}
+
+void FaceGallery::insert(qint64 id, const dlib::matrix<float, 0, 1> &encoding)
+{
+    insert(QVector<Entry>{{id, encoding}});
+}
+
+void FaceGallery::insert(const QVector<Entry> &newEntries)
+{
+    if (newEntries.isEmpty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+
+    std::shared_ptr<const Snapshot> previous = snapshot();
+    auto next = std::make_shared<Snapshot>();
+    next->version = previous->version + 1;
+    next->entries = previous->entries; // Copies pointers, encodings are shared
+
+    QHash<qint64, int> positions = previous->positions;
+    std::vector<std::shared_ptr<const Entry>> added;
+    for (const Entry &entry : newEntries) {
+        auto shared = std::make_shared<const Entry>(entry);
+        auto it = positions.find(entry.id);
+        if (it != positions.end()) {
+            next->entries[it.value()] = shared;
+        } else {
+            positions.insert(entry.id, static_cast<int>(next->entries.size()));
+            next->entries.push_back(shared);
+        }
+
+        // faces.db row ids are never reused and encode folder ids are content
+        // hashes, so an id already in the graph (e.g. from a saved index)
+        // carries the same encoding
+        if (!index.contains(entry.id)) {
+            index.insert(entry.id, entry.encoding);
+            added.push_back(shared);
+        }
+    }
+
+    publish(std::move(next), *previous, added);
+}
+
+bool FaceGallery::remove(qint64 id)
+{
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+
+    std::shared_ptr<const Snapshot> previous = snapshot();
+    auto it = previous->positions.constFind(id);
+    if (it == previous->positions.constEnd()) {
+        return false;
+    }
+
+    auto next = std::make_shared<Snapshot>();
+    next->version = previous->version + 1;
+    next->entries = previous->entries;
+    next->entries.erase(next->entries.begin() + it.value());
+
+    index.remove(id);
+
+    publish(std::move(next), *previous, {});
+    return true;
+}
+
+int FaceGallery::size() const
+{
+    return static_cast<int>(snapshot()->entries.size());
+}
+
+qint64 FaceGallery::match(const dlib::matrix<float, 0, 1> &encoding, double threshold) const
+{
+    std::shared_ptr<const Snapshot> faces = snapshot();
+
+    if (static_cast<int>(faces->entries.size()) >= indexThreshold) {
+        QVector<FaceIndex::Match> matches = faces->index->search(encoding, 4);
+
+        qint64 bestId = -1;
+        double bestDistance = threshold;
+
+        // The graph may hold ids the snapshot's entries no longer have
+        for (const FaceIndex::Match &match : matches) {
+            if (match.distance < bestDistance && faces->positions.contains(match.id)) {
+                bestDistance = match.distance;
+                bestId = match.id;
+                break;
+            }
+        }
+
+        for (const auto &entry : faces->unindexed) {
+            double distance = length(encoding - entry->encoding);
+            if (distance < bestDistance && faces->positions.contains(entry->id)) {
+                bestDistance = distance;
+                bestId = entry->id;
+            }
+        }
+        return bestId;
+    }
+
+    qint64 bestId = -1;
+    double bestDistance = threshold;
+    for (const auto &entry : faces->entries) {
+        double distance = length(encoding - entry->encoding);
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            bestId = entry->id;
+        }
+    }
+    return bestId;
+}
+
+bool FaceGallery::saveIndex(const QString &filePath) const
+{
+    // The working graph, the frozen one may lack the latest faces
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+    return index.save(filePath);
+}
+
+bool FaceGallery::loadIndex(const QString &filePath)
+{
+    std::lock_guard<std::mutex> writeLock(writeMutex);
+
+    FaceIndex loaded;
+    if (!loaded.load(filePath)) {
+        return false;
+    }
+
+    // Ids the graph does not know yet are added as the gallery is filled,
+    // ids that no longer exist are filtered out through the snapshot
+    index = std::move(loaded);
+    qDebug() << "Loaded face index with" << index.size() << "entries from" << filePath;
+
+    std::shared_ptr<const Snapshot> previous = snapshot();
+    auto next = std::make_shared<Snapshot>();
+    next->version = previous->version + 1;
+    next->entries = previous->entries;
+    publish(std::move(next), *previous, {}, true);
+    return true;
+}
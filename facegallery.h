@@ -0,0 +1,74 @@
+#ifndef FACEGALLERY_H
+#define FACEGALLERY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <dlib/matrix.h>
+
+#include "faceindex.h"
+
+// Known faces keyed by their faces.db row id. Readers take the current
+// immutable snapshot without locking; writers build a new snapshot and
+// publish it with an atomic pointer swap. A bulk add or an index load never
+// holds up a match. Snapshots share a frozen copy of the ANN graph, faces
+// added since it was frozen are scanned linearly until the next refreeze.
+class FaceGallery
+{
+public:
+    struct Entry
+    {
+        qint64 id;
+        dlib::matrix<float, 0, 1> encoding;
+    };
+
+    struct Snapshot
+    {
+        quint64 version = 0;
+        std::vector<std::shared_ptr<const Entry>> entries;
+        QHash<qint64, int> positions; // id -> index into entries
+        std::shared_ptr<const FaceIndex> index; // Frozen copy of the graph
+        std::vector<std::shared_ptr<const Entry>> unindexed; // Not in index yet
+    };
+
+    FaceGallery();
+
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    void insert(qint64 id, const dlib::matrix<float, 0, 1> &encoding);
+    void insert(const QVector<Entry> &newEntries);
+    bool remove(qint64 id);
+    int size() const;
+
+    // Returns the id of the closest known face within threshold, or -1
+    qint64 match(const dlib::matrix<float, 0, 1> &encoding, double threshold) const;
+
+    bool saveIndex(const QString &filePath) const;
+    bool loadIndex(const QString &filePath);
+
+    // Linear scan is faster for small galleries, the ANN index takes over
+    // once the watchlist grows past this many identities
+    static const int indexThreshold = 2000;
+
+    // The graph is copied into snapshots once this many faces wait outside
+    // it, so an edit costs a linear scan of at most this many, not a copy
+    static const int refreezeThreshold = 512;
+
+private:
+    std::shared_ptr<const Snapshot> current;
+
+    mutable std::mutex writeMutex; // Serialises writers, never taken by readers
+
+    // Writers update this graph under writeMutex, publish() freezes a copy
+    // of it into a snapshot once enough faces are waiting outside the frozen one
+    FaceIndex index;
+
+    void publish(std::shared_ptr<Snapshot> next, const Snapshot &previous,
+                 const std::vector<std::shared_ptr<const Entry>> &added, bool refreeze = false);
+};
+
+#endif // FACEGALLERY_H
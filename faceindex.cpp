@@ -0,0 +1,557 @@
+#include "faceindex.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace {
+
+const quint32 indexMagic = 0x58444946; // "FIDX"
+const quint32 indexVersion = 1;
+
+// Visited marks are kept per thread and reset with a generation counter so a
+// query never has to clear a gallery sized array.
+std::vector<unsigned int> &visitedTags(size_t count, unsigned int &generation)
+{
+    thread_local std::vector<unsigned int> tags;
+    thread_local unsigned int currentGeneration = 0;
+
+    if (tags.size() < count) {
+        tags.resize(count, 0);
+    }
+
+    if (++currentGeneration == 0) {
+        std::fill(tags.begin(), tags.end(), 0);
+        currentGeneration = 1;
+    }
+
+    generation = currentGeneration;
+    return tags;
+}
+
+}
+
+FaceIndex::FaceIndex(int M, int efConstruction)
+    : M(M), maxM0(2 * M), efConstruction(efConstruction), levelMult(1.0 / std::log(static_cast<double>(M)))
+{
+}
+
+int *FaceIndex::linksAt(int node, int level)
+{
+    if (level == 0) {
+        return links0.data() + static_cast<size_t>(node) * (1 + maxM0);
+    }
+    return upperLinks[node].data() + static_cast<size_t>(level - 1) * (1 + M);
+}
+
+const int *FaceIndex::linksAt(int node, int level) const
+{
+    if (level == 0) {
+        return links0.data() + static_cast<size_t>(node) * (1 + maxM0);
+    }
+    return upperLinks[node].data() + static_cast<size_t>(level - 1) * (1 + M);
+}
+
+float FaceIndex::distance(const float *a, const float *b) const
+{
+    // Squared L2, written as a flat loop so the compiler vectorises it
+    float sum = 0.0f;
+    for (int i = 0; i < dim; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+int FaceIndex::randomLevel()
+{
+    std::uniform_real_distribution<double> uniform(std::numeric_limits<double>::min(), 1.0);
+    return static_cast<int>(-std::log(uniform(rng)) * levelMult);
+}
+
+std::vector<std::pair<float, int>> FaceIndex::searchLayer(const float *query, int entry, int ef, int level) const
+{
+    unsigned int generation;
+    std::vector<unsigned int> &visited = visitedTags(labels.size(), generation);
+
+    // candidates: closest first, results: furthest first
+    std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, std::greater<>> candidates;
+    std::priority_queue<std::pair<float, int>> results;
+
+    float entryDistance = distance(query, vectorAt(entry));
+    candidates.emplace(entryDistance, entry);
+    results.emplace(entryDistance, entry);
+    visited[entry] = generation;
+
+    while (!candidates.empty()) {
+        auto current = candidates.top();
+        if (current.first > results.top().first && static_cast<int>(results.size()) >= ef) {
+            break;
+        }
+        candidates.pop();
+
+        const int *links = linksAt(current.second, level);
+        for (int i = 1; i <= links[0]; ++i) {
+            int neighbour = links[i];
+            if (visited[neighbour] == generation) {
+                continue;
+            }
+            visited[neighbour] = generation;
+
+            float d = distance(query, vectorAt(neighbour));
+            if (static_cast<int>(results.size()) < ef || d < results.top().first) {
+                candidates.emplace(d, neighbour);
+                results.emplace(d, neighbour);
+                if (static_cast<int>(results.size()) > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<float, int>> sorted(results.size());
+    for (int i = static_cast<int>(sorted.size()) - 1; i >= 0; --i) {
+        sorted[i] = results.top();
+        results.pop();
+    }
+    return sorted;
+}
+
+void FaceIndex::selectNeighbours(std::vector<std::pair<float, int>> &candidates, int count) const
+{
+    // Keeps a candidate only if it is closer to the base point than to every
+    // neighbour already chosen, which spreads links in different directions.
+    std::sort(candidates.begin(), candidates.end());
+    if (static_cast<int>(candidates.size()) <= count) {
+        return;
+    }
+
+    std::vector<std::pair<float, int>> selected;
+    std::vector<std::pair<float, int>> pruned;
+    for (const auto &candidate : candidates) {
+        if (static_cast<int>(selected.size()) >= count) {
+            break;
+        }
+
+        bool keep = true;
+        for (const auto &chosen : selected) {
+            if (distance(vectorAt(candidate.second), vectorAt(chosen.second)) < candidate.first) {
+                keep = false;
+                break;
+            }
+        }
+
+        if (keep) {
+            selected.push_back(candidate);
+        } else {
+            pruned.push_back(candidate);
+        }
+    }
+
+    for (const auto &candidate : pruned) {
+        if (static_cast<int>(selected.size()) >= count) {
+            break;
+        }
+        selected.push_back(candidate);
+    }
+
+    candidates.swap(selected);
+}
+
+void FaceIndex::connect(int node, int level, const std::vector<std::pair<float, int>> &neighbours)
+{
+    int limit = maxLinks(level);
+
+    int *links = linksAt(node, level);
+    links[0] = 0;
+    for (const auto &neighbour : neighbours) {
+        if (links[0] >= limit) {
+            break;
+        }
+        links[++links[0]] = neighbour.second;
+    }
+
+    for (const auto &neighbour : neighbours) {
+        int *other = linksAt(neighbour.second, level);
+        if (other[0] < limit) {
+            other[++other[0]] = node;
+            continue;
+        }
+
+        // Neighbour is full, re-select its links including the new node
+        std::vector<std::pair<float, int>> candidates;
+        candidates.reserve(other[0] + 1);
+        const float *base = vectorAt(neighbour.second);
+        for (int i = 1; i <= other[0]; ++i) {
+            candidates.emplace_back(distance(base, vectorAt(other[i])), other[i]);
+        }
+        candidates.emplace_back(neighbour.first, node);
+
+        selectNeighbours(candidates, limit);
+
+        other[0] = 0;
+        for (const auto &candidate : candidates) {
+            other[++other[0]] = candidate.second;
+        }
+    }
+}
+
+void FaceIndex::insert(qint64 id, const dlib::matrix<float, 0, 1> &encoding)
+{
+    if (labelToNode.contains(id)) {
+        remove(id);
+    }
+
+    if (dim == 0) {
+        dim = encoding.size();
+    }
+
+    if (encoding.size() != dim) {
+        qDebug() << "FaceIndex: encoding size" << encoding.size() << "does not match index dimension" << dim;
+        return;
+    }
+
+    int node = static_cast<int>(labels.size());
+    int level = randomLevel();
+
+    vectors.insert(vectors.end(), encoding.begin(), encoding.end());
+    labels.push_back(id);
+    levels.push_back(level);
+    deleted.push_back(0);
+    links0.resize(links0.size() + 1 + maxM0, 0);
+    upperLinks.emplace_back(static_cast<size_t>(level) * (1 + M), 0);
+    labelToNode.insert(id, node);
+
+    if (entryPoint < 0) {
+        entryPoint = node;
+        maxLevel = level;
+        return;
+    }
+
+    const float *query = vectorAt(node);
+    int current = entryPoint;
+
+    // Greedy descent through the levels above the new node
+    for (int lc = maxLevel; lc > level; --lc) {
+        bool changed = true;
+        float currentDistance = distance(query, vectorAt(current));
+        while (changed) {
+            changed = false;
+            const int *links = linksAt(current, lc);
+            for (int i = 1; i <= links[0]; ++i) {
+                float d = distance(query, vectorAt(links[i]));
+                if (d < currentDistance) {
+                    currentDistance = d;
+                    current = links[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (int lc = std::min(level, maxLevel); lc >= 0; --lc) {
+        std::vector<std::pair<float, int>> candidates = searchLayer(query, current, efConstruction, lc);
+        current = candidates.front().second;
+
+        selectNeighbours(candidates, M);
+        connect(node, lc, candidates);
+    }
+
+    if (level > maxLevel) {
+        maxLevel = level;
+        entryPoint = node;
+    }
+}
+
+bool FaceIndex::remove(qint64 id)
+{
+    auto it = labelToNode.find(id);
+    if (it == labelToNode.end()) {
+        return false;
+    }
+
+    deleted[it.value()] = 1;
+    labelToNode.erase(it);
+    ++deletedCount;
+
+    // Tombstones still route searches, but once they dominate the graph the
+    // walk wastes most of its budget on them
+    if (deletedCount > 1000 && deletedCount * 2 > static_cast<int>(labels.size())) {
+        rebuild();
+    }
+
+    return true;
+}
+
+bool FaceIndex::contains(qint64 id) const
+{
+    return labelToNode.contains(id);
+}
+
+void FaceIndex::rebuild()
+{
+    std::vector<float> oldVectors;
+    std::vector<qint64> oldLabels;
+    std::vector<unsigned char> oldDeleted;
+    oldVectors.swap(vectors);
+    oldLabels.swap(labels);
+    oldDeleted.swap(deleted);
+    int oldDim = dim;
+
+    clear();
+
+    dlib::matrix<float, 0, 1> encoding(oldDim);
+    for (size_t node = 0; node < oldLabels.size(); ++node) {
+        if (oldDeleted[node]) {
+            continue;
+        }
+        std::memcpy(encoding.begin(), oldVectors.data() + node * oldDim, oldDim * sizeof(float));
+        insert(oldLabels[node], encoding);
+    }
+
+    qDebug() << "FaceIndex: rebuilt graph with" << size() << "entries";
+}
+
+void FaceIndex::clear()
+{
+    dim = 0;
+    entryPoint = -1;
+    maxLevel = -1;
+    deletedCount = 0;
+    vectors.clear();
+    labels.clear();
+    levels.clear();
+    deleted.clear();
+    links0.clear();
+    upperLinks.clear();
+    labelToNode.clear();
+}
+
+QVector<FaceIndex::Match> FaceIndex::search(const dlib::matrix<float, 0, 1> &query, int k, int ef) const
+{
+    QVector<Match> matches;
+    if (entryPoint < 0 || query.size() != dim || k <= 0) {
+        return matches;
+    }
+
+    const float *q = &query(0);
+    int current = entryPoint;
+    float currentDistance = distance(q, vectorAt(current));
+
+    for (int lc = maxLevel; lc > 0; --lc) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const int *links = linksAt(current, lc);
+            for (int i = 1; i <= links[0]; ++i) {
+                float d = distance(q, vectorAt(links[i]));
+                if (d < currentDistance) {
+                    currentDistance = d;
+                    current = links[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<float, int>> candidates = searchLayer(q, current, std::max(ef, k) + deletedCount / 8, 0);
+    for (const auto &candidate : candidates) {
+        if (deleted[candidate.second]) {
+            continue;
+        }
+        matches.append({labels[candidate.second], std::sqrt(candidate.first)});
+        if (matches.size() >= k) {
+            break;
+        }
+    }
+
+    return matches;
+}
+
+int FaceIndex::size() const
+{
+    return labelToNode.size();
+}
+
+int FaceIndex::tombstones() const
+{
+    return deletedCount;
+}
+
+bool FaceIndex::save(const QString &filePath) const
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Error opening file for writing:" << file.errorString();
+        return false;
+    }
+
+    quint32 header[] = {indexMagic, indexVersion};
+    qint32 params[] = {dim, M, efConstruction, static_cast<qint32>(labels.size()), entryPoint, maxLevel, deletedCount};
+
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(params), sizeof(params));
+    file.write(reinterpret_cast<const char *>(labels.data()), labels.size() * sizeof(qint64));
+    file.write(reinterpret_cast<const char *>(levels.data()), levels.size() * sizeof(int));
+    file.write(reinterpret_cast<const char *>(deleted.data()), deleted.size());
+    file.write(reinterpret_cast<const char *>(vectors.data()), vectors.size() * sizeof(float));
+    file.write(reinterpret_cast<const char *>(links0.data()), links0.size() * sizeof(int));
+    for (const auto &links : upperLinks) {
+        file.write(reinterpret_cast<const char *>(links.data()), links.size() * sizeof(int));
+    }
+
+    return file.error() == QFileDevice::NoError;
+}
+
+bool FaceIndex::load(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    quint32 header[2];
+    qint32 params[7];
+    if (file.read(reinterpret_cast<char *>(header), sizeof(header)) != sizeof(header)
+        || header[0] != indexMagic || header[1] != indexVersion
+        || file.read(reinterpret_cast<char *>(params), sizeof(params)) != sizeof(params)
+        || params[1] != M) {
+        qDebug() << "FaceIndex: ignoring incompatible index file" << filePath;
+        return false;
+    }
+
+    clear();
+    dim = params[0];
+    efConstruction = params[2];
+    size_t count = params[3];
+    entryPoint = params[4];
+    maxLevel = params[5];
+    deletedCount = params[6];
+
+    auto readInto = [&file](void *data, qint64 bytes) {
+        return file.read(reinterpret_cast<char *>(data), bytes) == bytes;
+    };
+
+    labels.resize(count);
+    levels.resize(count);
+    deleted.resize(count);
+    vectors.resize(count * dim);
+    links0.resize(count * (1 + maxM0));
+
+    bool ok = readInto(labels.data(), count * sizeof(qint64))
+              && readInto(levels.data(), count * sizeof(int))
+              && readInto(deleted.data(), count)
+              && readInto(vectors.data(), vectors.size() * sizeof(float))
+              && readInto(links0.data(), links0.size() * sizeof(int));
+
+    upperLinks.resize(count);
+    for (size_t node = 0; ok && node < count; ++node) {
+        upperLinks[node].resize(static_cast<size_t>(levels[node]) * (1 + M));
+        ok = readInto(upperLinks[node].data(), upperLinks[node].size() * sizeof(int));
+    }
+
+    if (!ok) {
+        qDebug() << "FaceIndex: truncated index file" << filePath;
+        clear();
+        return false;
+    }
+
+    labelToNode.reserve(static_cast<int>(count));
+    for (size_t node = 0; node < count; ++node) {
+        if (!deleted[node]) {
+            labelToNode.insert(labels[node], static_cast<int>(node));
+        }
+    }
+
+    return true;
+}
+
+void FaceIndex::benchmark(int gallerySize, int queryCount, int k)
+{
+    const int dimensions = 128;
+    std::mt19937 generator(7);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    // Encodings of the same person sit close together, so generate identities
+    // as points on the unit sphere and jitter each enrolled image around them
+    auto randomEncoding = [&](const dlib::matrix<float, 0, 1> *centre, float spread) {
+        dlib::matrix<float, 0, 1> encoding(dimensions);
+        for (int i = 0; i < dimensions; ++i) {
+            encoding(i) = (centre ? (*centre)(i) : 0.0f) + normal(generator) * spread;
+        }
+        if (!centre) {
+            encoding /= dlib::length(encoding);
+        }
+        return encoding;
+    };
+
+    std::vector<dlib::matrix<float, 0, 1>> gallery;
+    gallery.reserve(gallerySize);
+    for (int i = 0; i < gallerySize; ++i) {
+        gallery.push_back(randomEncoding(nullptr, 0.09f));
+    }
+
+    FaceIndex index;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < gallerySize; ++i) {
+        index.insert(i, gallery[i]);
+    }
+    qDebug() << "FaceIndex benchmark: built" << gallerySize << "entries in" << timer.elapsed() << "ms";
+
+    timer.restart();
+    index.save("faceindex_benchmark.bin");
+    qint64 saveMs = timer.elapsed();
+    FaceIndex loaded;
+    timer.restart();
+    loaded.load("faceindex_benchmark.bin");
+    qDebug() << "FaceIndex benchmark: save" << saveMs << "ms, load" << timer.elapsed() << "ms";
+    QFile::remove("faceindex_benchmark.bin");
+
+    std::uniform_int_distribution<int> pick(0, gallerySize - 1);
+    std::vector<dlib::matrix<float, 0, 1>> queries;
+    for (int i = 0; i < queryCount; ++i) {
+        queries.push_back(randomEncoding(&gallery[pick(generator)], 0.02f));
+    }
+
+    for (int ef : {16, 32, 64, 128, 256}) {
+        qint64 exactNs = 0;
+        qint64 approxNs = 0;
+        int hits = 0;
+
+        for (const auto &query : queries) {
+            timer.restart();
+            std::vector<std::pair<float, int>> exact;
+            exact.reserve(gallery.size());
+            for (size_t i = 0; i < gallery.size(); ++i) {
+                exact.emplace_back(dlib::length_squared(query - gallery[i]), static_cast<int>(i));
+            }
+            std::partial_sort(exact.begin(), exact.begin() + k, exact.end());
+            exactNs += timer.nsecsElapsed();
+
+            timer.restart();
+            QVector<Match> approx = loaded.search(query, k, ef);
+            approxNs += timer.nsecsElapsed();
+
+            for (int i = 0; i < k; ++i) {
+                for (const Match &match : approx) {
+                    if (match.id == exact[i].second) {
+                        ++hits;
+                        break;
+                    }
+                }
+            }
+        }
+
+        qDebug() << "FaceIndex benchmark: ef" << ef
+                 << "recall@" << k << double(hits) / (queryCount * k)
+                 << "exact" << exactNs / 1000.0 / queryCount << "us/query"
+                 << "hnsw" << approxNs / 1000.0 / queryCount << "us/query";
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef FACEINDEX_H
+#define FACEINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <vector>
+#include <random>
+
+#include <dlib/matrix.h>
+
+// Approximate nearest-neighbour index (HNSW graph) over face encodings.
+// Entries are keyed by a caller supplied id; deletes are tombstones that are
+// skipped by search and dropped the next time the graph is rebuilt.
+class FaceIndex
+{
+public:
+    struct Match
+    {
+        qint64 id;
+        float distance; // Euclidean, same scale as length(a - b)
+    };
+
+    explicit FaceIndex(int M = 16, int efConstruction = 200);
+
+    void insert(qint64 id, const dlib::matrix<float, 0, 1> &encoding);
+    bool remove(qint64 id);
+    bool contains(qint64 id) const;
+    void clear();
+
+    QVector<Match> search(const dlib::matrix<float, 0, 1> &query, int k, int ef = 64) const;
+
+    int size() const;
+    int tombstones() const;
+
+    bool save(const QString &filePath) const;
+    bool load(const QString &filePath);
+
+    // Builds an index over a synthetic gallery and reports recall@k and
+    // per-query latency against an exact linear scan.
+    static void benchmark(int gallerySize, int queryCount, int k);
+
+private:
+    int M;
+    int maxM0;
+    int efConstruction;
+    double levelMult;
+    int dim = 0;
+
+    int entryPoint = -1;
+    int maxLevel = -1;
+    int deletedCount = 0;
+
+    std::vector<float> vectors;         // node * dim
+    std::vector<qint64> labels;
+    std::vector<int> levels;
+    std::vector<unsigned char> deleted;
+    std::vector<int> links0;            // node * (1 + maxM0), first slot is the count
+    std::vector<std::vector<int>> upperLinks; // per node, level 1..n, each (1 + M)
+    QHash<qint64, int> labelToNode;
+
+    std::mt19937 rng{42};
+
+    const float *vectorAt(int node) const { return vectors.data() + static_cast<size_t>(node) * dim; }
+    int *linksAt(int node, int level);
+    const int *linksAt(int node, int level) const;
+    int maxLinks(int level) const { return level == 0 ? maxM0 : M; }
+
+    float distance(const float *a, const float *b) const;
+    int randomLevel();
+
+    std::vector<std::pair<float, int>> searchLayer(const float *query, int entry, int ef, int level) const;
+    void selectNeighbours(std::vector<std::pair<float, int>> &candidates, int count) const;
+    void connect(int node, int level, const std::vector<std::pair<float, int>> &neighbours);
+    void rebuild();
+};
+
+#endif // FACEINDEX_H
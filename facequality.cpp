@@ -0,0 +1,61 @@
+#include "facequality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+double ramp(double value, double low, double high)
+{
+    return std::clamp((value - low) / (high - low), 0.0, 1.0);
+}
+
+} // namespace
+
+FaceQuality::Score FaceQuality::assess(const dlib::full_object_detection &shape, const dlib::matrix<dlib::rgb_pixel> &chip)
+{
+    Score score;
+    if (shape.num_parts() != 5 || chip.size() == 0) {
+        return score;
+    }
+
+    // Below 40 px the network has nothing to work with, from 100 px on
+    // size stops mattering
+    score.size = ramp(shape.get_rect().width(), 40.0, 100.0);
+
+    // dlib matrices are contiguous and row-major, wrap the chip without copying
+    cv::Mat rgb(static_cast<int>(chip.nr()), static_cast<int>(chip.nc()), CV_8UC3,
+                const_cast<dlib::rgb_pixel *>(&chip(0, 0)));
+    cv::Mat gray;
+    cv::cvtColor(rgb, gray, cv::COLOR_RGB2GRAY);
+
+    cv::Mat laplacian;
+    cv::Laplacian(gray, laplacian, CV_64F);
+    cv::Scalar laplacianMean;
+    cv::Scalar laplacianStddev;
+    cv::meanStdDev(laplacian, laplacianMean, laplacianStddev);
+    score.sharpness = ramp(laplacianStddev[0] * laplacianStddev[0], 15.0, 100.0);
+
+    // 5 point model: two corners per eye, then the bottom of the nose. A
+    // frontal face has the nose under the midpoint of the eyes, turning the
+    // head moves it along the eye line.
+    dlib::dpoint eyeA = (dlib::dpoint(shape.part(0)) + dlib::dpoint(shape.part(1))) / 2.0;
+    dlib::dpoint eyeB = (dlib::dpoint(shape.part(2)) + dlib::dpoint(shape.part(3))) / 2.0;
+    dlib::dpoint nose(shape.part(4));
+    dlib::dpoint eyeLine = eyeB - eyeA;
+    double eyeDistance = eyeLine.length();
+    if (eyeDistance > 1.0) {
+        double yaw = (nose - (eyeA + eyeB) / 2.0).dot(eyeLine) / (eyeDistance * eyeDistance);
+        score.pose = 1.0 - ramp(std::abs(yaw), 0.1, 0.45);
+    }
+
+    cv::Scalar mean;
+    cv::Scalar stddev;
+    cv::meanStdDev(gray, mean, stddev);
+    double brightness = std::min(ramp(mean[0], 30.0, 70.0), 1.0 - ramp(mean[0], 185.0, 225.0));
+    score.exposure = brightness * ramp(stddev[0], 10.0, 30.0);
+
+    score.overall = std::pow(score.size * score.sharpness * score.pose * score.exposure, 0.25);
+    return score;
+}
@@ -0,0 +1,30 @@
+#ifndef FACEQUALITY_H
+#define FACEQUALITY_H
+
+#include <dlib/image_processing.h>
+#include <dlib/matrix.h>
+#include <dlib/pixel.h>
+
+// Cheap checks run on an aligned chip before it goes through the embedding
+// network. Each component is 0..1, overall is their geometric mean, so one
+// failing component (a profile, a blurred frame) pulls the whole face down.
+class FaceQuality
+{
+public:
+    struct Score
+    {
+        double size = 0.0;       // Face width in source pixels
+        double sharpness = 0.0;  // Laplacian variance of the chip
+        double pose = 0.0;       // Yaw from the eye and nose landmarks
+        double exposure = 0.0;   // Chip brightness and contrast
+        double overall = 0.0;
+    };
+
+    // shape is the 5 point landmark fit in source coordinates, chip the
+    // aligned 150x150 crop extracted from it
+    static Score assess(const dlib::full_object_detection &shape, const dlib::matrix<dlib::rgb_pixel> &chip);
+
+    static constexpr double defaultThreshold = 0.5;
+};
+
+#endif // FACEQUALITY_H
@@ -8,6 +8,14 @@
 #include <QSqlError>
 #include <QFileDialog>
 #include <opencv2/opencv.hpp>
+#include <QProgressDialog>
+#include <QThread>
+#include <QFileInfo>
+#include <QPushButton>
+#include "bulkenrollment.h"
+#include "frequentvisitors.h"
+#include "unknownclusterer.h"
+#include <QDir>
 
 faceshandler::faceshandler(QWidget *parent) :
     QWidget(parent),
@@ -117,36 +125,15 @@ void faceshandler::on_load_image_button_clicked()
             return;
         }
 
-        // Convert the image to dlib's format
-        dlib::cv_image<dlib::bgr_pixel> dlib_img(img);
-
-        // Detect faces
-        dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
-        std::vector<dlib::rectangle> faces = detector(dlib_img);
-
-        if (faces.empty()) {
-            QMessageBox::critical(this, "Face Detection Error", "No face detected in the image.");
-            return;
-        }
-        else if (faces.size() > 1)
-        {
-            QMessageBox::critical(this, "Face Detection Error", "Expected exactly one face in " + fileName + ", but found " + QString::number(faces.size()) + " faces.");
+        // Detect, align and embed with the shared per-thread detector
+        std::string error;
+        if (!compute_face_encoding(img, face_encoding, &face_chip, &error)) {
+            QMessageBox::critical(this, "Face Detection Error", fileName + ": " + QString::fromStdString(error));
             return;
         }
 
-        // Assuming we only want the first detected face
-        auto shape = sp(dlib_img, faces[0]);
-
-        extract_image_chip(dlib_img, get_face_chip_details(shape, 150, 0.25), face_chip);
-
-        // Convert dlib matrix to QImage
-        QImage qimg(face_chip.nc(), face_chip.nr(), QImage::Format_RGB888);
-        for (int y = 0; y < face_chip.nr(); ++y)
-            for (int x = 0; x < face_chip.nc(); ++x)
-                qimg.setPixel(x, y, qRgb(face_chip(y, x).red, face_chip(y, x).green, face_chip(y, x).blue));
-
         // Display the face in the QLabel
-        ui->image_label->setPixmap(QPixmap::fromImage(qimg));
+        ui->image_label->setPixmap(QPixmap::fromImage(chip_to_image(face_chip)));
         facedetected = true;
         change_state();
     }
@@ -190,6 +177,7 @@ void faceshandler::on_clear_button_clicked()
     ui->name->clear();
     ui->age->clear();
     facedetected = false;
+    pendingVisitorId = -1;
     change_state();
 }
 
@@ -231,8 +219,6 @@ void faceshandler::on_save_details_button_clicked()
         // Convert gender to string
         QString gender = isMale ? "Male" : "Female";
 
-        dlib::matrix<float, 0, 1> face_encoding = net(face_chip);
-
         // Serialize the face encoding into a QByteArray
         QByteArray encodingBytes;
         QDataStream stream(&encodingBytes, QIODevice::WriteOnly);
@@ -253,8 +239,14 @@ void faceshandler::on_save_details_button_clicked()
             return;
         }
 
-        emit add_face(face_encoding);
+        emit add_face(query.lastInsertId().toLongLong(), face_encoding);
         update_table();
+
+        if (pendingVisitorId != -1)
+        {
+            UnknownClusterer::forget(db1, pendingVisitorId);
+            pendingVisitorId = -1;
+        }
         QMessageBox::information(this, "Success", "Details saved successfully.");
 
     }
@@ -268,13 +260,15 @@ void faceshandler::on_update_button_clicked()
 void faceshandler::fetch_faceEncodings()
 {
     QSqlQuery query(db1);
-    query.prepare("SELECT encoding, image_path FROM face_encodings");
+    query.prepare("SELECT id, encoding, image_path FROM face_encodings");
 
     if (!query.exec()) {
         qDebug() << "Error fetching data from table 'face_encodings':" << query.lastError().text();
         return;
     }
 
+    QVector<FaceGallery::Entry> faces;
+
     while (query.next())
     {
         QByteArray encodingBytes = query.value("encoding").toByteArray();
@@ -295,8 +289,11 @@ void faceshandler::fetch_faceEncodings()
         // Copy data from QByteArray to dlib::matrix
         std::memcpy(face_encoding_enc.begin(), encodingBytes.constData(), encodingBytes.size());
 
-        emit add_face(face_encoding_enc);
+        faces.append({query.value("id").toLongLong(), face_encoding_enc});
     }
+
+    // Publish the whole table to the gallery in one update
+    emit add_faces(faces);
 }
 
 void faceshandler::on_selection_changed(const QItemSelection &selected, const QItemSelection &deselected)
@@ -327,7 +324,7 @@ void faceshandler::on_delete_button_clicked()
                                   QMessageBox::Yes|QMessageBox::No);
     if (reply == QMessageBox::Yes) {
         // Get the ID of the selected row (assuming ID is in the first column)
-        int id = model->data(model->index(selectedRow, 0)).toInt();
+        qint64 id = model->data(model->index(selectedRow, 0)).toLongLong();
 
         // Delete the row from the database
         QSqlQuery query(db1);
@@ -340,8 +337,120 @@ void faceshandler::on_delete_button_clicked()
             return;
         }
 
-        emit delete_face(selectedRow);
+        emit delete_face(id);
         update_table();
         QMessageBox::information(this, "Success", "Entry deleted successfully.");
     }
 }
+
+void faceshandler::on_bulk_import_button_clicked()
+{
+    if (bulkImportRunning)
+    {
+        QMessageBox::critical(this, "Error", "A bulk import is already running.");
+        return;
+    }
+
+    QMessageBox sourceBox(QMessageBox::Question, "Bulk Import", "Import every photo in a folder (named after the person) or a CSV file with image_path,name,age,gender?", QMessageBox::Cancel, this);
+    QPushButton *folderButton = sourceBox.addButton("Folder", QMessageBox::AcceptRole);
+    QPushButton *csvButton = sourceBox.addButton("CSV File", QMessageBox::AcceptRole);
+    sourceBox.exec();
+
+    QString source;
+    if (sourceBox.clickedButton() == folderButton)
+    {
+        source = QFileDialog::getExistingDirectory(this, tr("Select Folder of Photos"));
+    }
+    else if (sourceBox.clickedButton() == csvButton)
+    {
+        source = QFileDialog::getOpenFileName(this, tr("Open CSV"), "", tr("CSV Files (*.csv)"));
+    }
+
+    if (source.isEmpty())
+        return;
+
+    BulkEnrollmentWorker *worker = new BulkEnrollmentWorker(source, db1.databaseName());
+    QThread *importThread = new QThread;
+    worker->moveToThread(importThread);
+
+    QProgressDialog *progressDialog = new QProgressDialog("Importing faces...", "Cancel", 0, 0, this);
+    progressDialog->setWindowModality(Qt::NonModal);
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+
+    QStringList *errors = new QStringList;
+
+    connect(importThread, &QThread::started, worker, &BulkEnrollmentWorker::run);
+    connect(progressDialog, &QProgressDialog::canceled, worker, &BulkEnrollmentWorker::cancel, Qt::DirectConnection);
+    connect(worker, &BulkEnrollmentWorker::progress, progressDialog, [progressDialog](int done, int total)
+    {
+        progressDialog->setMaximum(total);
+        progressDialog->setValue(done);
+    });
+    connect(worker, &BulkEnrollmentWorker::fileFailed, this, [errors](const QString &path, const QString &error)
+    {
+        qDebug() << "Bulk import failed for" << path << ":" << error;
+        errors->append(QFileInfo(path).fileName() + ": " + error);
+    });
+    connect(worker, &BulkEnrollmentWorker::finished, this, [this, progressDialog, errors](const QVector<FaceGallery::Entry> &faces, int failed)
+    {
+        progressDialog->close();
+
+        // Publish every new identity to the live gallery in one update
+        emit add_faces(faces);
+        update_table();
+
+        QString summary = QString("%1 faces enrolled, %2 failed.").arg(faces.size()).arg(failed);
+        if (!errors->isEmpty())
+        {
+            summary += "\n\n" + errors->mid(0, 20).join("\n");
+            if (errors->size() > 20)
+                summary += QString("\n... and %1 more").arg(errors->size() - 20);
+        }
+        QMessageBox::information(this, "Bulk Import", summary);
+
+        delete errors;
+        bulkImportRunning = false;
+    });
+    connect(worker, &BulkEnrollmentWorker::finished, importThread, &QThread::quit);
+    connect(importThread, &QThread::finished, worker, &QObject::deleteLater);
+    connect(importThread, &QThread::finished, importThread, &QThread::deleteLater);
+
+    bulkImportRunning = true;
+    importThread->start();
+}
+
+void faceshandler::on_frequent_visitors_button_clicked()
+{
+    if (facedetected)
+    {
+        QMessageBox::critical(this, "Error", "Please clear the previous instance first");
+        return;
+    }
+
+    FrequentVisitorsDialog dialog(db1, this);
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    UnknownClusterer::Visitor visitor = dialog.selectedVisitor();
+    if (visitor.id == 0 || visitor.chip.isNull() || visitor.centroid.size() == 0)
+        return;
+
+    // The cluster centroid is the encoding, the best chip becomes the photo
+    QImage chip = visitor.chip.convertToFormat(QImage::Format_RGB888);
+    face_chip = image_to_chip(chip);
+    face_encoding = visitor.centroid;
+
+    QDir().mkpath("unknown_visitors");
+    QString imagePath = QDir("unknown_visitors").absoluteFilePath(QString("%1.jpg").arg(visitor.id));
+    if (!chip.save(imagePath, "JPG"))
+    {
+        qDebug() << "Could not save visitor chip to" << imagePath;
+    }
+
+    ui->image_path->setText(imagePath);
+    ui->image_label->setPixmap(QPixmap::fromImage(chip));
+    pendingVisitorId = visitor.id;
+    facedetected = true;
+    change_state();
+}
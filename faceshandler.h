@@ -5,6 +5,7 @@
 #include <QtSql/QSqlTableModel>
 #include <QItemSelection>
 #include "dlib_utils.h"
+#include "facegallery.h"
 #include <opencv2/opencv.hpp>
 
 
@@ -23,8 +24,9 @@ public:
     void fetch_faceEncodings();
 
 signals:
-    void add_face(dlib::matrix<float, 0, 1>& face_encoding);
-    void delete_face(int num);
+    void add_face(qint64 id, const dlib::matrix<float, 0, 1> &face_encoding);
+    void add_faces(const QVector<FaceGallery::Entry> &faces);
+    void delete_face(qint64 id);
 
 private slots:
     void on_load_image_button_clicked();
@@ -39,14 +41,21 @@ private slots:
 
     void on_selection_changed(const QItemSelection &selected, const QItemSelection &deselected); // Add this line
 
+    void on_bulk_import_button_clicked();
+
+    void on_frequent_visitors_button_clicked();
+
 private:
     Ui::faceshandler *ui;
     QSqlTableModel *model;
     QSqlDatabase db1;
 
     bool facedetected = false;
+    bool bulkImportRunning = false;
+    qint64 pendingVisitorId = -1; // Unknown visitor being enrolled, removed once saved
 
     dlib::matrix<dlib::rgb_pixel> face_chip;
+    dlib::matrix<float, 0, 1> face_encoding;
     cv::Mat img = cv::imread("Icons/blank_new.jpeg");
     QImage blank_img = QImage(img.data, img.cols, img.rows, img.step, QImage::Format_RGB888);
 
@@ -0,0 +1,122 @@
+#include "facetracker.h"
+#include "dlib_utils.h"
+#include "recordingworker.h"
+
+#include <algorithm>
+
+FaceTracker::FaceTracker(double minOverlap, int maxMissed)
+    : minOverlap(minOverlap), maxMissed(maxMissed)
+{
+}
+
+std::vector<int> FaceTracker::update(const std::vector<cv::Rect> &boxes)
+{
+    std::vector<int> ids(boxes.size(), 0);
+    std::vector<bool> trackUsed(tracks.size(), false);
+
+    // Best overlapping pair first, a handful of faces per frame keeps this cheap
+    struct Candidate
+    {
+        double overlap;
+        size_t box;
+        size_t track;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t b = 0; b < boxes.size(); ++b) {
+        for (size_t t = 0; t < tracks.size(); ++t) {
+            double intersection = (boxes[b] & tracks[t].box).area();
+            double combined = boxes[b].area() + tracks[t].box.area() - intersection;
+            double overlap = combined > 0 ? intersection / combined : 0.0;
+            if (overlap >= minOverlap) {
+                candidates.push_back({overlap, b, t});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.overlap > b.overlap;
+    });
+
+    for (const Candidate &candidate : candidates) {
+        if (ids[candidate.box] != 0 || trackUsed[candidate.track]) {
+            continue;
+        }
+        Track &track = tracks[candidate.track];
+        track.box = boxes[candidate.box];
+        track.missed = 0;
+        trackUsed[candidate.track] = true;
+        ids[candidate.box] = track.id;
+    }
+
+    for (size_t t = 0; t < trackUsed.size(); ++t) {
+        if (!trackUsed[t]) {
+            ++tracks[t].missed;
+        }
+    }
+
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [this](const Track &track) {
+        return track.missed > maxMissed;
+    }), tracks.end());
+
+    for (size_t b = 0; b < boxes.size(); ++b) {
+        if (ids[b] == 0) {
+            Track track;
+            track.id = nextId++;
+            track.box = boxes[b];
+            tracks.push_back(track);
+            ids[b] = track.id;
+        }
+    }
+
+    return ids;
+}
+
+FaceTracker::Track *FaceTracker::track(int id)
+{
+    auto it = std::find_if(tracks.begin(), tracks.end(), [id](const Track &track) {
+        return track.id == id;
+    });
+    return it == tracks.end() ? nullptr : &*it;
+}
+
+void FaceTracker::offerChip(int id, const dlib::matrix<dlib::rgb_pixel> &chip, double quality)
+{
+    Track *current = track(id);
+    if (!current || quality <= current->bestQuality) {
+        return;
+    }
+
+    current->bestQuality = quality;
+
+    // Only the best few go into an event record. Motion without an event
+    // never takes the list, so it keeps no more than those.
+    auto byQuality = [](const EventFace &a, const EventFace &b) {
+        return a.quality < b.quality;
+    };
+    if (!eventFaces.contains(id) && eventFaces.size() >= RecordingWorker::maxEventFaces) {
+        auto worst = std::min_element(eventFaces.begin(), eventFaces.end(), byQuality);
+        if (quality <= worst->quality) {
+            return;
+        }
+        eventFaces.erase(worst);
+    }
+
+    // Deep copy, the event record outlives the track
+    eventFaces[id] = {id, quality, chip_to_image(chip)};
+}
+
+QVector<FaceTracker::EventFace> FaceTracker::takeEventFaces()
+{
+    QVector<EventFace> faces = eventFaces.values();
+    eventFaces.clear();
+
+    std::sort(faces.begin(), faces.end(), [](const EventFace &a, const EventFace &b) {
+        return a.quality > b.quality;
+    });
+    return faces;
+}
+
+void FaceTracker::clear()
+{
+    tracks.clear();
+    eventFaces.clear();
+}
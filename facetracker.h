@@ -0,0 +1,63 @@
+#ifndef FACETRACKER_H
+#define FACETRACKER_H
+
+#include <QImage>
+#include <QMap>
+#include <QVector>
+#include <dlib/matrix.h>
+#include <dlib/pixel.h>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Links face boxes across frames of one camera by overlap, so per-face state
+// (recognition result, best chip quality so far) survives between
+// detections. Boxes are in source frame coordinates, which do not change
+// with display or detection scale.
+class FaceTracker
+{
+public:
+    struct Track
+    {
+        int id = 0;
+        cv::Rect box;
+        int missed = 0;                 // Detection passes without a matching box
+        qint64 matchedId = -1;          // Gallery id once recognised
+        double bestQuality = -1.0;
+        double submittedQuality = -1.0; // Best chip handed to the visitor clusters
+        qint64 lastSightingMs = 0;      // Last row written to the sightings index
+    };
+
+    struct EventFace
+    {
+        int trackId;
+        double quality;
+        QImage chip;
+    };
+
+    explicit FaceTracker(double minOverlap = 0.3, int maxMissed = 10);
+
+    // Greedy IoU association, unmatched boxes start new tracks. Returns the
+    // track id for every box, in order.
+    std::vector<int> update(const std::vector<cv::Rect> &boxes);
+
+    Track *track(int id);
+
+    // Keeps the chip if it beats the track's best so far
+    void offerChip(int id, const dlib::matrix<dlib::rgb_pixel> &chip, double quality);
+
+    // Best chip of the best tracks seen since the last call, best first, as
+    // many as an event record keeps. Used when a recording is cut.
+    QVector<EventFace> takeEventFaces();
+
+    void clear();
+
+private:
+    double minOverlap;
+    int maxMissed;
+    int nextId = 1;
+
+    std::vector<Track> tracks;
+    QMap<int, EventFace> eventFaces;
+};
+
+#endif // FACETRACKER_H
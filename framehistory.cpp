@@ -0,0 +1,282 @@
+#include "framehistory.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+FrameHistory::FrameHistory()
+    : d(new Data)
+{
+}
+
+void FrameHistory::append(const QDateTime &capturedAt, const cv::Mat &frame)
+{
+    QWriteLocker locker(&d->lock);
+
+    // A clock stepping back must not break the binary searches, the frame
+    // keeps its own time but sorts as if it came right after the last one
+    qint64 time = capturedAt.toMSecsSinceEpoch();
+    if (!d->times.empty()) {
+        time = std::max(time, d->times.back());
+    }
+
+    qint64 position = d->end();
+    d->frames.push_back(qMakePair(capturedAt.date(), qMakePair(frame, capturedAt.time())));
+    d->times.push_back(time);
+
+    auto day = d->dayIndex.find(capturedAt.date());
+    if (day == d->dayIndex.end()) {
+        d->dayIndex.insert(capturedAt.date(), qMakePair(position, position));
+    } else {
+        day->second = position;
+    }
+
+    // One thumbnail a second
+    Second &second = d->seconds[capturedAt.toSecsSinceEpoch()];
+    if (second.thumbnail.empty()) {
+        int height = std::max(1, frame.rows * thumbnailWidth / frame.cols);
+        cv::resize(frame, second.thumbnail, cv::Size(thumbnailWidth, height), 0, 0, cv::INTER_AREA);
+    }
+}
+
+void FrameHistory::addActivity(const QDateTime &capturedAt, Activity activity)
+{
+    QWriteLocker locker(&d->lock);
+    Second &second = d->seconds[capturedAt.toSecsSinceEpoch()];
+    if (activity == Motion) {
+        ++second.motion;
+    } else {
+        ++second.faces;
+    }
+}
+
+void FrameHistory::clear()
+{
+    // Positions keep counting, views opened before still line up
+    QWriteLocker locker(&d->lock);
+    d->removed = d->end();
+    d->frames.clear();
+    d->times.clear();
+    d->dayIndex.clear();
+    d->seconds.clear();
+}
+
+void FrameHistory::removeBefore(const QDateTime &cutoff)
+{
+    QWriteLocker locker(&d->lock);
+    auto last = std::lower_bound(d->times.begin(), d->times.end(), cutoff.toMSecsSinceEpoch());
+    qint64 count = last - d->times.begin();
+    if (count == 0) {
+        return;
+    }
+
+    d->seconds.erase(d->seconds.begin(), d->seconds.lowerBound(cutoff.toSecsSinceEpoch()));
+    d->frames.erase(d->frames.begin(), d->frames.begin() + count);
+    d->times.erase(d->times.begin(), last);
+    d->removed += count;
+
+    for (auto day = d->dayIndex.begin(); day != d->dayIndex.end();) {
+        if (day->second < d->removed) {
+            day = d->dayIndex.erase(day);
+        } else {
+            day->first = std::max(day->first, d->removed);
+            ++day;
+        }
+    }
+}
+
+int FrameHistory::size() const
+{
+    QReadLocker locker(&d->lock);
+    return static_cast<int>(d->frames.size());
+}
+
+QVector<FrameHistory::Frame> FrameHistory::slice(const QDateTime &from, const QDateTime &to) const
+{
+    QReadLocker locker(&d->lock);
+    auto first = std::lower_bound(d->times.cbegin(), d->times.cend(), from.toMSecsSinceEpoch());
+    auto last = std::upper_bound(first, d->times.cend(), to.toMSecsSinceEpoch());
+    auto begin = d->frames.cbegin() + (first - d->times.cbegin());
+    return QVector<Frame>(begin, begin + (last - first));
+}
+
+QVector<FrameHistory::Frame> FrameHistory::frames() const
+{
+    QReadLocker locker(&d->lock);
+    return QVector<Frame>(d->frames.cbegin(), d->frames.cend());
+}
+
+HistoryView FrameHistory::view() const
+{
+    QReadLocker locker(&d->lock);
+    HistoryView view;
+    view.d = d;
+    view.origin = d->removed;
+    view.end = d->end();
+    return view;
+}
+
+void HistoryView::setLiveTail(bool live)
+{
+    if (!d || live == liveTail) {
+        return;
+    }
+
+    // Leaving live tail freezes the view where the store is now
+    if (!live) {
+        QReadLocker locker(&d->lock);
+        end = d->end();
+    }
+    liveTail = live;
+}
+
+qint64 HistoryView::visibleBegin() const
+{
+    return std::max(origin, d->removed);
+}
+
+qint64 HistoryView::visibleEnd() const
+{
+    return liveTail ? d->end() : std::min(end, d->end());
+}
+
+int HistoryView::size() const
+{
+    if (!d) {
+        return 0;
+    }
+    if (!liveTail) {
+        return static_cast<int>(end - origin);
+    }
+    QReadLocker locker(&d->lock);
+    return static_cast<int>(d->end() - origin);
+}
+
+bool HistoryView::frameAt(int index, Frame &frame) const
+{
+    if (!d || index < 0) {
+        return false;
+    }
+    QReadLocker locker(&d->lock);
+    qint64 position = origin + index;
+    if (position < visibleBegin() || position >= visibleEnd()) {
+        return false;
+    }
+    frame = d->frames[position - d->removed];
+    return true;
+}
+
+QDateTime HistoryView::timestamp(int index) const
+{
+    Frame frame;
+    if (!frameAt(index, frame)) {
+        return QDateTime();
+    }
+    return QDateTime(frame.first, frame.second.second);
+}
+
+QList<QDate> HistoryView::days() const
+{
+    QList<QDate> days;
+    if (!d) {
+        return days;
+    }
+    QReadLocker locker(&d->lock);
+    qint64 begin = visibleBegin();
+    qint64 finish = visibleEnd();
+    for (auto day = d->dayIndex.cbegin(); day != d->dayIndex.cend(); ++day) {
+        if (day->second >= begin && day->first < finish) {
+            days.append(day.key());
+        }
+    }
+    return days;
+}
+
+QPair<int, int> HistoryView::dayRange(const QDate &day) const
+{
+    if (!d) {
+        return qMakePair(-1, -1);
+    }
+    QReadLocker locker(&d->lock);
+    auto it = d->dayIndex.constFind(day);
+    if (it == d->dayIndex.constEnd()) {
+        return qMakePair(-1, -1);
+    }
+
+    qint64 first = std::max(it->first, visibleBegin());
+    qint64 last = std::min(it->second, visibleEnd() - 1);
+    if (first > last) {
+        return qMakePair(-1, -1);
+    }
+    return qMakePair(static_cast<int>(first - origin), static_cast<int>(last - origin));
+}
+
+int HistoryView::indexAt(const QDateTime &time) const
+{
+    if (!d) {
+        return -1;
+    }
+    QReadLocker locker(&d->lock);
+    qint64 begin = visibleBegin();
+    qint64 finish = visibleEnd();
+    if (begin >= finish) {
+        return -1;
+    }
+
+    auto first = d->times.cbegin() + (begin - d->removed);
+    auto last = d->times.cbegin() + (finish - d->removed);
+    qint64 position = begin + (std::lower_bound(first, last, time.toMSecsSinceEpoch()) - first);
+    return static_cast<int>(std::min(position, finish - 1) - origin);
+}
+
+QVector<HistoryView::Frame> HistoryView::range(int first, int last) const
+{
+    if (!d) {
+        return QVector<Frame>();
+    }
+    QReadLocker locker(&d->lock);
+    qint64 begin = std::max(origin + first, visibleBegin());
+    qint64 finish = std::min(origin + last + 1, visibleEnd());
+    if (begin >= finish) {
+        return QVector<Frame>();
+    }
+    auto frame = d->frames.cbegin() + (begin - d->removed);
+    return QVector<Frame>(frame, frame + (finish - begin));
+}
+
+QVector<QPair<int, int>> HistoryView::activity(const QDateTime &from, const QDateTime &to, int buckets) const
+{
+    QVector<QPair<int, int>> result(std::max(buckets, 0), qMakePair(0, 0));
+    qint64 first = from.toSecsSinceEpoch();
+    qint64 span = to.toSecsSinceEpoch() - first + 1;
+    if (!d || buckets <= 0 || span <= 0) {
+        return result;
+    }
+
+    QReadLocker locker(&d->lock);
+    const QMap<qint64, FrameHistory::Second> &seconds = d->seconds;
+    for (auto second = seconds.lowerBound(first); second != seconds.cend() && second.key() < first + span; ++second) {
+        int bucket = static_cast<int>((second.key() - first) * buckets / span);
+        result[bucket].first += second->motion;
+        result[bucket].second += second->faces;
+    }
+    return result;
+}
+
+cv::Mat HistoryView::thumbnailAt(const QDateTime &time) const
+{
+    if (!d) {
+        return cv::Mat();
+    }
+
+    QReadLocker locker(&d->lock);
+    qint64 first = time.toSecsSinceEpoch();
+    const QMap<qint64, FrameHistory::Second> &seconds = d->seconds;
+    for (auto second = seconds.lowerBound(first); second != seconds.cend() && second.key() < first + 60; ++second) {
+        if (!second->thumbnail.empty()) {
+            return second->thumbnail;
+        }
+    }
+    return cv::Mat();
+}
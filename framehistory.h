@@ -0,0 +1,155 @@
+#ifndef FRAMEHISTORY_H
+#define FRAMEHISTORY_H
+
+#include <QDate>
+#include <QDateTime>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <QTime>
+#include <QVector>
+#include <deque>
+#include <opencv2/core.hpp>
+
+class HistoryView;
+
+// A camera's recorded frames in capture order, with the indexes rewind
+// needs kept up to date on append: capture times for binary search and the
+// first/last frame of every day. Opening a day, its range and the frame
+// nearest a time are all O(log n).
+//
+// Every second also gets a small thumbnail, taken from its first frame, and
+// counts of the frames with motion and with faces. They are filled in as
+// frames are captured, the timeline never has to go back to the frames.
+//
+// Frames keep the (date, (frame, time)) layout RecordingWorker takes. The
+// store is shared, not copied: copies of a FrameHistory and the views made
+// from it all see the same frames, so a rewind session costs nothing
+// however long the history is.
+class FrameHistory
+{
+public:
+    using Frame = QPair<QDate, QPair<cv::Mat, QTime>>;
+
+    enum Activity
+    {
+        Motion,
+        Faces
+    };
+
+    struct Second
+    {
+        cv::Mat thumbnail;
+        int motion = 0;  // Frames with motion
+        int faces = 0;   // Frames with faces
+    };
+
+    static const int thumbnailWidth = 96;
+
+    FrameHistory();
+
+    // Copies share the store. There is no move, a moved-from history would
+    // be left without one.
+    FrameHistory(const FrameHistory &other) = default;
+    FrameHistory &operator=(const FrameHistory &other) = default;
+
+    void append(const QDateTime &capturedAt, const cv::Mat &frame);
+    void clear();
+
+    // The analyzers saw activity in the frame captured at capturedAt
+    void addActivity(const QDateTime &capturedAt, Activity activity);
+
+    // Drops every frame captured before cutoff
+    void removeBefore(const QDateTime &cutoff);
+
+    int size() const;
+    bool isEmpty() const { return size() == 0; }
+
+    // Frames captured in [from, to]
+    QVector<Frame> slice(const QDateTime &from, const QDateTime &to) const;
+
+    // Every frame, the images themselves are shared
+    QVector<Frame> frames() const;
+
+    // Read-only view of the frames recorded so far
+    HistoryView view() const;
+
+private:
+    friend class HistoryView;
+
+    struct Data
+    {
+        mutable QReadWriteLock lock;
+        std::deque<Frame> frames;
+        std::deque<qint64> times;  // msecs since epoch, never decreasing
+        QMap<QDate, QPair<qint64, qint64>> dayIndex; // First, last, counted from the very first frame
+        QMap<qint64, Second> seconds; // By secs since epoch
+        qint64 removed = 0;     // Frames dropped from the front so far
+
+        qint64 end() const { return removed + static_cast<qint64>(frames.size()); }
+    };
+
+    QSharedPointer<Data> d;
+};
+
+// A rewind session's window on a FrameHistory. It holds the store, not the
+// frames: positions count from the first frame there was when the view was
+// made, and stay put when old frames are trimmed (those read as missing).
+//
+// The view ends at the last frame of the time it was made. In live tail mode
+// it follows the store instead and new frames show up as they are captured.
+class HistoryView
+{
+public:
+    using Frame = FrameHistory::Frame;
+
+    HistoryView() = default;
+
+    void setLiveTail(bool live);
+    bool isLiveTail() const { return liveTail; }
+
+    int size() const;
+    bool isEmpty() const { return size() == 0; }
+
+    // False when the frame was trimmed or is outside the view
+    bool frameAt(int index, Frame &frame) const;
+    QDateTime timestamp(int index) const;
+
+    // Days with frames in the view, oldest first
+    QList<QDate> days() const;
+
+    // First and last index of the day, (-1, -1) without frames that day
+    QPair<int, int> dayRange(const QDate &day) const;
+
+    // First frame captured at or after time, the last frame past the end,
+    // -1 when empty
+    int indexAt(const QDateTime &time) const;
+
+    // Frames first..last, the images themselves are shared
+    QVector<Frame> range(int first, int last) const;
+
+    // Motion and face frame counts summed into buckets equal parts of
+    // [from, to], seconds without frames count as nothing
+    QVector<QPair<int, int>> activity(const QDateTime &from, const QDateTime &to, int buckets) const;
+
+    // Thumbnail of the first second at or after time that has one, within
+    // a minute, empty otherwise
+    cv::Mat thumbnailAt(const QDateTime &time) const;
+
+private:
+    friend class FrameHistory;
+
+    QSharedPointer<FrameHistory::Data> d;
+    qint64 origin = 0;   // Store position of index 0
+    qint64 end = 0;      // Store position past the last frame, unless live
+    bool liveTail = false;
+
+    // Store positions still readable, [visibleBegin, visibleEnd), with the
+    // lock held
+    qint64 visibleBegin() const;
+    qint64 visibleEnd() const;
+};
+
+#endif // FRAMEHISTORY_H
@@ -0,0 +1,138 @@
+#include "frameprefetcher.h"
+
+#include <QMutexLocker>
+#include <QtConcurrent/QtConcurrent>
+#include <opencv2/imgproc.hpp>
+
+FramePrefetcher::FramePrefetcher(const HistoryView &history, int depth)
+    : history(history), depth(depth)
+{
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+    }
+    future.waitForFinished();
+}
+
+void FramePrefetcher::setHistory(const HistoryView &view)
+{
+    QMutexLocker locker(&mutex);
+    history = view;
+    cache.clear();
+}
+
+void FramePrefetcher::request(int index, int step, const QSize &target)
+{
+    QMutexLocker locker(&mutex);
+    if (target != size) {
+        cache.clear();
+        size = target;
+    }
+    playhead = index;
+    stride = step == 0 ? 1 : step;
+    evict();
+
+    if (!running && !stopping) {
+        running = true;
+        future = QtConcurrent::run([this]() { run(); });
+    }
+}
+
+bool FramePrefetcher::take(int index, const QSize &target, QImage &image)
+{
+    QMutexLocker locker(&mutex);
+    if (target != size) {
+        return false;
+    }
+    auto it = cache.find(index);
+    if (it == cache.end()) {
+        return false;
+    }
+    image = it.value();
+    cache.erase(it);
+    return !image.isNull();
+}
+
+QImage FramePrefetcher::toImage(const cv::Mat &mat, const QSize &size)
+{
+    // scaled() makes its own copy, the converted Mat can go afterwards
+    if (mat.channels() == 3) {
+        cv::Mat rgb;
+        cv::cvtColor(mat, rgb, cv::COLOR_BGR2RGB);
+        QImage image(rgb.data, rgb.cols, rgb.rows, rgb.step, QImage::Format_RGB888);
+        return image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    if (mat.channels() == 1) {
+        QImage image(mat.data, mat.cols, mat.rows, mat.step, QImage::Format_Grayscale8);
+        return image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return QImage();
+}
+
+void FramePrefetcher::run()
+{
+    while (true) {
+        int index = -1;
+        HistoryView view;
+        QSize target;
+        {
+            QMutexLocker locker(&mutex);
+            if (!stopping) {
+                // Nearest missing frame first, the playhead gets there soonest
+                for (int k = 1; k <= depth; ++k) {
+                    int candidate = playhead + stride * k;
+                    if (candidate < 0 || candidate >= history.size()) {
+                        break;
+                    }
+                    if (!cache.contains(candidate)) {
+                        index = candidate;
+                        break;
+                    }
+                }
+            }
+            if (index == -1) {
+                running = false;
+                return;
+            }
+            view = history;
+            target = size;
+        }
+
+        HistoryView::Frame frame;
+        QImage image;
+        if (view.frameAt(index, frame)) {
+            image = toImage(frame.second.first, target);
+        }
+
+        QMutexLocker locker(&mutex);
+        // Trimmed frames are stored empty so they are not tried again, the
+        // caller falls back to converting them itself
+        if (target == size && inWindow(index)) {
+            cache.insert(index, image);
+        }
+    }
+}
+
+bool FramePrefetcher::inWindow(int index) const
+{
+    int offset = index - playhead;
+    if (stride > 0) {
+        return offset > 0 && offset <= stride * depth;
+    }
+    return offset < 0 && offset >= stride * depth;
+}
+
+void FramePrefetcher::evict()
+{
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (inWindow(it.key())) {
+            ++it;
+        } else {
+            it = cache.erase(it);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef FRAMEPREFETCHER_H
+#define FRAMEPREFETCHER_H
+
+#include <QFuture>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include "framehistory.h"
+
+// Converts and scales the frames ahead of the rewind playhead on the global
+// thread pool, so the GUI thread only has to put a ready image on screen.
+// Ahead means playhead + stride * 1..depth: the stride carries the playback
+// direction and the frames skipped at high speed.
+//
+// The cache only keeps that window, and only for one display size.
+class FramePrefetcher
+{
+public:
+    explicit FramePrefetcher(const HistoryView &history, int depth = 8);
+    ~FramePrefetcher();
+
+    // The view changed, e.g. live tail was switched on
+    void setHistory(const HistoryView &history);
+
+    // Playback is at index, start filling the window after it
+    void request(int index, int stride, const QSize &size);
+
+    // The image of index at size if it is ready, removed from the cache
+    bool take(int index, const QSize &size, QImage &image);
+
+    static QImage toImage(const cv::Mat &mat, const QSize &size);
+
+private:
+    QMutex mutex;
+    HistoryView history;
+    QHash<int, QImage> cache;
+    QSize size;
+    int playhead = 0;
+    int stride = 1;
+    int depth;
+    bool running = false;
+    bool stopping = false;
+    QFuture<void> future;
+
+    void run();
+    bool inWindow(int index) const;
+    void evict();
+};
+
+#endif // FRAMEPREFETCHER_H
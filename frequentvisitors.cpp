@@ -0,0 +1,56 @@
+#include "frequentvisitors.h"
+
+#include <QDialogButtonBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+FrequentVisitorsDialog::FrequentVisitorsDialog(QSqlDatabase db, QWidget *parent)
+    : QDialog(parent)
+{
+    setWindowTitle("Frequent Visitors");
+    resize(520, 600);
+
+    visitors = UnknownClusterer::frequentVisitors(db);
+
+    list = new QListWidget(this);
+    list->setIconSize(QSize(96, 96));
+    list->setSelectionMode(QAbstractItemView::SingleSelection);
+
+    for (const UnknownClusterer::Visitor &visitor : visitors) {
+        QString text = QString("%1 visits, %2 sightings\nCameras: %3\nFirst seen %4\nLast seen %5")
+                           .arg(visitor.visits)
+                           .arg(visitor.sightings)
+                           .arg(visitor.cameras.join(", "))
+                           .arg(visitor.firstSeen.toString("yyyy-MM-dd hh:mm"))
+                           .arg(visitor.lastSeen.toString("yyyy-MM-dd hh:mm"));
+        QListWidgetItem *item = new QListWidgetItem(QIcon(QPixmap::fromImage(visitor.chip)), text, list);
+        item->setSizeHint(QSize(0, 104));
+    }
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Cancel, this);
+    QPushButton *enrollButton = buttons->addButton("Enroll", QDialogButtonBox::AcceptRole);
+    enrollButton->setEnabled(false);
+    connect(list, &QListWidget::currentRowChanged, this, [enrollButton](int row) {
+        enrollButton->setEnabled(row >= 0);
+    });
+    connect(list, &QListWidget::itemDoubleClicked, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    if (visitors.isEmpty()) {
+        layout->addWidget(new QLabel("No unknown face has been seen often enough yet.", this));
+    }
+    layout->addWidget(list, 1);
+    layout->addWidget(buttons);
+}
+
+UnknownClusterer::Visitor FrequentVisitorsDialog::selectedVisitor() const
+{
+    int row = list->currentRow();
+    if (row < 0 || row >= visitors.size()) {
+        return UnknownClusterer::Visitor();
+    }
+    return visitors[row];
+}
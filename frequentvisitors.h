@@ -0,0 +1,28 @@
+#ifndef FREQUENTVISITORS_H
+#define FREQUENTVISITORS_H
+
+#include "unknownclusterer.h"
+
+#include <QDialog>
+#include <QListWidget>
+#include <QSqlDatabase>
+#include <QVector>
+
+// Lists the unrecognised faces that keep coming back, most visits first, so
+// one of them can be enrolled without hunting for a photo.
+class FrequentVisitorsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit FrequentVisitorsDialog(QSqlDatabase db, QWidget *parent = nullptr);
+
+    // Valid after accept()
+    UnknownClusterer::Visitor selectedVisitor() const;
+
+private:
+    QListWidget *list;
+    QVector<UnknownClusterer::Visitor> visitors;
+};
+
+#endif // FREQUENTVISITORS_H
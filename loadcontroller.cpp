@@ -0,0 +1,218 @@
+#include "loadcontroller.h"
+
+#include <QDebug>
+#include <QStringList>
+
+// Detection width and cadence, from full quality down to the cheapest step
+const LoadController::Settings LoadController::ladder[] = {
+    {640, 1}, {480, 1}, {480, 2}, {360, 2}, {360, 3}, {240, 4}, {240, 6}
+};
+const int LoadController::ladderSize = sizeof(ladder) / sizeof(ladder[0]);
+
+const char *LoadController::stageNames[StageCount] = {"capture", "resize", "motion", "detect", "embed"};
+
+namespace {
+
+const double smoothing = 0.1;       // EWMA weight of the newest sample
+const qint64 decisionIntervalMs = 1000;
+const double headroomFactor = 0.7;  // Below this share of both limits counts as headroom
+const int headroomDecisionsToRestore = 3;
+
+double ewma(double average, double sample)
+{
+    return average == 0.0 ? sample : average + smoothing * (sample - average);
+}
+
+} // namespace
+
+LoadController::LoadController(double cpuBudget, double latencyTargetMs)
+    : cpuBudget(cpuBudget), latencyTargetMs(latencyTargetMs)
+{
+}
+
+void LoadController::setLimits(double budget, double targetMs)
+{
+    if (budget == cpuBudget && targetMs == latencyTargetMs) {
+        return;
+    }
+    qDebug().noquote() << QString("LoadController: CPU budget %1, latency target %2 ms")
+                              .arg(budget, 0, 'f', 2)
+                              .arg(targetMs, 0, 'f', 0);
+    cpuBudget = budget;
+    latencyTargetMs = targetMs;
+
+    // Headroom counted against the old limits does not carry over
+    headroomDecisions = 0;
+    saturated = false;
+}
+
+void LoadController::setArmed(const QString &cameraName, bool armed)
+{
+    cameras[cameraName].armed = armed;
+}
+
+void LoadController::setFocusedCamera(const QString &cameraName)
+{
+    focusedCamera = cameraName;
+}
+
+void LoadController::removeCamera(const QString &cameraName)
+{
+    cameras.remove(cameraName);
+    if (focusedCamera == cameraName) {
+        focusedCamera.clear();
+    }
+}
+
+LoadController::Settings LoadController::settings(const QString &cameraName) const
+{
+    auto it = cameras.constFind(cameraName);
+    return ladder[it == cameras.constEnd() ? 0 : it->level];
+}
+
+bool LoadController::shouldDetect(const QString &cameraName)
+{
+    CameraLoad &camera = cameras[cameraName];
+    return camera.frame++ % ladder[camera.level].detectionCadence == 0;
+}
+
+void LoadController::record(const QString &cameraName, Stage stage, double milliseconds)
+{
+    CameraLoad &camera = cameras[cameraName];
+    camera.stageMs[stage] = ewma(camera.stageMs[stage], milliseconds);
+}
+
+double LoadController::stageLatency(const QString &cameraName, Stage stage) const
+{
+    auto it = cameras.constFind(cameraName);
+    return it == cameras.constEnd() ? 0.0 : it->stageMs[stage];
+}
+
+int LoadController::level(const QString &cameraName) const
+{
+    auto it = cameras.constFind(cameraName);
+    return it == cameras.constEnd() ? 0 : it->level;
+}
+
+int LoadController::priority(const QString &cameraName, const CameraLoad &camera) const
+{
+    return (camera.armed ? 1 : 0) + (cameraName == focusedCamera ? 2 : 0);
+}
+
+double LoadController::cameraCost(const CameraLoad &camera) const
+{
+    // Average cost per frame, the detection stages only run every Nth frame
+    double perFrame = camera.stageMs[Capture] + camera.stageMs[Resize];
+    double perDetection = camera.stageMs[Motion] + camera.stageMs[Detect] + camera.stageMs[Embed];
+    return perFrame + perDetection / ladder[camera.level].detectionCadence;
+}
+
+void LoadController::changeLevel(const QString &cameraName, CameraLoad &camera, int newLevel, const QString &reason)
+{
+    QStringList stages;
+    for (int stage = 0; stage < StageCount; ++stage) {
+        stages << QString("%1 %2").arg(stageNames[stage]).arg(camera.stageMs[stage], 0, 'f', 1);
+    }
+
+    qDebug().noquote() << QString("LoadController: %1 %2 from level %3 to %4 (%5 px, every %6 frame(s)): %7 [%8 ms]")
+                              .arg(newLevel > camera.level ? "degrading" : "restoring", cameraName)
+                              .arg(camera.level)
+                              .arg(newLevel)
+                              .arg(ladder[newLevel].detectionWidth)
+                              .arg(ladder[newLevel].detectionCadence)
+                              .arg(reason, stages.join(", "));
+
+    camera.level = newLevel;
+}
+
+void LoadController::endPass(double sampleMs)
+{
+    // Wall time between passes, includes the timer wait, so a pass that
+    // takes as long as the interval means the thread is saturated
+    if (passClock.isValid() && passClock.elapsed() > 0) {
+        busy = ewma(busy, sampleMs / passClock.elapsed());
+    }
+    passClock.start();
+    passMs = ewma(passMs, sampleMs);
+
+    if (!decisionClock.isValid()) {
+        decisionClock.start();
+        return;
+    }
+    if (decisionClock.elapsed() < decisionIntervalMs) {
+        return;
+    }
+    decisionClock.restart();
+
+    QString state = QString("pass %1 ms / target %2 ms, CPU %3 / budget %4")
+                        .arg(passMs, 0, 'f', 1)
+                        .arg(latencyTargetMs, 0, 'f', 0)
+                        .arg(busy, 0, 'f', 2)
+                        .arg(cpuBudget, 0, 'f', 2);
+
+    if (passMs > latencyTargetMs || busy > cpuBudget) {
+        headroomDecisions = 0;
+
+        // Least important camera first, the most expensive one among equals.
+        // Disarmed cameras do not run detection, there is nothing to trade.
+        QString victim;
+        int victimPriority = 0;
+        double victimCost = 0.0;
+        for (auto it = cameras.begin(); it != cameras.end(); ++it) {
+            if (!it->armed || it->level >= ladderSize - 1) {
+                continue;
+            }
+            int cameraPriority = priority(it.key(), *it);
+            double cost = cameraCost(*it);
+            if (victim.isEmpty() || cameraPriority < victimPriority || (cameraPriority == victimPriority && cost > victimCost)) {
+                victim = it.key();
+                victimPriority = cameraPriority;
+                victimCost = cost;
+            }
+        }
+
+        if (victim.isEmpty()) {
+            if (!saturated) {
+                qDebug().noquote() << "LoadController: over budget with every armed camera at the lowest step:" << state;
+                saturated = true;
+            }
+            return;
+        }
+
+        CameraLoad &camera = cameras[victim];
+        changeLevel(victim, camera, camera.level + 1, "over budget, " + state);
+    } else if (passMs < headroomFactor * latencyTargetMs && busy < headroomFactor * cpuBudget) {
+        saturated = false;
+
+        // Only restore after sustained headroom so a single quiet second does
+        // not bounce a camera between two steps
+        if (++headroomDecisions < headroomDecisionsToRestore) {
+            return;
+        }
+        headroomDecisions = 0;
+
+        QString favourite;
+        int favouritePriority = 0;
+        double favouriteCost = 0.0;
+        for (auto it = cameras.begin(); it != cameras.end(); ++it) {
+            if (it->level == 0) {
+                continue;
+            }
+            int cameraPriority = priority(it.key(), *it);
+            double cost = cameraCost(*it);
+            if (favourite.isEmpty() || cameraPriority > favouritePriority || (cameraPriority == favouritePriority && cost < favouriteCost)) {
+                favourite = it.key();
+                favouritePriority = cameraPriority;
+                favouriteCost = cost;
+            }
+        }
+
+        if (!favourite.isEmpty()) {
+            CameraLoad &camera = cameras[favourite];
+            changeLevel(favourite, camera, camera.level - 1, "headroom, " + state);
+        }
+    } else {
+        headroomDecisions = 0;
+        saturated = false;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef LOADCONTROLLER_H
+#define LOADCONTROLLER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+
+// Keeps the frame loop inside a CPU budget and a latency target by trading
+// detection resolution and cadence per camera. Display and recording keep
+// the operator's scale factor, only the detection plane is degraded.
+//
+// Every camera sits on a step of a fixed ladder (full detection width every
+// frame down to a small plane every few frames). When the loop is over
+// budget the least important camera steps down, when there is headroom for a
+// while the most important degraded camera steps back up. Armed and focused
+// cameras are degraded last and restored first. Every decision is logged.
+class LoadController
+{
+public:
+    enum Stage
+    {
+        Capture,
+        Resize,
+        Motion,
+        Detect,
+        Embed,
+        StageCount
+    };
+
+    struct Settings
+    {
+        int detectionWidth;     // Width of the detection plane in pixels
+        int detectionCadence;   // Run detection on every Nth frame
+    };
+
+    // cpuBudget is the share of one core the frame loop may use, latencyTarget
+    // the longest acceptable pass over all cameras
+    explicit LoadController(double cpuBudget = 0.7, double latencyTargetMs = 100.0);
+
+    // Takes effect at the next decision
+    void setLimits(double cpuBudget, double latencyTargetMs);
+
+    void setArmed(const QString &cameraName, bool armed);
+    void setFocusedCamera(const QString &cameraName);
+    void removeCamera(const QString &cameraName);
+
+    // Current detection settings for the camera, and whether this frame is
+    // one the camera should run detection on. Call once per frame.
+    Settings settings(const QString &cameraName) const;
+    bool shouldDetect(const QString &cameraName);
+
+    void record(const QString &cameraName, Stage stage, double milliseconds);
+
+    // Call once after every pass over all cameras
+    void endPass(double passMs);
+
+    double stageLatency(const QString &cameraName, Stage stage) const;
+    int level(const QString &cameraName) const;
+
+private:
+    struct CameraLoad
+    {
+        double stageMs[StageCount] = {};
+        int level = 0;
+        bool armed = false;
+        quint64 frame = 0;
+    };
+
+    static const Settings ladder[];
+    static const int ladderSize;
+    static const char *stageNames[StageCount];
+
+    double cpuBudget;
+    double latencyTargetMs;
+
+    QHash<QString, CameraLoad> cameras;
+    QString focusedCamera;
+
+    // Smoothed over passes
+    double passMs = 0.0;
+    double busy = 0.0;
+
+    QElapsedTimer passClock;
+    QElapsedTimer decisionClock;
+    int headroomDecisions = 0;
+    bool saturated = false;
+
+    int priority(const QString &cameraName, const CameraLoad &camera) const;
+    double cameraCost(const CameraLoad &camera) const;
+    void changeLevel(const QString &cameraName, CameraLoad &camera, int newLevel, const QString &reason);
+};
+
+#endif // LOADCONTROLLER_H
@@ -1,9 +1,84 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "faceindex.h"
+#include "facedetector.h"
+#include "sightingsindex.h"
+#include "dlib_utils.h"
+#include <QSqlDatabase>
+#include <opencv2/imgcodecs.hpp>
 
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv);
 
+    // Recall/latency check of the watchlist index against exact search
+    if (a.arguments().contains("--benchmark-face-index")) {
+        FaceIndex::benchmark(100000, 500, 10);
+        return 0;
+    }
+
+    // Head-to-head run of the face detector backends over recorded clips,
+    // e.g. --bench-detectors clips --bench-scale 0.3 to match the live path
+    int detectorsArg = a.arguments().indexOf("--bench-detectors");
+    if (detectorsArg >= 0 && detectorsArg + 1 < a.arguments().size()) {
+        double scale = 1.0;
+        int scaleArg = a.arguments().indexOf("--bench-scale");
+        if (scaleArg >= 0 && scaleArg + 1 < a.arguments().size()) {
+            scale = a.arguments().at(scaleArg + 1).toDouble();
+        }
+        FaceDetector::benchmark(a.arguments().at(detectorsArg + 1), scale > 0.0 ? scale : 1.0);
+        return 0;
+    }
+
+    // Latency and recall of the sightings index at a million rows
+    if (a.arguments().contains("--bench-sightings")) {
+        SightingsIndex::benchmark(1000000, 200);
+        return 0;
+    }
+
+    // Where was this person seen, e.g. --search-sightings photo.jpg or an
+    // enrolled face id, optionally limited with --search-days 7
+    int searchArg = a.arguments().indexOf("--search-sightings");
+    if (searchArg >= 0 && searchArg + 1 < a.arguments().size()) {
+        SightingsIndex::Query query;
+        int daysArg = a.arguments().indexOf("--search-days");
+        if (daysArg >= 0 && daysArg + 1 < a.arguments().size()) {
+            query.from = QDateTime::currentDateTime().addDays(-a.arguments().at(daysArg + 1).toInt());
+        }
+
+        // The app may be appending to the index meanwhile, search it as is
+        SightingsIndex index("sightings");
+        if (!index.open(SightingsIndex::ReadOnly)) {
+            return 1;
+        }
+
+        QString target = a.arguments().at(searchArg + 1);
+        QString error;
+        QVector<SightingsIndex::Sighting> results;
+        bool isId = false;
+        qint64 faceId = target.toLongLong(&isId);
+        if (isId) {
+            QSqlDatabase facesDb = QSqlDatabase::addDatabase("QSQLITE", "search_connection");
+            facesDb.setDatabaseName("faces.db");
+            facesDb.open();
+            results = index.searchIdentity(facesDb, faceId, query, &error);
+        } else {
+            initialize_network();
+            initialize_shape_predictor();
+            results = index.searchImage(cv::imread(target.toStdString()), query, &error);
+        }
+
+        if (!error.isEmpty()) {
+            qDebug() << "Search failed:" << error;
+            return 1;
+        }
+        for (const SightingsIndex::Sighting &sighting : results) {
+            qDebug().noquote() << sighting.seenAt.toString("yyyy-MM-dd hh:mm:ss") << sighting.cameraName
+                               << QString::number(sighting.distance, 'f', 3) << sighting.thumbnailPath;
+        }
+        qDebug() << results.size() << "sightings";
+        return 0;
+    }
+
     MainWindow w;
     w.show();
 
@@ -45,9 +45,12 @@ MainWindow::MainWindow(QWidget *parent) :
     cameraSettingsInstance = new CameraSettings(); // Create an instance of CameraSettings
     connect(cameraSettingsInstance, &CameraSettings::add_camera, this, &MainWindow::update_camera_buttons);
     connect(cameraSettingsInstance, &CameraSettings::delete_camera, this, &MainWindow::remove_camera_button);
+    connect(cameraSettingsInstance, &CameraSettings::settings_changed, this, &MainWindow::update_camera_settings);
+    connect(cameraSettingsInstance, &CameraSettings::storage_changed, this, &MainWindow::update_storage_targets);
 
     facesHandlerInstance = new faceshandler();
     connect(facesHandlerInstance, &faceshandler::add_face, this, &MainWindow::add_new_face);
+    connect(facesHandlerInstance, &faceshandler::add_faces, this, &MainWindow::add_new_faces);
     connect(facesHandlerInstance, &faceshandler::delete_face, this, &MainWindow::delete_face);
 
     // Setup the timer to update date and time
@@ -109,7 +112,18 @@ std::vector<std::pair<QString, QString>> MainWindow::getAllCameras()
                                       "port TEXT, "
                                       "ip_address TEXT, "
                                       "username TEXT, "
-                                      "password TEXT)";
+                                      "password TEXT, "
+                                      "detection_roi TEXT, "
+                                      "exclusion_mask TEXT, "
+                                      "detector_backend TEXT, "
+                                      "quality_threshold REAL, "
+                                      "object_cadence INTEGER, "
+                                      "pre_roll REAL, "
+                                      "post_roll REAL, "
+                                      "min_duration REAL, "
+                                      "merge_gap REAL, "
+                                      "cooldown REAL, "
+                                      "continuous_recording INTEGER)";
         QSqlQuery createTableQuery(createTableQueryStr);
         if (!createTableQuery.exec()) {
             qDebug() << "Failed to create table:" << createTableQuery.lastError().text();
@@ -147,7 +161,18 @@ std::vector<std::pair<QString, QString>> MainWindow::getAllCameras()
                                           "port TEXT, "
                                           "ip_address TEXT, "
                                           "username TEXT, "
-                                          "password TEXT)";
+                                          "password TEXT, "
+                                          "detection_roi TEXT, "
+                                          "exclusion_mask TEXT, "
+                                          "detector_backend TEXT, "
+                                          "quality_threshold REAL, "
+                                          "object_cadence INTEGER, "
+                                          "pre_roll REAL, "
+                                          "post_roll REAL, "
+                                          "min_duration REAL, "
+                                          "merge_gap REAL, "
+                                          "cooldown REAL, "
+                                          "continuous_recording INTEGER)";
             QSqlQuery createTableQuery(createTableQueryStr);
             if (!createTableQuery.exec()) {
                 qDebug() << "Failed to create table:" << createTableQuery.lastError().text();
@@ -155,6 +180,28 @@ std::vector<std::pair<QString, QString>> MainWindow::getAllCameras()
                 return cameras;
             }
         }
+        else {
+            // Older databases predate the per-camera settings columns
+            const QStringList settingsColumns = {"detection_roi TEXT", "exclusion_mask TEXT", "detector_backend TEXT", "quality_threshold REAL", "object_cadence INTEGER",
+                                                 "pre_roll REAL", "post_roll REAL", "min_duration REAL", "merge_gap REAL", "cooldown REAL",
+                                                 "continuous_recording INTEGER"};
+
+            QStringList existingColumns;
+            QSqlQuery columnsQuery("PRAGMA table_info(cameradetails)");
+            while (columnsQuery.next()) {
+                existingColumns << columnsQuery.value(1).toString();
+            }
+
+            for (const QString &column : settingsColumns) {
+                if (existingColumns.contains(column.section(' ', 0, 0))) {
+                    continue;
+                }
+                QSqlQuery alterQuery;
+                if (!alterQuery.exec("ALTER TABLE cameradetails ADD COLUMN " + column)) {
+                    qDebug() << "Failed to add column" << column << ":" << alterQuery.lastError().text();
+                }
+            }
+        }
 
         db.close();
     }
@@ -333,14 +380,33 @@ void MainWindow::on_settings_button_clicked()
     }
 }
 
-void MainWindow::add_new_face(dlib::matrix<float, 0, 1> face_encoding)
+void MainWindow::update_camera_settings(const QString &cameraName)
+{
+    if (cameraScreens) {
+        cameraScreens->reloadCameraSettings(cameraName);
+    }
+}
+
+void MainWindow::update_storage_targets()
+{
+    if (cameraScreens) {
+        cameraScreens->reloadStorageTargets();
+    }
+}
+
+void MainWindow::add_new_face(qint64 id, const dlib::matrix<float, 0, 1> &face_encoding)
+{
+    emit cameraScreens->add_new_face(id, face_encoding);
+}
+
+void MainWindow::add_new_faces(const QVector<FaceGallery::Entry> &faces)
 {
-    emit cameraScreens->add_new_face(face_encoding);
+    emit cameraScreens->add_new_faces(faces);
 }
 
-void MainWindow::delete_face(int num)
+void MainWindow::delete_face(qint64 id)
 {
-    emit cameraScreens->delete_face(num);
+    emit cameraScreens->delete_face(id);
 }
 
 void MainWindow::hide_close_button(int tabIndex)
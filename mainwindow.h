@@ -56,9 +56,15 @@ private slots:
 
     void on_settings_button_clicked();
 
-    void add_new_face(dlib::matrix<float, 0, 1> face_encoding);
+    void add_new_face(qint64 id, const dlib::matrix<float, 0, 1> &face_encoding);
 
-    void delete_face(int num);
+    void add_new_faces(const QVector<FaceGallery::Entry> &faces);
+
+    void delete_face(qint64 id);
+
+    void update_camera_settings(const QString &cameraName);
+
+    void update_storage_targets();
 
     void hide_close_button(int tabIndex);
 
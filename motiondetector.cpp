@@ -0,0 +1,106 @@
+#include "motiondetector.h"
+
+MotionDetector::MotionDetector(int analysisWidth, double learningRate, int pixelThreshold, double motionThreshold)
+    : analysisWidth(analysisWidth), learningRate(learningRate), pixelThreshold(pixelThreshold), motionThreshold(motionThreshold)
+{
+    kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+}
+
+void MotionDetector::reset()
+{
+    background.release();
+    framesSinceMotion = 0;
+    score = 0.0;
+    lastRegions.clear();
+}
+
+MotionDetector::Result MotionDetector::update(const cv::Mat &frame, const cv::Mat &mask)
+{
+    Result result;
+    if (frame.empty()) {
+        return result;
+    }
+
+    // Downsample before converting so the colour conversion touches only the
+    // small plane. Every step below is a vectorised OpenCV primitive.
+    double scale = static_cast<double>(analysisWidth) / frame.cols;
+    if (scale < 1.0) {
+        cv::resize(frame, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    } else {
+        scale = 1.0;
+        small = frame;
+    }
+
+    if (small.channels() == 3) {
+        cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = small;
+    }
+
+    if (background.empty() || background.size() != gray.size()) {
+        gray.convertTo(background, CV_32F);
+        return result;
+    }
+
+    background.convertTo(backgroundU8, CV_8U);
+    cv::absdiff(gray, backgroundU8, difference);
+    cv::threshold(difference, difference, pixelThreshold, 255, cv::THRESH_BINARY);
+    if (!mask.empty()) {
+        cv::resize(mask, smallMask, difference.size(), 0, 0, cv::INTER_NEAREST);
+        cv::bitwise_and(difference, smallMask, difference);
+    }
+    cv::accumulateWeighted(gray, background, learningRate);
+
+    score = static_cast<double>(cv::countNonZero(difference)) / difference.total();
+    result.score = score;
+
+    if (score >= motionThreshold) {
+        cv::dilate(difference, difference, kernel, cv::Point(-1, -1), 2);
+
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(difference, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+        lastRegions.clear();
+        cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+        for (const auto &contour : contours) {
+            cv::Rect box = cv::boundingRect(contour);
+            if (box.area() < 4) {
+                continue; // Sensor noise that survived the threshold
+            }
+
+            // Back to frame coordinates, padded so a moving head keeps its face
+            int padX = box.width / 2 + 2;
+            int padY = box.height / 2 + 2;
+            cv::Rect mapped(cvFloor((box.x - padX) / scale), cvFloor((box.y - padY) / scale),
+                            cvCeil((box.width + 2 * padX) / scale), cvCeil((box.height + 2 * padY) / scale));
+            lastRegions.push_back(mapped & frameRect);
+        }
+
+        // Merge overlapping regions so a face split across blobs is scanned once
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t i = 0; i < lastRegions.size() && !merged; ++i) {
+                for (size_t j = i + 1; j < lastRegions.size(); ++j) {
+                    if ((lastRegions[i] & lastRegions[j]).area() > 0) {
+                        lastRegions[i] |= lastRegions[j];
+                        lastRegions.erase(lastRegions.begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        framesSinceMotion = 0;
+    } else {
+        ++framesSinceMotion;
+    }
+
+    result.motion = !lastRegions.empty() && framesSinceMotion <= hangoverFrames;
+    if (result.motion) {
+        result.regions = lastRegions;
+    }
+
+    return result;
+}
@@ -0,0 +1,52 @@
+#ifndef MOTIONDETECTOR_H
+#define MOTIONDETECTOR_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Cheap per-camera motion detector. Keeps a running-average background of a
+// heavily downsampled gray plane and reports how much of it changed, plus
+// the changed areas mapped back to the input frame.
+class MotionDetector
+{
+public:
+    struct Result
+    {
+        double score = 0.0;             // Fraction of changed pixels, 0..1
+        bool motion = false;            // Score above threshold, or still in hangover
+        std::vector<cv::Rect> regions;  // In input frame coordinates
+    };
+
+    explicit MotionDetector(int analysisWidth = 160, double learningRate = 0.05,
+                            int pixelThreshold = 25, double motionThreshold = 0.002);
+
+    // mask (optional, frame sized, 8-bit) zeroes out areas that never count
+    Result update(const cv::Mat &frame, const cv::Mat &mask = cv::Mat());
+    void reset();
+
+    double lastScore() const { return score; }
+
+private:
+    int analysisWidth;
+    double learningRate;
+    int pixelThreshold;
+    double motionThreshold;
+
+    // Keep detection running for a few frames after motion stops, so slow
+    // movers are not dropped between two almost identical frames
+    int hangoverFrames = 15;
+    int framesSinceMotion = 0;
+
+    double score = 0.0;
+    std::vector<cv::Rect> lastRegions;
+
+    cv::Mat small;
+    cv::Mat gray;
+    cv::Mat background; // CV_32F
+    cv::Mat backgroundU8;
+    cv::Mat difference;
+    cv::Mat smallMask;
+    cv::Mat kernel;
+};
+
+#endif // MOTIONDETECTOR_H
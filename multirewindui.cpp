@@ -0,0 +1,333 @@
+#include "multirewindui.h"
+
+#include <QDebug>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QGridLayout>
+#include <QGroupBox>
+#include <QHBoxLayout>
+#include <QListWidget>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <cmath>
+
+MultiRewindUi::MultiRewindUi(const QVector<QPair<QString, HistoryView>> &histories, QWidget *parent)
+    : QWidget(parent)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+
+    QHBoxLayout *topRow = new QHBoxLayout;
+    date = new QComboBox(this);
+    gotoTime = new QTimeEdit(this);
+    gotoTime->setDisplayFormat("HH:mm:ss");
+    gotoTimeButton = new QPushButton("Go to Time", this);
+    topRow->addWidget(new QLabel("Date", this));
+    topRow->addWidget(date);
+    topRow->addStretch();
+    topRow->addWidget(gotoTime);
+    topRow->addWidget(gotoTimeButton);
+    layout->addLayout(topRow);
+
+    // Square-ish grid, one box per camera
+    QGridLayout *grid = new QGridLayout;
+    int columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(histories.size())))));
+    for (int i = 0; i < histories.size(); ++i) {
+        Stream stream;
+        stream.cameraName = histories[i].first;
+        stream.history = histories[i].second;
+        stream.prefetcher = new FramePrefetcher(stream.history);
+
+        QGroupBox *box = new QGroupBox(stream.cameraName, this);
+        QVBoxLayout *boxLayout = new QVBoxLayout(box);
+        stream.display = new QLabel(box);
+        stream.display->setAlignment(Qt::AlignCenter);
+        stream.display->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+        stream.display->setMinimumSize(160, 90);
+        boxLayout->addWidget(stream.display);
+        grid->addWidget(box, i / columns, i % columns);
+
+        streams.append(stream);
+    }
+    layout->addLayout(grid, 1);
+
+    QHBoxLayout *sliderRow = new QHBoxLayout;
+    slider = new QSlider(Qt::Horizontal, this);
+    clockLabel = new QLabel(this);
+    sliderRow->addWidget(slider);
+    sliderRow->addWidget(clockLabel);
+    layout->addLayout(sliderRow);
+
+    QHBoxLayout *controls = new QHBoxLayout;
+    playButton = new QPushButton(this);
+    pauseButton = new QPushButton(this);
+    playButton->setIcon(QIcon("Icons/play.png"));
+    pauseButton->setIcon(QIcon("Icons/pause.png"));
+    speed = new QComboBox(this);
+    const QList<double> speeds = {0.25, 0.5, 1, 2, 4, 8, 16, 32};
+    for (double value : speeds) {
+        speed->addItem(QString("%1x").arg(value), value);
+    }
+    speed->setCurrentIndex(speed->findData(1.0));
+    reverse = new QCheckBox("Reverse", this);
+    controls->addStretch();
+    controls->addWidget(playButton);
+    controls->addWidget(pauseButton);
+    controls->addWidget(speed);
+    controls->addWidget(reverse);
+    controls->addStretch();
+    layout->addLayout(controls);
+
+    playbackTimer = new QTimer(this);
+    connect(playbackTimer, &QTimer::timeout, this, &MultiRewindUi::updateFrame);
+    connect(date, &QComboBox::currentIndexChanged, this, &MultiRewindUi::onDateChanged);
+    connect(slider, &QSlider::valueChanged, this, &MultiRewindUi::onSliderValueChanged);
+    connect(playButton, &QPushButton::clicked, this, &MultiRewindUi::onPlayClicked);
+    connect(pauseButton, &QPushButton::clicked, this, &MultiRewindUi::onPauseClicked);
+    connect(gotoTimeButton, &QPushButton::clicked, this, &MultiRewindUi::onGotoTimeClicked);
+    connect(speed, &QComboBox::currentIndexChanged, this, &MultiRewindUi::onSpeedChanged);
+
+    setControlsEnabled(false);
+
+    // Every day any of the cameras has frames for
+    QList<QDate> days;
+    for (const Stream &stream : streams) {
+        days.append(stream.history.days());
+    }
+    std::sort(days.begin(), days.end());
+    days.erase(std::unique(days.begin(), days.end()), days.end());
+    for (const QDate &day : days) {
+        date->addItem(day.toString(Qt::ISODate), QVariant(day));
+    }
+}
+
+MultiRewindUi::~MultiRewindUi()
+{
+    qDebug() << "Multi rewind UI deleted";
+    playbackTimer->stop();
+    for (Stream &stream : streams) {
+        delete stream.prefetcher;
+    }
+}
+
+QStringList MultiRewindUi::chooseCameras(const QStringList &cameras, QWidget *parent)
+{
+    QDialog dialog(parent);
+    dialog.setWindowTitle("Rewind Cameras Together");
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+
+    QListWidget *list = new QListWidget(&dialog);
+    for (const QString &camera : cameras) {
+        QListWidgetItem *item = new QListWidgetItem(camera, list);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(Qt::Unchecked);
+    }
+    layout->addWidget(list);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    QStringList chosen;
+    if (dialog.exec() != QDialog::Accepted) {
+        return chosen;
+    }
+    for (int i = 0; i < list->count(); ++i) {
+        if (list->item(i)->checkState() == Qt::Checked) {
+            chosen.append(list->item(i)->text());
+        }
+    }
+    return chosen;
+}
+
+void MultiRewindUi::onDateChanged(int index)
+{
+    onPauseClicked();
+    if (index < 0) {
+        setControlsEnabled(false);
+        return;
+    }
+
+    // The shared timeline spans the day from the earliest to the latest
+    // frame of any camera
+    QDate day = date->itemData(index).toDate();
+    dayStart = QDateTime();
+    dayEnd = QDateTime();
+    for (const Stream &stream : streams) {
+        QPair<int, int> range = stream.history.dayRange(day);
+        if (range.first == -1) {
+            continue;
+        }
+        QDateTime first = stream.history.timestamp(range.first);
+        QDateTime last = stream.history.timestamp(range.second);
+        if (first.isValid() && (!dayStart.isValid() || first < dayStart)) {
+            dayStart = first;
+        }
+        if (last.isValid() && (!dayEnd.isValid() || last > dayEnd)) {
+            dayEnd = last;
+        }
+    }
+    if (!dayStart.isValid() || !dayEnd.isValid()) {
+        setControlsEnabled(false);
+        return;
+    }
+
+    clock = dayStart;
+    slider->blockSignals(true);
+    slider->setRange(0, static_cast<int>(dayStart.secsTo(dayEnd)));
+    slider->setValue(0);
+    slider->blockSignals(false);
+    setControlsEnabled(true);
+    showClock();
+}
+
+void MultiRewindUi::onSliderValueChanged(int value)
+{
+    // Playback and seeking move the slider with signals blocked, this is
+    // the user dragging it
+    clock = dayStart.addSecs(value);
+    showClock();
+}
+
+void MultiRewindUi::onPlayClicked()
+{
+    if (!clock.isValid()) {
+        return;
+    }
+    isPlaying = true;
+    playClock.start();
+    playbackTimer->start(33);
+}
+
+void MultiRewindUi::onPauseClicked()
+{
+    isPlaying = false;
+    playbackTimer->stop();
+}
+
+void MultiRewindUi::onGotoTimeClicked()
+{
+    if (!dayStart.isValid()) {
+        return;
+    }
+    QDateTime target(dayStart.date(), gotoTime->time());
+    clock = std::clamp(target, dayStart, dayEnd);
+    showClock();
+}
+
+void MultiRewindUi::onSpeedChanged(int index)
+{
+    if (index >= 0) {
+        playbackSpeed = speed->itemData(index).toDouble();
+    }
+}
+
+void MultiRewindUi::updateFrame()
+{
+    if (!isPlaying) {
+        playbackTimer->stop();
+        return;
+    }
+
+    // Wall time drives the clock, a tick that ran late moves it further
+    qint64 elapsed = playClock.restart();
+    qint64 step = std::llround(elapsed * playbackSpeed);
+    clock = clock.addMSecs(reverse->isChecked() ? -step : step);
+
+    bool finished = false;
+    if (clock >= dayEnd) {
+        clock = dayEnd;
+        finished = true;
+    } else if (clock <= dayStart) {
+        clock = dayStart;
+        finished = true;
+    }
+
+    showClock();
+
+    if (finished) {
+        onPauseClicked();
+    }
+}
+
+int MultiRewindUi::frameIndexAt(const Stream &stream, const QDateTime &time) const
+{
+    // Last frame at or before the clock, none when the camera has a gap there
+    int index = stream.history.indexAt(time);
+    if (index < 0) {
+        return -1;
+    }
+    QDateTime frameTime = stream.history.timestamp(index);
+    if (frameTime.isValid() && frameTime > time) {
+        --index;
+        frameTime = stream.history.timestamp(index);
+    }
+    if (!frameTime.isValid() || frameTime > time || frameTime.msecsTo(time) > maxGapMs) {
+        return -1;
+    }
+    return index;
+}
+
+void MultiRewindUi::showClock()
+{
+    clockLabel->setText(clock.time().toString("hh:mm:ss"));
+    slider->blockSignals(true);
+    slider->setValue(static_cast<int>(dayStart.secsTo(clock)));
+    slider->blockSignals(false);
+
+    QElapsedTimer budget;
+    budget.start();
+
+    for (int k = 0; k < streams.size(); ++k) {
+        Stream &stream = streams[(firstStream + k) % streams.size()];
+        int index = frameIndexAt(stream, clock);
+        if (index == stream.shown) {
+            continue;
+        }
+
+        if (index == -1) {
+            stream.display->clear();
+            stream.display->setText("No footage");
+            stream.shown = -1;
+            continue;
+        }
+
+        QSize size = stream.display->size();
+        QImage image;
+        if (!stream.prefetcher->take(index, size, image)) {
+            // Not prefetched: convert it here, unless playing and the tick is
+            // already spent, then the stream drops this frame
+            if (isPlaying && budget.elapsed() > frameBudgetMs) {
+                continue;
+            }
+            HistoryView::Frame frame;
+            if (stream.history.frameAt(index, frame)) {
+                image = FramePrefetcher::toImage(frame.second.first, size);
+            }
+        }
+        if (!image.isNull()) {
+            stream.display->setPixmap(QPixmap::fromImage(image));
+        }
+        stream.shown = index;
+
+        if (isPlaying) {
+            // Frames the clock moves past per tick at this stream's own rate
+            int perSecond = std::max(1, index - std::max(0, stream.history.indexAt(clock.addSecs(-1))));
+            int stride = std::max(1, static_cast<int>(std::lround(playbackSpeed * perSecond * playbackTimer->interval() / 1000.0)));
+            stream.prefetcher->request(index, reverse->isChecked() ? -stride : stride, size);
+        }
+    }
+
+    if (!streams.isEmpty()) {
+        firstStream = (firstStream + 1) % streams.size();
+    }
+}
+
+void MultiRewindUi::setControlsEnabled(bool enabled)
+{
+    slider->setEnabled(enabled);
+    playButton->setEnabled(enabled);
+    pauseButton->setEnabled(enabled);
+    gotoTime->setEnabled(enabled);
+    gotoTimeButton->setEnabled(enabled);
+}
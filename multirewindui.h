@@ -0,0 +1,86 @@
+#ifndef MULTIREWINDUI_H
+#define MULTIREWINDUI_H
+
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QLabel>
+#include <QPushButton>
+#include <QSlider>
+#include <QTimeEdit>
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+#include "framehistory.h"
+#include "frameprefetcher.h"
+
+// Rewinds several cameras side by side against one clock. Every stream shows
+// its last frame captured at or before the clock, so streams line up by
+// capture time whatever their frame rates and gaps.
+//
+// The clock runs on wall time times the speed and never waits for a stream.
+// Frames come from each stream's prefetcher; a stream whose frame is not
+// ready once the tick's budget is spent keeps its old frame and catches up
+// on a later tick.
+class MultiRewindUi : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit MultiRewindUi(const QVector<QPair<QString, HistoryView>> &histories, QWidget *parent = nullptr);
+    ~MultiRewindUi();
+
+    // Lets the user tick the cameras to rewind together, empty if cancelled
+    static QStringList chooseCameras(const QStringList &cameras, QWidget *parent = nullptr);
+
+private slots:
+    void onDateChanged(int index);
+    void onSliderValueChanged(int value);
+    void onPlayClicked();
+    void onPauseClicked();
+    void onGotoTimeClicked();
+    void onSpeedChanged(int index);
+    void updateFrame();
+
+private:
+    struct Stream
+    {
+        QString cameraName;
+        HistoryView history;
+        FramePrefetcher *prefetcher = nullptr;
+        QLabel *display = nullptr;
+        int shown = -1;
+    };
+
+    QVector<Stream> streams;
+    int firstStream = 0;  // Rotates so a slow stream is not always served last
+
+    QComboBox *date;
+    QTimeEdit *gotoTime;
+    QPushButton *gotoTimeButton;
+    QSlider *slider;
+    QLabel *clockLabel;
+    QPushButton *playButton;
+    QPushButton *pauseButton;
+    QComboBox *speed;
+    QCheckBox *reverse;
+
+    QTimer *playbackTimer;
+    QElapsedTimer playClock;
+    bool isPlaying = false;
+    double playbackSpeed = 1.0;
+
+    QDateTime clock;
+    QDateTime dayStart;
+    QDateTime dayEnd;
+
+    static const int frameBudgetMs = 20;
+    static const int maxGapMs = 2000;
+
+    int frameIndexAt(const Stream &stream, const QDateTime &time) const;
+    void showClock();
+    void setControlsEnabled(bool enabled);
+};
+
+#endif // MULTIREWINDUI_H
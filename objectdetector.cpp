@@ -0,0 +1,118 @@
+#include "objectdetector.h"
+
+#include <QDebug>
+#include <QFile>
+
+namespace {
+
+// COCO label ids of the SSD graph for the classes that matter to a camera,
+// everything else (chairs, plants, ...) is ignored
+bool categoryForClass(int classId, ObjectDetector::Category &category)
+{
+    switch (classId) {
+    case 1:  // person
+        category = ObjectDetector::Person;
+        return true;
+    case 2:  // bicycle
+    case 3:  // car
+    case 4:  // motorcycle
+    case 6:  // bus
+    case 8:  // truck
+        category = ObjectDetector::Vehicle;
+        return true;
+    case 27: // backpack
+    case 31: // handbag
+    case 33: // suitcase
+        category = ObjectDetector::Package;
+        return true;
+    default:
+        return false;
+    }
+}
+
+}
+
+ObjectDetector::ObjectDetector(const std::string &modelPath, const std::string &configPath)
+{
+    if (!QFile::exists(QString::fromStdString(modelPath)) || !QFile::exists(QString::fromStdString(configPath))) {
+        qDebug() << "Object detector model not found:" << QString::fromStdString(modelPath);
+        return;
+    }
+
+    try {
+        net = cv::dnn::readNetFromTensorflow(modelPath, configPath);
+        net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        loaded = !net.empty();
+    } catch (const cv::Exception &e) {
+        qDebug() << "Could not load the object detector:" << e.what();
+    }
+}
+
+std::vector<std::vector<ObjectDetector::Detection>> ObjectDetector::detect(const std::vector<cv::Mat> &frames, float minConfidence)
+{
+    std::vector<std::vector<Detection>> results(frames.size());
+    if (!loaded || frames.empty()) {
+        return results;
+    }
+
+    std::vector<cv::Mat> batch;
+    std::vector<int> batchIndex;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (!frames[i].empty() && frames[i].channels() == 3) {
+            batch.push_back(frames[i]);
+            batchIndex.push_back(static_cast<int>(i));
+        }
+    }
+    if (batch.empty()) {
+        return results;
+    }
+
+    // One NCHW blob for all cameras, a single forward pass amortises the
+    // per-call overhead of the network
+    cv::Mat blob = cv::dnn::blobFromImages(batch, 1.0, cv::Size(inputSize, inputSize), cv::Scalar(), true, false);
+    cv::Mat output;
+    try {
+        net.setInput(blob);
+        output = net.forward();
+    } catch (const cv::Exception &e) {
+        qDebug() << "Object detection failed:" << e.what();
+        return results;
+    }
+
+    // DetectionOutput is 1 x 1 x N x 7: image, class, confidence, then the
+    // box as fractions of the image
+    cv::Mat detections(output.size[2], output.size[3], CV_32F, output.ptr<float>());
+    for (int row = 0; row < detections.rows; ++row) {
+        const float *values = detections.ptr<float>(row);
+        int image = static_cast<int>(values[0]);
+        float confidence = values[2];
+        Category category;
+        if (image < 0 || image >= static_cast<int>(batch.size()) || confidence < minConfidence
+            || !categoryForClass(static_cast<int>(values[1]), category)) {
+            continue;
+        }
+
+        const cv::Mat &frame = batch[image];
+        cv::Rect box(cv::Point(cvRound(values[3] * frame.cols), cvRound(values[4] * frame.rows)),
+                     cv::Point(cvRound(values[5] * frame.cols), cvRound(values[6] * frame.rows)));
+        box &= cv::Rect(0, 0, frame.cols, frame.rows);
+        if (box.area() > 0) {
+            results[batchIndex[image]].push_back({category, confidence, box});
+        }
+    }
+    return results;
+}
+
+QString ObjectDetector::categoryName(Category category)
+{
+    switch (category) {
+    case Person:
+        return "Person";
+    case Vehicle:
+        return "Vehicle";
+    case Package:
+        return "Package";
+    }
+    return QString();
+}
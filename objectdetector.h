@@ -0,0 +1,51 @@
+#ifndef OBJECTDETECTOR_H
+#define OBJECTDETECTOR_H
+
+#include <QString>
+#include <opencv2/dnn.hpp>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// People, vehicles and bags with a MobileNet-SSD (COCO) through cv::dnn on
+// the OpenCV CPU backend. Catches what the face detectors cannot: people
+// facing away, cars, parcels left at the door.
+//
+// detect() takes the frames of several cameras and runs them through the
+// network as one batch. Not thread-safe, one call at a time.
+class ObjectDetector
+{
+public:
+    enum Category
+    {
+        Person,
+        Vehicle,
+        Package
+    };
+
+    struct Detection
+    {
+        Category category;
+        float confidence;
+        cv::Rect box; // In the coordinates of the frame it came from
+    };
+
+    explicit ObjectDetector(const std::string &modelPath = "ssd_mobilenet_v2_coco.pb",
+                            const std::string &configPath = "ssd_mobilenet_v2_coco.pbtxt");
+
+    bool isLoaded() const { return loaded; }
+
+    // One result list per frame, in order
+    std::vector<std::vector<Detection>> detect(const std::vector<cv::Mat> &frames, float minConfidence = 0.5f);
+
+    static QString categoryName(Category category);
+
+    // Network input, frames are resized to this square
+    static const int inputSize = 300;
+
+private:
+    cv::dnn::Net net;
+    bool loaded = false;
+};
+
+#endif // OBJECTDETECTOR_H
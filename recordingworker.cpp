@@ -1,72 +1,153 @@
 #include "recordingworker.h"
+#include "clipmuxer.h"
+#include "storagemanager.h"
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
 
 using namespace cv;
 
+const QString RecordingWorker::eventKind = "event";
+
 RecordingWorker::RecordingWorker() {
 
 }
 
-void RecordingWorker::recordvideo(int startFrameindex, int endFrameindex, const QString &cameraname, const QVector<QPair<QDate, QPair<Mat, QTime>>>& frameBuffer, QSqlDatabase db)
+void RecordingWorker::setEventFaces(const QVector<QImage> &faces)
 {
-    // Check if the frame indexes are valid
-    if (startFrameindex < 0 || endFrameindex >= frameBuffer.size() || startFrameindex > endFrameindex) {
-        qDebug() << "Invalid frame indexes for recording.";
-        return;
-    }
-
-    // // Create the directory for the camera if it doesn't exist
-    // QString cameraDirPath = "Recordings/" + cameraname;
-    // QDir cameraDir(cameraDirPath);
+    eventFaces = faces.mid(0, maxEventFaces);
+}
 
-    // if (!cameraDir.exists())
-    // {
-    //     if (!cameraDir.mkpath(cameraname)) {
-    //         qDebug() << "Error: Failed to create directory for camera: " << cameraname;
-    //         return;
-    //     }
-    // }
+void RecordingWorker::setStorage(StorageManager *storage)
+{
+    this->storage = storage;
+}
 
-    // Create VideoWriter object
-    QString fileName = QString("%1_%2_%3_%4.mp4")
+void RecordingWorker::startClip(const QString &cameraname, const QDateTime &start)
+{
+    // Named after the start until the end is known, a clip recovered after
+    // a crash keeps this name
+    QString fileName = QString("%1_%2_%3.mp4")
                            .arg(cameraname)
-                           .arg(frameBuffer[startFrameindex].first.toString().replace(" ", "_"))
-                           .arg(frameBuffer[startFrameindex].second.second.toString("hhmmss"))
-                           .arg(frameBuffer[endFrameindex].second.second.toString("hhmmss"));
+                           .arg(start.date().toString().replace(" ", "_"))
+                           .arg(start.time().toString("hhmmss"));
+
+    // The events pool falls back to events_root itself, only a worker
+    // without a storage manager writes to the working folder
+    QString folder = storage ? storage->targetFor(StorageManager::eventsPool, cameraname) : QString();
+    if (folder.isEmpty()) {
+        folder = ".";
+    }
+
+    clipCamera = cameraname;
+    clipPath = folder + "/" + fileName;
+    clipWriteMs = 0;
+    clip = std::make_shared<ClipMuxer>(clipPath);
+    clip->setRecoveryInfo(eventKind, cameraname);
+}
 
-    QString filePath = "C:/FYPPublish/FYPPublish/wwwroot/Anomaly/" + fileName;
+void RecordingWorker::addFrames(const QVector<Frame> &frames)
+{
+    if (!clip) {
+        return;
+    }
+
+    QElapsedTimer writeTimer;
+    writeTimer.start();
+    for (const Frame &frame : frames) {
+        if (!clip->add(QDateTime(frame.first, frame.second.second), frame.second.first)) {
+            qDebug() << "Error staging the event clip of" << clipCamera;
+            break;
+        }
+    }
+    clipWriteMs += writeTimer.elapsed();
+}
 
-    VideoWriter videoWriter(filePath.toStdString(), VideoWriter::fourcc('a', 'v', 'c', '1'), 30, frameBuffer[startFrameindex].second.first.size());
+void RecordingWorker::finishClip(const QDateTime &end, const QString &databasePath)
+{
+    std::shared_ptr<ClipMuxer> muxer = std::move(clip);
+    if (!muxer) {
+        return;
+    }
+    if (muxer->isEmpty()) {
+        qDebug() << "No frames left for the event on" << clipCamera;
+        return;
+    }
 
-    // Check if VideoWriter is opened successfully
-    if (!videoWriter.isOpened()) {
-        qDebug() << "Error opening VideoWriter for recording:" << filePath;
+    // Frames at their capture times, the clip lasts as long as the event
+    QElapsedTimer writeTimer;
+    writeTimer.start();
+    muxer->setEnd(end);
+    QDateTime first = muxer->firstTime();
+    QDateTime last = muxer->lastTime();
+    if (!muxer->finish()) {
+        qDebug() << "Error writing recording:" << clipPath;
+        if (storage) {
+            storage->recordWrite(clipCamera, clipPath, 0, 0, clipWriteMs + writeTimer.elapsed(), false);
+        }
         return;
     }
 
-    // Write frames to the video file
-    for (int i = startFrameindex; i <= endFrameindex; ++i) {
-        videoWriter.write(frameBuffer[i].second.first);
+    // Now that the end is known the clip gets the name of its time range
+    QString filePath = clipPath.left(clipPath.lastIndexOf('.')) + "_" + last.time().toString("hhmmss") + ".mp4";
+    if (!QFile::rename(clipPath, filePath)) {
+        qDebug() << "Error renaming" << clipPath << "to" << filePath;
+        filePath = clipPath;
+    }
+    qint64 writtenBytes = QFileInfo(filePath).size();
+
+    // Best face chips of the event, next to the clip
+    QString bestFacePath;
+    QString faceBasePath = filePath.left(filePath.lastIndexOf('.'));
+    for (int i = 0; i < eventFaces.size(); ++i) {
+        QString facePath = QString("%1_face%2.jpg").arg(faceBasePath).arg(i + 1);
+        if (!eventFaces[i].save(facePath, "JPG", 95)) {
+            qDebug() << "Error saving event face:" << facePath;
+            continue;
+        }
+        if (bestFacePath.isEmpty()) {
+            bestFacePath = facePath;
+        }
+        writtenBytes += QFileInfo(facePath).size();
+    }
+    if (storage) {
+        storage->recordWrite(clipCamera, filePath, writtenBytes, muxer->wallClockMs(), clipWriteMs + writeTimer.elapsed(), true);
     }
 
-    // Release VideoWriter resources
-    videoWriter.release();
+    // SQLite connections belong to the thread that opened them
+    QString connectionName = QString("event_recording_%1").arg(reinterpret_cast<quintptr>(this));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(databasePath);
+        if (!db.open()) {
+            qDebug() << "Error opening" << databasePath << "to log" << filePath << ":" << db.lastError().text();
+        } else {
+            logRecording(db, clipCamera, filePath, first.time(), last.time(), bestFacePath);
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+}
 
-    // Insert log into database
+bool RecordingWorker::logRecording(QSqlDatabase db, const QString &cameraname, const QString &filePath,
+                                   const QTime &start, const QTime &end, const QString &bestFacePath)
+{
     QSqlQuery query(db); // Pass the database connection to QSqlQuery constructor
-    query.prepare("INSERT INTO camera_logs (camera_name, file_name, start_time, end_time) VALUES (:camera_name, :file_name, :start_time, :end_time)");
+    query.prepare("INSERT INTO camera_logs (camera_name, file_name, start_time, end_time, best_face) VALUES (:camera_name, :file_name, :start_time, :end_time, :best_face)");
+    query.bindValue(":best_face", bestFacePath.isEmpty() ? QVariant() : QVariant(bestFacePath));
     query.bindValue(":camera_name", cameraname);
     query.bindValue(":file_name", filePath);
-    query.bindValue(":start_time", frameBuffer[startFrameindex].second.second.toString("hh:mm:ss"));
-    query.bindValue(":end_time", frameBuffer[endFrameindex].second.second.toString("hh:mm:ss"));
+    query.bindValue(":start_time", start.toString("hh:mm:ss"));
+    query.bindValue(":end_time", end.toString("hh:mm:ss"));
     if (!query.exec()) {
         qDebug() << "Error inserting log into database:" << query.lastError().text();
-    } else {
-        qDebug() << "Video recording saved: " << filePath;
+        return false;
     }
+    qDebug() << "Video recording saved: " << filePath;
+    return true;
 }
 
 void RecordingWorker::recordvideo(int startFrameindex, int endFrameindex, const QString &cameraname, const QVector<QPair<QDate, QPair<Mat, QTime>>>& frameBuffer)
@@ -78,29 +159,19 @@ void RecordingWorker::recordvideo(int startFrameindex, int endFrameindex, const
         return;
     }
 
-    // Create VideoWriter object
+    // Name the clip after the camera and its time range
     QString fileName = QString("%1_%2_%3_%4.mp4")
                            .arg(cameraname)
                            .arg(frameBuffer[startFrameindex].first.toString())
                            .arg(frameBuffer[startFrameindex].second.second.toString("hhmmss"))
                            .arg(frameBuffer[endFrameindex].second.second.toString("hhmmss"));
 
-    VideoWriter videoWriter(fileName.toStdString(), VideoWriter::fourcc('m', 'p', '4', 'v'), 30, frameBuffer[startFrameindex].second.first.size());
-
-    // Check if VideoWriter is opened successfully
-    if (!videoWriter.isOpened()) {
-        qDebug() << "Error opening VideoWriter for recording.";
+    ClipMuxer muxer(fileName);
+    if (!muxer.write(frameBuffer, startFrameindex, endFrameindex)) {
+        qDebug() << "Error writing recording:" << fileName;
         return;
     }
 
-    // Write frames to the video file
-    for (int i = startFrameindex; i <= endFrameindex; ++i) {
-        videoWriter.write(frameBuffer[i].second.first);
-    }
-
-    // Release VideoWriter resources
-    videoWriter.release();
-
     qDebug() << "Video recording saved: " << fileName;
 }
 
@@ -114,21 +185,11 @@ void RecordingWorker::recordvideo(int startFrameindex, int endFrameindex, const
         return;
     }
 
-    VideoWriter videoWriter(filePath.toStdString(), VideoWriter::fourcc('m', 'p', '4', 'v'), 30, frameBuffer[startFrameindex].second.first.size());
-
-    // Check if VideoWriter is opened successfully
-    if (!videoWriter.isOpened()) {
-        qDebug() << "Error opening VideoWriter for recording.";
+    ClipMuxer muxer(filePath);
+    if (!muxer.write(frameBuffer, startFrameindex, endFrameindex)) {
+        qDebug() << "Error writing recording:" << filePath;
         return;
     }
 
-    // Write frames to the video file
-    for (int i = startFrameindex; i <= endFrameindex; ++i) {
-        videoWriter.write(frameBuffer[i].second.first);
-    }
-
-    // Release VideoWriter resources
-    videoWriter.release();
-
     qDebug() << "Video recording saved: " << filePath;
 }
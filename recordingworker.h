@@ -3,6 +3,10 @@
 
 #include <QString>
 #include <QTime>
+#include <QImage>
+#include <QVector>
+#include <QDateTime>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <QSqlDatabase>
 #include <QSqlQuery>
@@ -10,17 +14,51 @@
 
 // using namespace cv;
 
+class ClipMuxer;
+class StorageManager;
+
 
 class RecordingWorker: public QObject
 {
     Q_OBJECT
 public:
+    using Frame = QPair<QDate, QPair<cv::Mat, QTime>>;
+
     RecordingWorker();
 
-    void recordvideo(int startFrameindex, int endFrameindex, const QString &cameraname, const QVector<QPair<QDate, QPair<cv::Mat, QTime>>> &frameBuffer, QSqlDatabase db);
+    // Recovery kind of the staged event clips
+    static const QString eventKind;
+
+    // Face chips saved next to the event clip, best first. The first one is
+    // referenced from camera_logs.best_face.
+    void setEventFaces(const QVector<QImage> &faces);
+
+    // Event clips go to the camera's disk in the events pool
+    void setStorage(StorageManager *storage);
+
+    // An event clip is staged on disk while the event is open and encoded
+    // once it ends. Called on the worker's thread; finishClip() logs the clip
+    // to camera_logs over a connection of its own to databasePath.
+    void startClip(const QString &cameraname, const QDateTime &start);
+    void addFrames(const QVector<Frame> &frames);
+    void finishClip(const QDateTime &end, const QString &databasePath);
+
     void recordvideo(int startFrameindex, int endFrameindex, const QString &cameraname, const QVector<QPair<QDate, QPair<cv::Mat, QTime>>> &frameBuffer);
     void recordvideo(int startFrameindex, int endFrameindex, const QString &cameraname, const QVector<QPair<QDate, QPair<cv::Mat, QTime>>> &frameBuffer, QString filePath);
 
+    // Adds an event clip to camera_logs, also used for clips recovered at startup
+    static bool logRecording(QSqlDatabase db, const QString &cameraname, const QString &filePath,
+                             const QTime &start, const QTime &end, const QString &bestFacePath);
+
+
+private:
+    QVector<QImage> eventFaces;
+    StorageManager *storage = nullptr;
+    std::shared_ptr<ClipMuxer> clip; // Null outside an event
+    QString clipCamera;
+    QString clipPath;
+    qint64 clipWriteMs = 0;
+    static const int maxEventFaces = 5;
 };
 
 #endif // RECORDINGWORKER_H
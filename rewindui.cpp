@@ -3,8 +3,11 @@
 #include "ui_rewindui.h"
 #include <QThread>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <algorithm>
+#include <cmath>
 
-RewindUi::RewindUi(const QString& cameraName, const QVector<QPair<QDate, QPair<Mat, QTime>>>& frameBuffer, QWidget* parent)
+RewindUi::RewindUi(const QString& cameraName, const HistoryView& frameBuffer, QWidget* parent)
     : QWidget(parent), ui(new Ui::RewindUi), isPlaying(false), currentFrameIndex(0), frameBuffer(frameBuffer), cameraname(cameraName)
 {
     ui->setupUi(this);
@@ -12,6 +15,25 @@ RewindUi::RewindUi(const QString& cameraName, const QVector<QPair<QDate, QPair<M
     playbackTimer = new QTimer(this);
     connect(playbackTimer, &QTimer::timeout, this, &RewindUi::updateFrame);
 
+    // Picks up frames captured since the view was opened while in live tail
+    liveTimer = new QTimer(this);
+    connect(liveTimer, &QTimer::timeout, this, &RewindUi::refreshLiveTail);
+
+    prefetcher = new FramePrefetcher(frameBuffer);
+
+    // Filmstrip and activity above the slider, seeking through the slider
+    timeline = new TimelineBar(this);
+    timeline->setHistory(frameBuffer);
+    ui->verticalLayout_3->insertWidget(2, timeline);
+    connect(timeline, &TimelineBar::seekRequested, ui->horizontalSlider, &QSlider::setValue);
+
+    // Playback speeds, 1x is real time
+    const QList<double> speeds = {0.25, 0.5, 1, 2, 4, 8, 16, 32};
+    for (double speed : speeds) {
+        ui->speed->addItem(QString("%1x").arg(speed), speed);
+    }
+    ui->speed->setCurrentIndex(ui->speed->findData(1.0));
+
     // Connect signals to slots`
     connect(ui->play_button, &QPushButton::clicked, this, &RewindUi::onPlayButtonClicked);
     connect(ui->pause_button, &QPushButton::clicked, this, &RewindUi::onPauseButtonClicked);
@@ -28,22 +50,23 @@ RewindUi::RewindUi(const QString& cameraName, const QVector<QPair<QDate, QPair<M
     ui->horizontalSlider->setEnabled(false);
     ui->cancel_recording->setEnabled(false);
 
-    QTime lastFrameTime = frameBuffer.last().second.second;
+    ui->goto_time->setEnabled(false);
+    ui->goto_time_button->setEnabled(false);
 
     ui->camera_name->setText(cameraname);
 
-    // Update label_2 with the time of the last frame
-    ui->label_2->setText(lastFrameTime.toString());
+    if (frameBuffer.isEmpty())
+    {
+        return;
+    }
 
-    QSet<QDate> uniqueDates;
+    QTime lastFrameTime = frameBuffer.timestamp(frameBuffer.size() - 1).time();
 
-    // Add the dates from frameBuffer
-    for (const auto& entry : frameBuffer) {
-        uniqueDates.insert(entry.first);
-    }
+    // Update label_2 with the time of the last frame
+    ui->label_2->setText(lastFrameTime.toString());
 
-    // Populate the combobox with unique dates
-    for (const auto& date : uniqueDates) {
+    // The history keeps a day index, no need to go through every frame
+    for (const QDate& date : frameBuffer.days()) {
         ui->date->addItem(date.toString(Qt::ISODate), QVariant(date));
     }
 }
@@ -51,12 +74,18 @@ RewindUi::RewindUi(const QString& cameraName, const QVector<QPair<QDate, QPair<M
 RewindUi::~RewindUi()
 {
     qDebug() << "Rewind UI deleted";
+    delete prefetcher;
     delete ui;
 }
 
 void RewindUi::onPlayButtonClicked()
 {
     isPlaying = true;
+    playbackClock = frameBuffer.timestamp(currentFrameIndex);
+    playedFrameIndex = currentFrameIndex;
+    playClock.start();
+
+    prefetcher->request(currentFrameIndex, reversePlayback ? -1 : 1, ui->video_display->size());
 
     playbackTimer->start(33); // Set the interval to 33 ms (approx. 30 fps)
 }
@@ -68,16 +97,81 @@ void RewindUi::onPauseButtonClicked()
 
 void RewindUi::updateFrame()
 {
-    if (isPlaying && currentFrameIndex < frameBuffer.size()) {
+    if (!isPlaying) {
+        playbackTimer->stop();
+        return;
+    }
+
+    // Seeked since the last tick, the clock follows the slider
+    if (currentFrameIndex != playedFrameIndex || !playbackClock.isValid()) {
+        playbackClock = frameBuffer.timestamp(currentFrameIndex);
+        playedFrameIndex = currentFrameIndex;
+    }
+    if (!playbackClock.isValid()) {
+        // The frame was trimmed from the history since the view was opened
+        isPlaying = false;
+        playbackTimer->stop();
+        return;
+    }
+
+    // Wall time drives the clock, a tick that ran late moves it further.
+    // The frames shown follow capture time whatever the camera's frame rate.
+    qint64 step = std::llround(playClock.restart() * playbackSpeed);
+    playbackClock = playbackClock.addMSecs(reversePlayback ? -step : step);
+
+    // Last frame at or before the clock
+    int first = ui->horizontalSlider->minimum();
+    int last = ui->horizontalSlider->maximum();
+    int target = frameBuffer.indexAt(playbackClock);
+    QDateTime targetTime = frameBuffer.timestamp(target);
+    if (targetTime.isValid() && targetTime > playbackClock) {
+        --target;
+    }
+    target = qBound(first, target, last);
+    targetTime = frameBuffer.timestamp(target);
+
+    // A camera that was down leaves a gap, it is skipped rather than played
+    if (targetTime.isValid() && targetTime.msecsTo(playbackClock) > maxGapMs) {
+        if (!reversePlayback && target < last) {
+            ++target;
+            targetTime = frameBuffer.timestamp(target);
+        }
+        playbackClock = targetTime;
+    }
+
+    bool finished = false;
+    if (!reversePlayback && target == last && playbackClock >= targetTime) {
+        // In live tail, wait at the end for the next frames
+        playbackClock = targetTime;
+        finished = !frameBuffer.isLiveTail();
+    } else if (reversePlayback && target == first && playbackClock <= targetTime) {
+        finished = true;
+    }
+
+    if (target != currentFrameIndex) {
+        currentFrameIndex = target;
+        playedFrameIndex = target;
         updateUIFromFrame(currentFrameIndex);
-        ++currentFrameIndex;
-    } else {
+
+        // Frames the clock moves past per tick at the camera's own rate
+        int perSecond = std::max(1, target - std::max(0, frameBuffer.indexAt(playbackClock.addSecs(-1))));
+        int stride = std::max(1, static_cast<int>(std::lround(playbackSpeed * perSecond * playbackTimer->interval() / 1000.0)));
+        prefetcher->request(currentFrameIndex, reversePlayback ? -stride : stride, ui->video_display->size());
+    }
+
+    if (finished) {
+        isPlaying = false;
         playbackTimer->stop();
     }
 }
 
 void RewindUi::onSliderValueChanged(int value)
 {
+    // Moved by playback, the frame is already on screen
+    if (value == currentFrameIndex) {
+        return;
+    }
+
     // Handle slider value change
     currentFrameIndex = value;
     updateUIFromFrame(currentFrameIndex);
@@ -86,17 +180,30 @@ void RewindUi::onSliderValueChanged(int value)
 void RewindUi::updateUIFromFrame(int frameIndex)
 {
     // Update UI elements based on the frame at frameIndex
-    Mat frameMat = frameBuffer[frameIndex].second.first;
-    QTime currentTime = frameBuffer[frameIndex].second.second;
-
-    // Display the frame image (assuming you have a QLabel named video_display)
-    ui->video_display->setPixmap(QPixmap::fromImage(matToImage(frameMat)).scaled(ui->video_display->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    HistoryView::Frame frame;
+    if (!frameBuffer.frameAt(frameIndex, frame))
+    {
+        // Trimmed from the history since the view was opened
+        return;
+    }
+    Mat frameMat = frame.second.first;
+    QTime currentTime = frame.second.second;
+
+    // Display the frame image, converted and scaled ahead by the prefetcher
+    // during playback, here when scrubbing
+    QImage image;
+    if (prefetcher->take(frameIndex, ui->video_display->size(), image)) {
+        ui->video_display->setPixmap(QPixmap::fromImage(image));
+    } else {
+        ui->video_display->setPixmap(QPixmap::fromImage(matToImage(frameMat)).scaled(ui->video_display->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
 
     // Update labels with current time information
     ui->label->setText(currentTime.toString());
 
     // Update slider position
     ui->horizontalSlider->setValue(frameIndex);
+    timeline->setPosition(frameIndex);
 }
 
 void RewindUi::on_goto_start_clicked()
@@ -129,7 +236,7 @@ void RewindUi::on_save_recording_clicked()
     {
         startFrameindex = currentFrameIndex;
 
-        QTime currentTime = frameBuffer[startFrameindex].second.second;
+        QTime currentTime = frameBuffer.timestamp(startFrameindex).time();
 
         ui->from_time->setTime(currentTime);
 
@@ -139,7 +246,7 @@ void RewindUi::on_save_recording_clicked()
     {
         endFrameindex = currentFrameIndex;
 
-        QTime currentTime = frameBuffer[endFrameindex].second.second;
+        QTime currentTime = frameBuffer.timestamp(endFrameindex).time();
 
         ui->till_time->setTime(currentTime);
 
@@ -147,7 +254,10 @@ void RewindUi::on_save_recording_clicked()
 
         onPauseButtonClicked();
 
-        if((frameBuffer.size() - 1) < endFrameindex || startFrameindex > endFrameindex)
+        // Only the marked frames are copied out of the history
+        QVector<QPair<QDate, QPair<Mat, QTime>>> clip = frameBuffer.range(startFrameindex, endFrameindex);
+
+        if((frameBuffer.size() - 1) < endFrameindex || startFrameindex > endFrameindex || clip.isEmpty())
         {
             qDebug() << "List index out of range or incorrect labels";
             ui->save_recording->setText("Start Recording");
@@ -158,9 +268,9 @@ void RewindUi::on_save_recording_clicked()
             // Create VideoWriter object
             QString fileName = QString("%1_%2_%3_%4.mp4")
                                    .arg(cameraname)
-                                   .arg(frameBuffer[startFrameindex].first.toString())
-                                   .arg(frameBuffer[startFrameindex].second.second.toString("hhmmss"))
-                                   .arg(frameBuffer[endFrameindex].second.second.toString("hhmmss"));
+                                   .arg(clip.first().first.toString())
+                                   .arg(clip.first().second.second.toString("hhmmss"))
+                                   .arg(clip.last().second.second.toString("hhmmss"));
 
             QString filePath = QFileDialog::getSaveFileName(this, tr("Save Recording"), fileName, tr("Videos (*.mp4);;All Files (*)"));
 
@@ -172,26 +282,11 @@ void RewindUi::on_save_recording_clicked()
                 return;
             }
 
-            RecordingWorker* worker = new RecordingWorker;
-
-            // Move the worker object to a separate thread
-            // Create a new thread
-            QThread* recordingThread = new QThread;
-
-            // Move the RecordingWorker instance to the new thread
-            worker -> moveToThread(recordingThread);
-
-            // Call recordvideo from the new thread using lambda function
-            QObject::connect(recordingThread, &QThread::started, [=]()
-            {
-                worker -> recordvideo(startFrameindex, endFrameindex, cameraname, frameBuffer, filePath);
-            });
-
-            // Connect thread's finished signal to deleteLater() slot to clean up when the thread finishes
-            QObject::connect(recordingThread, &QThread::finished, recordingThread, &QThread::deleteLater);
-
-            // Start the thread
-            recordingThread->start();
+            // Long ranges are encoded in parallel segments, progress and
+            // cancel in a dialog
+            ClipExporter* exporter = new ClipExporter(clip, filePath);
+            exporter->showProgress(this, "Saving " + QFileInfo(filePath).fileName());
+            exporter->start();
 
             ui->save_recording->setText("Start Recording");
             ui->cancel_recording->setEnabled(false);
@@ -229,28 +324,22 @@ void RewindUi::on_date_currentIndexChanged(int index)
     // Get the selected date from the combobox
     QDate selectedDate = ui->date->itemData(index).toDate();
 
-    // Initialize first and last frame indexes
-    int firstFrameIndex = -1;
-    int lastFrameIndex = -1;
-
-    // Find the indexes of the first and last frames for the selected date
-    for (int i = 0; i < frameBuffer.size(); ++i) {
-        if (frameBuffer[i].first == selectedDate) {
-            if (firstFrameIndex == -1) {
-                firstFrameIndex = i;
-            }
-            lastFrameIndex = i;
-        }
-    }
+    // First and last frame of the day from the history's day index
+    QPair<int, int> range = frameBuffer.dayRange(selectedDate);
+    int firstFrameIndex = range.first;
+    int lastFrameIndex = range.second;
 
     if (firstFrameIndex != -1 && lastFrameIndex != -1) {
         // Display frames for the selected date
         qDebug() << "Frames found from this date";
+        currentFrameIndex = firstFrameIndex;
         updateUIFromFrame(firstFrameIndex);
         ui->horizontalSlider->setRange(firstFrameIndex, lastFrameIndex);
         ui->horizontalSlider->setValue(firstFrameIndex);
+        timeline->setRange(firstFrameIndex, lastFrameIndex);
+        timeline->setPosition(firstFrameIndex);
 
-        QTime lastFrameTime = frameBuffer[lastFrameIndex].second.second;
+        QTime lastFrameTime = frameBuffer.timestamp(lastFrameIndex).time();
 
         // Update label_2 with the time of the last frame
         ui->label_2->setText(lastFrameTime.toString());
@@ -272,11 +361,14 @@ void RewindUi::disableeverything()
     ui->horizontalSlider->setEnabled(false);
     ui->goto_end->setEnabled(false);
     ui->goto_start->setEnabled(false);
+    ui->goto_time->setEnabled(false);
+    ui->goto_time_button->setEnabled(false);
     ui->video_display->clear();
     ui->label->clear();
     ui->label_2->clear();
     ui->horizontalSlider->setRange(0, 0);
     ui->horizontalSlider->setValue(0);
+    timeline->setRange(-1, -1);
 }
 
 void RewindUi::enableeverything()
@@ -287,7 +379,8 @@ void RewindUi::enableeverything()
     ui->horizontalSlider->setEnabled(true);
     ui->goto_end->setEnabled(true);
     ui->goto_start->setEnabled(true);
-
+    ui->goto_time->setEnabled(true);
+    ui->goto_time_button->setEnabled(true);
 }
 
 void RewindUi::on_cancel_recording_clicked()
@@ -298,3 +391,84 @@ void RewindUi::on_cancel_recording_clicked()
     ui->from_time->setTime(QTime(0, 0, 0));
     ui->till_time->setTime(QTime(0, 0, 0));
 }
+
+void RewindUi::on_goto_time_button_clicked()
+{
+    int dateIndex = ui->date->currentIndex();
+    if (dateIndex < 0)
+    {
+        return;
+    }
+
+    // Nearest frame at or after the time on the selected date, kept within
+    // the day the slider covers
+    QDate selectedDate = ui->date->itemData(dateIndex).toDate();
+    QPair<int, int> range = frameBuffer.dayRange(selectedDate);
+    if (range.first == -1)
+    {
+        return;
+    }
+
+    int frameIndex = frameBuffer.indexAt(QDateTime(selectedDate, ui->goto_time->time()));
+    currentFrameIndex = qBound(range.first, frameIndex, range.second);
+    updateUIFromFrame(currentFrameIndex);
+}
+
+void RewindUi::on_live_tail_toggled(bool checked)
+{
+    frameBuffer.setLiveTail(checked);
+    prefetcher->setHistory(frameBuffer);
+    timeline->setHistory(frameBuffer);
+    if (checked)
+    {
+        refreshLiveTail();
+        liveTimer->start(1000);
+    }
+    else
+    {
+        liveTimer->stop();
+    }
+}
+
+void RewindUi::refreshLiveTail()
+{
+    // New days show up in the date list, the slider grows with today
+    const QList<QDate> days = frameBuffer.days();
+    for (const QDate& date : days)
+    {
+        if (ui->date->findData(QVariant(date)) == -1)
+        {
+            ui->date->addItem(date.toString(Qt::ISODate), QVariant(date));
+        }
+    }
+
+    int dateIndex = ui->date->currentIndex();
+    if (dateIndex < 0)
+    {
+        return;
+    }
+
+    QPair<int, int> range = frameBuffer.dayRange(ui->date->itemData(dateIndex).toDate());
+    if (range.first == -1 || range.second <= ui->horizontalSlider->maximum())
+    {
+        return;
+    }
+
+    ui->horizontalSlider->setMaximum(range.second);
+    timeline->setRange(range.first, range.second);
+    ui->label_2->setText(frameBuffer.timestamp(range.second).time().toString());
+}
+
+void RewindUi::on_speed_currentIndexChanged(int index)
+{
+    if (index < 0)
+    {
+        return;
+    }
+    playbackSpeed = ui->speed->itemData(index).toDouble();
+}
+
+void RewindUi::on_reverse_toggled(bool checked)
+{
+    reversePlayback = checked;
+}
@@ -3,12 +3,18 @@
 #define REWINDUI_H
 
 #include <QWidget>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QTime>
 #include <QThread>
 #include <QTimer>
 #include <opencv2/opencv.hpp>
 #include "recordingworker.h"
+#include "clipexporter.h"
+#include "framehistory.h"
+#include "frameprefetcher.h"
+#include "timelinebar.h"
 
 using namespace cv;
 
@@ -20,7 +26,7 @@ class RewindUi : public QWidget {
     Q_OBJECT
 
 public:
-    explicit RewindUi(const QString& cameraname, const QVector<QPair<QDate, QPair<Mat, QTime>>>& frameBuffer, QWidget* parent = nullptr);
+    explicit RewindUi(const QString& cameraname, const HistoryView& frameBuffer, QWidget* parent = nullptr);
     ~RewindUi();
 
 public slots:
@@ -39,12 +45,26 @@ private slots:
 
     void on_cancel_recording_clicked();
 
+    void on_goto_time_button_clicked();
+
+    void on_live_tail_toggled(bool checked);
+
+    void refreshLiveTail();
+
+    void on_speed_currentIndexChanged(int index);
+
+    void on_reverse_toggled(bool checked);
+
 private:
     Ui::RewindUi* ui;
     bool isPlaying;
     int currentFrameIndex;
     double playbackSpeed = 1.0;
-    QVector<QPair<QDate, QPair<Mat, QTime>>> frameBuffer;
+    bool reversePlayback = false;
+    QDateTime playbackClock;        // Capture time being played, runs on wall time times the speed
+    QElapsedTimer playClock;
+    int playedFrameIndex = -1;      // Last frame the clock showed, anything else was a seek
+    HistoryView frameBuffer;
     QString cameraname;
 
     void updateFrame();
@@ -62,7 +82,12 @@ private:
     QThread workerThread;
     RecordingWorker recordWorker;
 
+    static const int maxGapMs = 2000; // Longer gaps in the footage are skipped
+
     QTimer *playbackTimer;
+    QTimer *liveTimer;
+    FramePrefetcher *prefetcher;
+    TimelineBar *timeline;
 };
 
 #endif // REWINDUI_H
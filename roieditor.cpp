@@ -0,0 +1,164 @@
+#include "roieditor.h"
+#include "detectionregions.h"
+
+#include <QDebug>
+#include <QDialogButtonBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPushButton>
+#include <QVBoxLayout>
+#include <opencv2/opencv.hpp>
+
+RoiCanvas::RoiCanvas(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumSize(640, 360);
+    setCursor(Qt::CrossCursor);
+}
+
+void RoiCanvas::setSnapshot(const QImage &image)
+{
+    snapshot = image;
+    update();
+}
+
+void RoiCanvas::setExcludeMode(bool exclude)
+{
+    excludeMode = exclude;
+    current.clear();
+    update();
+}
+
+void RoiCanvas::clear()
+{
+    include.clear();
+    exclude.clear();
+    current.clear();
+    update();
+}
+
+QRectF RoiCanvas::imageRect() const
+{
+    if (snapshot.isNull()) {
+        return QRectF(rect());
+    }
+
+    // Letterbox the snapshot so normalised points keep the camera's aspect
+    QSizeF imageSize = QSizeF(snapshot.size()).scaled(size(), Qt::KeepAspectRatio);
+    return QRectF(QPointF((width() - imageSize.width()) / 2, (height() - imageSize.height()) / 2), imageSize);
+}
+
+void RoiCanvas::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    QRectF target = imageRect();
+    if (!snapshot.isNull()) {
+        painter.drawImage(target, snapshot);
+    }
+
+    auto toWidget = [&target](const QPolygonF &polygon) {
+        QPolygonF mapped;
+        for (const QPointF &point : polygon) {
+            mapped << QPointF(target.left() + point.x() * target.width(), target.top() + point.y() * target.height());
+        }
+        return mapped;
+    };
+
+    painter.setPen(QPen(Qt::green, 2));
+    painter.setBrush(QColor(0, 255, 0, 50));
+    for (const QPolygonF &polygon : include) {
+        painter.drawPolygon(toWidget(polygon));
+    }
+
+    painter.setPen(QPen(Qt::red, 2));
+    painter.setBrush(QColor(255, 0, 0, 70));
+    for (const QPolygonF &polygon : exclude) {
+        painter.drawPolygon(toWidget(polygon));
+    }
+
+    painter.setPen(QPen(excludeMode ? Qt::red : Qt::green, 2, Qt::DashLine));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawPolyline(toWidget(current));
+}
+
+void RoiCanvas::mousePressEvent(QMouseEvent *event)
+{
+    QRectF target = imageRect();
+
+    if (event->button() == Qt::LeftButton) {
+        QPointF position = event->position();
+        if (!target.contains(position)) {
+            return;
+        }
+        current << QPointF((position.x() - target.left()) / target.width(), (position.y() - target.top()) / target.height());
+    } else if (event->button() == Qt::RightButton) {
+        if (current.size() >= 3) {
+            (excludeMode ? exclude : include).append(current);
+        }
+        current.clear();
+    }
+
+    update();
+}
+
+RoiEditor::RoiEditor(const QString &cameraName, const QString &cameraUrl, const QString &includeText, const QString &excludeText, QWidget *parent)
+    : QDialog(parent)
+{
+    setWindowTitle("Detection Regions - " + cameraName);
+
+    canvas = new RoiCanvas(this);
+    canvas->include = DetectionRegions::parse(includeText);
+    canvas->exclude = DetectionRegions::parse(excludeText);
+
+    // One frame from the camera to draw on
+    cv::VideoCapture capture(cameraUrl.toStdString(), cv::CAP_FFMPEG);
+    cv::Mat frame;
+    if (capture.isOpened() && capture.read(frame) && frame.channels() == 3) {
+        QImage image(frame.data, frame.cols, frame.rows, frame.step, QImage::Format_RGB888);
+        canvas->setSnapshot(image.rgbSwapped());
+    } else {
+        qDebug() << "Could not grab a snapshot from" << cameraName;
+    }
+    capture.release();
+
+    includeButton = new QRadioButton("Detection Area", this);
+    excludeButton = new QRadioButton("Exclusion Mask", this);
+    includeButton->setChecked(true);
+    connect(excludeButton, &QRadioButton::toggled, canvas, &RoiCanvas::setExcludeMode);
+
+    QPushButton *clearButton = new QPushButton("Clear", this);
+    connect(clearButton, &QPushButton::clicked, canvas, &RoiCanvas::clear);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Save | QDialogButtonBox::Cancel, this);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QHBoxLayout *modeLayout = new QHBoxLayout;
+    modeLayout->addWidget(includeButton);
+    modeLayout->addWidget(excludeButton);
+    modeLayout->addStretch();
+    modeLayout->addWidget(new QLabel("Left click: add point, right click: close polygon", this));
+    modeLayout->addWidget(clearButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(modeLayout);
+    layout->addWidget(canvas, 1);
+    layout->addWidget(buttons);
+}
+
+QString RoiEditor::includeText() const
+{
+    return DetectionRegions::format(canvas->include);
+}
+
+QString RoiEditor::excludeText() const
+{
+    return DetectionRegions::format(canvas->exclude);
+}
@@ -0,0 +1,55 @@
+#ifndef ROIEDITOR_H
+#define ROIEDITOR_H
+
+#include <QDialog>
+#include <QImage>
+#include <QPolygonF>
+#include <QRadioButton>
+#include <QVector>
+#include <QWidget>
+
+// Draws the detection area and exclusion polygons over a snapshot of the
+// camera. Left click adds a point, right click closes the polygon.
+class RoiCanvas : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit RoiCanvas(QWidget *parent = nullptr);
+
+    void setSnapshot(const QImage &image);
+    void setExcludeMode(bool exclude);
+    void clear();
+
+    QVector<QPolygonF> include;
+    QVector<QPolygonF> exclude;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+
+private:
+    QImage snapshot;
+    QPolygonF current;
+    bool excludeMode = false;
+
+    QRectF imageRect() const;
+};
+
+class RoiEditor : public QDialog
+{
+    Q_OBJECT
+
+public:
+    RoiEditor(const QString &cameraName, const QString &cameraUrl, const QString &includeText, const QString &excludeText, QWidget *parent = nullptr);
+
+    QString includeText() const;
+    QString excludeText() const;
+
+private:
+    RoiCanvas *canvas;
+    QRadioButton *includeButton;
+    QRadioButton *excludeButton;
+};
+
+#endif // ROIEDITOR_H
@@ -0,0 +1,778 @@
+#include "sightingsindex.h"
+#include "dlib_utils.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <random>
+
+namespace {
+
+const quint32 centroidsMagic = 0x56464953; // "SIFV"
+const quint32 centroidsVersion = 1;
+
+float squaredDistance(const float *a, const float *b, int dimensions)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < dimensions; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+int nearestCentroid(const std::vector<float> &centroids, int count, int dimensions, const float *encoding)
+{
+    int best = 0;
+    float bestDistance = std::numeric_limits<float>::max();
+    for (int c = 0; c < count; ++c) {
+        float d = squaredDistance(encoding, centroids.data() + static_cast<size_t>(c) * dimensions, dimensions);
+        if (d < bestDistance) {
+            bestDistance = d;
+            best = c;
+        }
+    }
+    return best;
+}
+
+}
+
+SightingsIndex::SightingsIndex(const QString &directory)
+    : directory(directory)
+{
+    trainPool.setMaxThreadCount(1);
+}
+
+SightingsIndex::~SightingsIndex()
+{
+    trainPool.waitForDone();
+    close();
+}
+
+bool SightingsIndex::openColumn(Column &column, const QString &name, int width, QIODevice::OpenMode mode)
+{
+    column.width = width;
+    column.file.setFileName(QDir(directory).filePath(name));
+    if (!column.file.open(mode)) {
+        qDebug() << "SightingsIndex: cannot open" << column.file.fileName() << column.file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SightingsIndex::open(Mode mode)
+{
+    QMutexLocker locker(&mutex);
+    if (opened) {
+        return true;
+    }
+    readOnly = mode == ReadOnly;
+
+    if (!readOnly && !QDir().mkpath(QDir(directory).filePath("thumbs"))) {
+        qDebug() << "SightingsIndex: cannot create" << directory;
+        return false;
+    }
+
+    QIODevice::OpenMode fileMode = readOnly ? QIODevice::ReadOnly : QIODevice::ReadWrite;
+    if (!openColumn(timeColumn, "time.i64", sizeof(qint64), fileMode)
+        || !openColumn(cameraColumn, "camera.u16", sizeof(quint16), fileMode)
+        || !openColumn(listColumn, "list.u16", sizeof(quint16), fileMode)
+        || !openColumn(scaleColumn, "scale.f32", sizeof(float), fileMode)
+        || !openColumn(codeColumn, "code.i8", dimensions, fileMode)) {
+        return false;
+    }
+
+    // Columns are written one after the other, a crash can leave the last
+    // row in some of them only. Cut every column back to the shortest.
+    Column *columns[] = {&timeColumn, &cameraColumn, &listColumn, &scaleColumn, &codeColumn};
+    rows = std::numeric_limits<quint64>::max();
+    for (Column *column : columns) {
+        rows = std::min<quint64>(rows, column->file.size() / column->width);
+    }
+    for (Column *column : columns) {
+        if (!readOnly && static_cast<quint64>(column->file.size()) != rows * column->width) {
+            qDebug() << "SightingsIndex: dropping a partial row from" << column->file.fileName();
+            column->file.resize(rows * column->width);
+        }
+    }
+
+    QFile namesFile(QDir(directory).filePath("cameras.txt"));
+    if (namesFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream stream(&namesFile);
+        while (!stream.atEnd()) {
+            QString name = stream.readLine();
+            cameraIds.insert(name, static_cast<quint16>(cameraNames.size()));
+            cameraNames.append(name);
+        }
+    }
+
+    loadCentroids();
+
+    // Posting lists are rebuilt from the list column, 2 bytes a row
+    lists.assign(listCount, {});
+    unassigned.clear();
+    listColumn.file.seek(0);
+    QByteArray listBytes = listColumn.file.read(rows * sizeof(quint16));
+    const quint16 *listIds = reinterpret_cast<const quint16 *>(listBytes.constData());
+    for (quint64 row = 0; row < rows; ++row) {
+        if (listIds[row] < listCount) {
+            lists[listIds[row]].push_back(static_cast<quint32>(row));
+        } else {
+            unassigned.push_back(static_cast<quint32>(row));
+        }
+    }
+
+    if (!mapColumns()) {
+        return false;
+    }
+
+    // Rows appended while the index was training the last time round,
+    // only assigned in memory when read-only
+    if (listCount > 0 && !unassigned.empty()) {
+        std::vector<float> encoding(dimensions);
+        for (quint32 row : unassigned) {
+            decode(row, encoding.data());
+            quint16 list = static_cast<quint16>(nearestList(encoding.data()));
+            if (!readOnly) {
+                listColumn.file.seek(static_cast<qint64>(row) * sizeof(quint16));
+                listColumn.file.write(reinterpret_cast<const char *>(&list), sizeof(list));
+            }
+            lists[list].push_back(row);
+        }
+        unassigned.clear();
+        if (!readOnly) {
+            listColumn.file.flush();
+        }
+    }
+
+    opened = true;
+    qDebug() << "SightingsIndex: opened" << directory << "with" << rows << "sightings," << listCount << "lists";
+    return true;
+}
+
+void SightingsIndex::close()
+{
+    QMutexLocker locker(&mutex);
+    if (!opened) {
+        return;
+    }
+
+    unmapColumns();
+    for (Column *column : {&timeColumn, &cameraColumn, &listColumn, &scaleColumn, &codeColumn}) {
+        column->file.close();
+    }
+    opened = false;
+}
+
+quint64 SightingsIndex::size() const
+{
+    QMutexLocker locker(&mutex);
+    return rows;
+}
+
+bool SightingsIndex::isTrained() const
+{
+    QMutexLocker locker(&mutex);
+    return listCount > 0;
+}
+
+bool SightingsIndex::mapColumns()
+{
+    for (Column *column : {&timeColumn, &cameraColumn, &scaleColumn, &codeColumn}) {
+        if (column->mappedRows == rows) {
+            continue;
+        }
+        column->file.flush();
+        if (column->map) {
+            column->file.unmap(column->map);
+            column->map = nullptr;
+            column->mappedRows = 0;
+        }
+        if (rows == 0) {
+            continue;
+        }
+        column->map = column->file.map(0, rows * column->width);
+        if (!column->map) {
+            qDebug() << "SightingsIndex: cannot map" << column->file.fileName() << column->file.errorString();
+            return false;
+        }
+        column->mappedRows = rows;
+    }
+    return true;
+}
+
+void SightingsIndex::unmapColumns()
+{
+    for (Column *column : {&timeColumn, &cameraColumn, &scaleColumn, &codeColumn}) {
+        if (column->map) {
+            column->file.unmap(column->map);
+            column->map = nullptr;
+            column->mappedRows = 0;
+        }
+    }
+}
+
+bool SightingsIndex::appendCamera(const QString &cameraName, quint16 &id)
+{
+    auto it = cameraIds.constFind(cameraName);
+    if (it != cameraIds.constEnd()) {
+        id = it.value();
+        return true;
+    }
+    if (cameraNames.size() >= unassignedList) {
+        return false;
+    }
+
+    QFile namesFile(QDir(directory).filePath("cameras.txt"));
+    if (!namesFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qDebug() << "SightingsIndex: cannot write camera names" << namesFile.errorString();
+        return false;
+    }
+    QTextStream(&namesFile) << cameraName << "\n";
+
+    id = static_cast<quint16>(cameraNames.size());
+    cameraIds.insert(cameraName, id);
+    cameraNames.append(cameraName);
+    return true;
+}
+
+bool SightingsIndex::append(const QString &cameraName, const QDateTime &seenAt,
+                            const dlib::matrix<float, 0, 1> &encoding, const QImage &chip)
+{
+    bool startTraining = false;
+    {
+        QMutexLocker locker(&mutex);
+        if (!opened || readOnly || encoding.size() != dimensions) {
+            return false;
+        }
+
+        quint16 cameraId;
+        if (!appendCamera(cameraName, cameraId)) {
+            return false;
+        }
+
+        // Symmetric int8 quantisation with one scale per row
+        float maxAbs = 0.0f;
+        for (int i = 0; i < dimensions; ++i) {
+            maxAbs = std::max(maxAbs, std::abs(encoding(i)));
+        }
+        float scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+        qint8 codes[dimensions];
+        for (int i = 0; i < dimensions; ++i) {
+            codes[i] = static_cast<qint8>(std::clamp<long>(std::lround(encoding(i) / scale), -127, 127));
+        }
+
+        quint16 list = listCount > 0 ? static_cast<quint16>(nearestList(&encoding(0))) : unassignedList;
+        qint64 time = seenAt.toMSecsSinceEpoch();
+
+        struct Value
+        {
+            Column &column;
+            const void *data;
+        };
+        Value values[] = {{timeColumn, &time}, {cameraColumn, &cameraId}, {listColumn, &list},
+                          {scaleColumn, &scale}, {codeColumn, codes}};
+        for (const Value &value : values) {
+            value.column.file.seek(rows * value.column.width);
+            if (value.column.file.write(static_cast<const char *>(value.data), value.column.width) != value.column.width) {
+                qDebug() << "SightingsIndex: write failed" << value.column.file.fileName() << value.column.file.errorString();
+                for (const Value &undo : values) {
+                    undo.column.file.resize(rows * undo.column.width);
+                }
+                return false;
+            }
+        }
+
+        if (!chip.isNull()) {
+            QString path = thumbnailPath(rows);
+            QDir().mkpath(QFileInfo(path).path());
+            chip.save(path, "JPG", 85);
+        }
+
+        if (list == unassignedList) {
+            unassigned.push_back(static_cast<quint32>(rows));
+        } else {
+            lists[list].push_back(static_cast<quint32>(rows));
+        }
+        ++rows;
+
+        // A crash loses at most the last few rows
+        if (++unflushedRows >= 32) {
+            for (Column *column : {&timeColumn, &cameraColumn, &listColumn, &scaleColumn, &codeColumn}) {
+                column->file.flush();
+            }
+            unflushedRows = 0;
+        }
+
+        startTraining = listCount == 0 && rows >= trainThreshold && !training;
+    }
+
+    if (startTraining) {
+        trainPool.start([this]() {
+            if (!isTrained()) {
+                train();
+            }
+        });
+    }
+    return true;
+}
+
+void SightingsIndex::flush()
+{
+    QMutexLocker locker(&mutex);
+    for (Column *column : {&timeColumn, &cameraColumn, &listColumn, &scaleColumn, &codeColumn}) {
+        column->file.flush();
+    }
+    unflushedRows = 0;
+}
+
+QString SightingsIndex::thumbnailPath(quint64 row) const
+{
+    // 10000 thumbnails a folder keeps directory listings fast
+    return QDir(directory).filePath(QString("thumbs/%1/%2.jpg").arg(row / 10000).arg(row));
+}
+
+int SightingsIndex::nearestList(const float *encoding) const
+{
+    return nearestCentroid(centroids, listCount, dimensions, encoding);
+}
+
+void SightingsIndex::decode(quint64 row, float *out) const
+{
+    const qint8 *codes = reinterpret_cast<const qint8 *>(codeColumn.map) + row * dimensions;
+    float scale = reinterpret_cast<const float *>(scaleColumn.map)[row];
+    for (int i = 0; i < dimensions; ++i) {
+        out[i] = codes[i] * scale;
+    }
+}
+
+float SightingsIndex::distance(const float *query, quint64 row) const
+{
+    const qint8 *codes = reinterpret_cast<const qint8 *>(codeColumn.map) + row * dimensions;
+    float scale = reinterpret_cast<const float *>(scaleColumn.map)[row];
+    float sum = 0.0f;
+    for (int i = 0; i < dimensions; ++i) {
+        float d = query[i] - codes[i] * scale;
+        sum += d * d;
+    }
+    return sum;
+}
+
+QVector<SightingsIndex::Sighting> SightingsIndex::search(const dlib::matrix<float, 0, 1> &encoding, const Query &query)
+{
+    QVector<Sighting> results;
+
+    QMutexLocker locker(&mutex);
+    if (!opened || rows == 0 || encoding.size() != dimensions || query.limit <= 0) {
+        return results;
+    }
+
+    for (Column *column : {&timeColumn, &cameraColumn, &listColumn, &scaleColumn, &codeColumn}) {
+        column->file.flush();
+    }
+    unflushedRows = 0;
+    if (!mapColumns()) {
+        return results;
+    }
+
+    const float *queryVector = &encoding(0);
+    qint64 from = query.from.isValid() ? query.from.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+    qint64 to = query.to.isValid() ? query.to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+    float maxDistance = static_cast<float>(query.maxDistance * query.maxDistance);
+
+    QSet<quint16> cameraFilter;
+    for (const QString &camera : query.cameras) {
+        auto it = cameraIds.constFind(camera);
+        if (it != cameraIds.constEnd()) {
+            cameraFilter.insert(it.value());
+        }
+    }
+    if (!query.cameras.isEmpty() && cameraFilter.isEmpty()) {
+        return results;
+    }
+
+    const qint64 *times = reinterpret_cast<const qint64 *>(timeColumn.map);
+    const quint16 *cameras = reinterpret_cast<const quint16 *>(cameraColumn.map);
+
+    // Max-heap of the best rows so far, the worst one on top
+    std::priority_queue<std::pair<float, quint64>> best;
+    auto consider = [&](quint64 row) {
+        if (times[row] < from || times[row] > to) {
+            return;
+        }
+        if (!cameraFilter.isEmpty() && !cameraFilter.contains(cameras[row])) {
+            return;
+        }
+        float d = distance(queryVector, row);
+        if (d > maxDistance) {
+            return;
+        }
+        if (static_cast<int>(best.size()) < query.limit) {
+            best.emplace(d, row);
+        } else if (d < best.top().first) {
+            best.pop();
+            best.emplace(d, row);
+        }
+    };
+
+    if (listCount > 0) {
+        std::vector<std::pair<float, int>> nearest(listCount);
+        for (int c = 0; c < listCount; ++c) {
+            nearest[c] = {squaredDistance(queryVector, centroids.data() + static_cast<size_t>(c) * dimensions, dimensions), c};
+        }
+        int probes = std::clamp(query.probes, 1, listCount);
+        std::partial_sort(nearest.begin(), nearest.begin() + probes, nearest.end());
+        for (int p = 0; p < probes; ++p) {
+            for (quint32 row : lists[nearest[p].second]) {
+                consider(row);
+            }
+        }
+        for (quint32 row : unassigned) {
+            consider(row);
+        }
+    } else {
+        for (quint64 row = 0; row < rows; ++row) {
+            consider(row);
+        }
+    }
+
+    results.resize(static_cast<int>(best.size()));
+    for (int i = results.size() - 1; i >= 0; --i) {
+        quint64 row = best.top().second;
+        float d = best.top().first;
+        best.pop();
+
+        Sighting &sighting = results[i];
+        sighting.row = row;
+        sighting.cameraName = cameras[row] < cameraNames.size() ? cameraNames[cameras[row]] : QString();
+        sighting.seenAt = QDateTime::fromMSecsSinceEpoch(times[row]);
+        sighting.distance = std::sqrt(d);
+        sighting.thumbnailPath = thumbnailPath(row);
+    }
+    return results;
+}
+
+QVector<SightingsIndex::Sighting> SightingsIndex::searchImage(const cv::Mat &image, const Query &query, QString *error)
+{
+    dlib::matrix<float, 0, 1> encoding;
+    std::string encodingError;
+    if (!compute_face_encoding(image, encoding, nullptr, &encodingError)) {
+        if (error) {
+            *error = QString::fromStdString(encodingError);
+        }
+        return {};
+    }
+    return search(encoding, query);
+}
+
+QVector<SightingsIndex::Sighting> SightingsIndex::searchIdentity(QSqlDatabase facesDb, qint64 faceId, const Query &query, QString *error)
+{
+    QSqlQuery faceQuery(facesDb);
+    faceQuery.prepare("SELECT encoding FROM face_encodings WHERE id = :id");
+    faceQuery.bindValue(":id", faceId);
+    if (!faceQuery.exec() || !faceQuery.next()) {
+        if (error) {
+            *error = faceQuery.lastError().isValid() ? faceQuery.lastError().text() : QString("No enrolled face with id %1").arg(faceId);
+        }
+        return {};
+    }
+
+    QByteArray encodingBytes = faceQuery.value(0).toByteArray();
+    if (encodingBytes.size() != static_cast<int>(dimensions * sizeof(float))) {
+        if (error) {
+            *error = "Stored encoding has an unexpected size";
+        }
+        return {};
+    }
+
+    dlib::matrix<float, 0, 1> encoding(dimensions);
+    std::memcpy(encoding.begin(), encodingBytes.constData(), encodingBytes.size());
+    return search(encoding, query);
+}
+
+bool SightingsIndex::train(int newListCount)
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (readOnly) {
+            return false;
+        }
+    }
+
+    // One training run at a time, the automatic one or a manual retrain
+    if (training.exchange(true)) {
+        return false;
+    }
+    struct TrainingFlag
+    {
+        std::atomic<bool> &flag;
+        ~TrainingFlag() { flag = false; }
+    } trainingFlag{training};
+
+    newListCount = std::clamp(newListCount, 1, static_cast<int>(unassignedList) - 1);
+
+    QElapsedTimer timer;
+    timer.start();
+    std::mt19937 generator(42);
+
+    // Sample under the lock, cluster without it
+    quint64 trainedRows;
+    std::vector<float> sample;
+    {
+        QMutexLocker locker(&mutex);
+        trainedRows = rows;
+        if (!opened || trainedRows < static_cast<quint64>(newListCount) * 4) {
+            qDebug() << "SightingsIndex: too few sightings to train" << newListCount << "lists";
+            return false;
+        }
+        if (!mapColumns()) {
+            return false;
+        }
+
+        quint64 sampleSize = std::min<quint64>(trainedRows, static_cast<quint64>(newListCount) * 64);
+        sample.resize(sampleSize * dimensions);
+        std::uniform_int_distribution<quint64> pick(0, trainedRows - 1);
+        for (quint64 i = 0; i < sampleSize; ++i) {
+            decode(sampleSize == trainedRows ? i : pick(generator), sample.data() + i * dimensions);
+        }
+    }
+
+    int sampleCount = static_cast<int>(sample.size() / dimensions);
+    std::vector<float> newCentroids(static_cast<size_t>(newListCount) * dimensions);
+    std::vector<int> order(sampleCount);
+    for (int i = 0; i < sampleCount; ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), generator);
+    for (int c = 0; c < newListCount; ++c) {
+        std::memcpy(newCentroids.data() + static_cast<size_t>(c) * dimensions,
+                    sample.data() + static_cast<size_t>(order[c]) * dimensions, dimensions * sizeof(float));
+    }
+
+    // Plain Lloyd iterations, an empty list is reseeded from a random sample
+    std::uniform_int_distribution<int> pickSample(0, sampleCount - 1);
+    for (int iteration = 0; iteration < 10; ++iteration) {
+        std::vector<double> sums(newCentroids.size(), 0.0);
+        std::vector<int> counts(newListCount, 0);
+        for (int i = 0; i < sampleCount; ++i) {
+            const float *point = sample.data() + static_cast<size_t>(i) * dimensions;
+            int c = nearestCentroid(newCentroids, newListCount, dimensions, point);
+            ++counts[c];
+            for (int d = 0; d < dimensions; ++d) {
+                sums[static_cast<size_t>(c) * dimensions + d] += point[d];
+            }
+        }
+        for (int c = 0; c < newListCount; ++c) {
+            float *centroid = newCentroids.data() + static_cast<size_t>(c) * dimensions;
+            if (counts[c] == 0) {
+                std::memcpy(centroid, sample.data() + static_cast<size_t>(pickSample(generator)) * dimensions,
+                            dimensions * sizeof(float));
+                continue;
+            }
+            for (int d = 0; d < dimensions; ++d) {
+                centroid[d] = static_cast<float>(sums[static_cast<size_t>(c) * dimensions + d] / counts[c]);
+            }
+        }
+    }
+
+    // Assign in chunks so appends and searches get the lock in between
+    std::vector<quint16> assignments;
+    assignments.reserve(trainedRows);
+    std::vector<float> encoding(dimensions);
+    const quint64 chunk = 4096;
+    for (quint64 start = 0; start < trainedRows; start += chunk) {
+        QMutexLocker locker(&mutex);
+        if (!opened || !mapColumns()) {
+            return false;
+        }
+        for (quint64 row = start; row < std::min(trainedRows, start + chunk); ++row) {
+            decode(row, encoding.data());
+            assignments.push_back(static_cast<quint16>(nearestCentroid(newCentroids, newListCount, dimensions, encoding.data())));
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    if (!opened || !mapColumns()) {
+        return false;
+    }
+
+    // Rows that arrived while clustering
+    for (quint64 row = trainedRows; row < rows; ++row) {
+        decode(row, encoding.data());
+        assignments.push_back(static_cast<quint16>(nearestCentroid(newCentroids, newListCount, dimensions, encoding.data())));
+    }
+
+    centroids = std::move(newCentroids);
+    listCount = newListCount;
+    if (!saveCentroids()) {
+        return false;
+    }
+
+    listColumn.file.seek(0);
+    listColumn.file.write(reinterpret_cast<const char *>(assignments.data()), assignments.size() * sizeof(quint16));
+    listColumn.file.flush();
+
+    lists.assign(listCount, {});
+    unassigned.clear();
+    for (quint64 row = 0; row < assignments.size(); ++row) {
+        lists[assignments[row]].push_back(static_cast<quint32>(row));
+    }
+
+    qDebug() << "SightingsIndex: trained" << listCount << "lists over" << rows << "sightings in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool SightingsIndex::loadCentroids()
+{
+    centroids.clear();
+    listCount = 0;
+
+    QFile file(QDir(directory).filePath("centroids.f32"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    quint32 header[2];
+    qint32 params[2];
+    if (file.read(reinterpret_cast<char *>(header), sizeof(header)) != sizeof(header)
+        || header[0] != centroidsMagic || header[1] != centroidsVersion
+        || file.read(reinterpret_cast<char *>(params), sizeof(params)) != sizeof(params)
+        || params[0] <= 0 || params[0] >= unassignedList || params[1] != dimensions) {
+        qDebug() << "SightingsIndex: ignoring incompatible centroids file" << file.fileName();
+        return false;
+    }
+
+    std::vector<float> loaded(static_cast<size_t>(params[0]) * dimensions);
+    qint64 bytes = static_cast<qint64>(loaded.size() * sizeof(float));
+    if (file.read(reinterpret_cast<char *>(loaded.data()), bytes) != bytes) {
+        qDebug() << "SightingsIndex: truncated centroids file" << file.fileName();
+        return false;
+    }
+
+    centroids = std::move(loaded);
+    listCount = params[0];
+    return true;
+}
+
+bool SightingsIndex::saveCentroids() const
+{
+    // Written aside and renamed, a crash keeps the previous centroids
+    QSaveFile file(QDir(directory).filePath("centroids.f32"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "SightingsIndex: cannot write centroids" << file.errorString();
+        return false;
+    }
+
+    quint32 header[] = {centroidsMagic, centroidsVersion};
+    qint32 params[] = {listCount, dimensions};
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(params), sizeof(params));
+    file.write(reinterpret_cast<const char *>(centroids.data()), centroids.size() * sizeof(float));
+    return file.commit();
+}
+
+void SightingsIndex::benchmark(int rowCount, int queryCount)
+{
+    QTemporaryDir temporary;
+    if (!temporary.isValid()) {
+        qDebug() << "SightingsIndex benchmark: no temporary directory";
+        return;
+    }
+
+    std::mt19937 generator(7);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    // A few hundred thousand people, each seen about 20 times
+    int identities = std::max(1, rowCount / 20);
+    std::vector<dlib::matrix<float, 0, 1>> people(identities);
+    for (auto &person : people) {
+        person.set_size(dimensions);
+        for (int i = 0; i < dimensions; ++i) {
+            person(i) = normal(generator) * 0.09f;
+        }
+    }
+    auto jitter = [&](const dlib::matrix<float, 0, 1> &person) {
+        dlib::matrix<float, 0, 1> encoding(dimensions);
+        for (int i = 0; i < dimensions; ++i) {
+            encoding(i) = person(i) + normal(generator) * 0.02f;
+        }
+        return encoding;
+    };
+
+    SightingsIndex index(temporary.path());
+    index.open();
+
+    std::uniform_int_distribution<int> pickPerson(0, identities - 1);
+    std::uniform_int_distribution<int> pickCamera(0, 7);
+    QDateTime start = QDateTime::currentDateTime().addDays(-7);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int row = 0; row < rowCount; ++row) {
+        index.append(QString("Camera %1").arg(pickCamera(generator)), start.addMSecs(row * 600LL),
+                     jitter(people[pickPerson(generator)]), QImage());
+    }
+    index.flush();
+    index.trainPool.waitForDone();
+    qDebug() << "SightingsIndex benchmark: appended" << rowCount << "rows in" << timer.elapsed() << "ms";
+
+    if (!index.isTrained()) {
+        timer.restart();
+        index.train();
+        qDebug() << "SightingsIndex benchmark: trained in" << timer.elapsed() << "ms";
+    }
+
+    std::vector<dlib::matrix<float, 0, 1>> queries;
+    for (int i = 0; i < queryCount; ++i) {
+        queries.push_back(jitter(people[pickPerson(generator)]));
+    }
+
+    // Scanning every list is the exact answer
+    Query exactQuery;
+    exactQuery.limit = 50;
+    exactQuery.probes = index.listCount;
+    std::vector<QVector<Sighting>> exact;
+    timer.restart();
+    for (const auto &query : queries) {
+        exact.push_back(index.search(query, exactQuery));
+    }
+    qDebug() << "SightingsIndex benchmark: full scan" << timer.nsecsElapsed() / 1000000.0 / queryCount << "ms/query";
+
+    for (int probes : {4, 8, 16, 32}) {
+        Query query = exactQuery;
+        query.probes = probes;
+        int hits = 0;
+        int expected = 0;
+        timer.restart();
+        qint64 searchNs = 0;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            timer.restart();
+            QVector<Sighting> approx = index.search(queries[q], query);
+            searchNs += timer.nsecsElapsed();
+
+            QSet<quint64> found;
+            for (const Sighting &sighting : approx) {
+                found.insert(sighting.row);
+            }
+            for (const Sighting &sighting : exact[q]) {
+                hits += found.contains(sighting.row) ? 1 : 0;
+            }
+            expected += exact[q].size();
+        }
+        qDebug() << "SightingsIndex benchmark: probes" << probes
+                 << "recall" << (expected > 0 ? double(hits) / expected : 1.0)
+                 << searchNs / 1000000.0 / queryCount << "ms/query";
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef SIGHTINGSINDEX_H
+#define SIGHTINGSINDEX_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <vector>
+
+#include <dlib/matrix.h>
+#include <opencv2/core.hpp>
+
+// Every embedded face the cameras have seen, for "when was this person here"
+// questions over the recorded history.
+//
+// Rows are append-only and stored column by column in one directory: capture
+// time, camera, inverted list, quantisation scale and the encoding as int8
+// codes (132 bytes a face instead of 512). The columns are memory mapped for
+// search. Once enough rows exist an IVF index (k-means centroids) is trained
+// in the background and a query only scans the few lists nearest to it; until
+// then every row is scanned. Thumbnails live next to the columns, named after
+// their row.
+class SightingsIndex
+{
+public:
+    struct Sighting
+    {
+        quint64 row;
+        QString cameraName;
+        QDateTime seenAt;
+        float distance;
+        QString thumbnailPath;
+    };
+
+    struct Query
+    {
+        QDateTime from;            // Invalid for no lower bound
+        QDateTime to;              // Invalid for no upper bound
+        QStringList cameras;       // Empty for every camera
+        double maxDistance = 0.6;  // Same scale as the recognition threshold
+        int limit = 100;
+        int probes = 16;           // Lists scanned once the index is trained
+    };
+
+    enum Mode
+    {
+        ReadWrite,
+        ReadOnly  // For searching from another process, never writes
+    };
+
+    explicit SightingsIndex(const QString &directory);
+    ~SightingsIndex();
+
+    // Creates the directory if needed and drops any row a crash left half
+    // written. Read-only, a half written row is only left out: the running
+    // app may be in the middle of appending it.
+    bool open(Mode mode = ReadWrite);
+    void close();
+
+    quint64 size() const;
+    bool isTrained() const;
+
+    bool append(const QString &cameraName, const QDateTime &seenAt, const dlib::matrix<float, 0, 1> &encoding,
+                const QImage &chip);
+    void flush();
+
+    // Ranked by distance, best first
+    QVector<Sighting> search(const dlib::matrix<float, 0, 1> &encoding, const Query &query);
+    QVector<Sighting> searchImage(const cv::Mat &image, const Query &query, QString *error = nullptr);
+    QVector<Sighting> searchIdentity(QSqlDatabase facesDb, qint64 faceId, const Query &query, QString *error = nullptr);
+
+    // k-means over a sample of the rows, then every row is put on the list of
+    // its nearest centroid. Runs on the caller's thread, appends and searches
+    // stay possible meanwhile.
+    bool train(int listCount = 256);
+
+    // Rows before the index trains itself
+    static const int trainThreshold = 50000;
+
+    // Builds a synthetic index and reports search latency and recall of the
+    // IVF lists against a full scan
+    static void benchmark(int rows, int queryCount);
+
+private:
+    struct Column
+    {
+        QFile file;
+        int width = 0;
+        uchar *map = nullptr;
+        quint64 mappedRows = 0;
+    };
+
+    QString directory;
+    mutable QMutex mutex;
+
+    Column timeColumn;    // qint64 msecs since epoch
+    Column cameraColumn;  // quint16 into cameraNames
+    Column listColumn;    // quint16 list, unassignedList before training
+    Column scaleColumn;   // float
+    Column codeColumn;    // dimensions x qint8
+
+    quint64 rows = 0;
+    quint64 unflushedRows = 0;
+    bool opened = false;
+    bool readOnly = false;
+
+    QStringList cameraNames;
+    QHash<QString, quint16> cameraIds;
+
+    std::vector<float> centroids; // list x dimensions
+    int listCount = 0;
+    std::vector<std::vector<quint32>> lists;
+    std::vector<quint32> unassigned;
+
+    QThreadPool trainPool;
+    std::atomic<bool> training{false};
+
+    static const int dimensions = 128;
+    static const quint16 unassignedList = 0xFFFF;
+
+    bool openColumn(Column &column, const QString &name, int width, QIODevice::OpenMode mode);
+    bool mapColumns();
+    void unmapColumns();
+    bool appendCamera(const QString &cameraName, quint16 &id);
+    bool loadCentroids();
+    bool saveCentroids() const;
+
+    int nearestList(const float *encoding) const;
+    void decode(quint64 row, float *out) const;
+    float distance(const float *query, quint64 row) const;
+
+    QString thumbnailPath(quint64 row) const;
+};
+
+#endif // SIGHTINGSINDEX_H
@@ -0,0 +1,443 @@
+#include "storagemanager.h"
+#include "continuousrecorder.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStorageInfo>
+#include <algorithm>
+
+const QString StorageManager::eventsPool = "events";
+const QString StorageManager::continuousPool = "continuous";
+const QString StorageManager::archivePool = "archive";
+
+namespace {
+
+QString assignmentKey(const QString &pool, const QString &cameraName)
+{
+    return pool + '\n' + cameraName;
+}
+
+} // namespace
+
+StorageManager::StorageManager()
+{
+    scanPool.setMaxThreadCount(1);
+}
+
+StorageManager::~StorageManager()
+{
+    scanPool.waitForDone();
+}
+
+void StorageManager::load(QSqlDatabase db)
+{
+    QSqlQuery query(db);
+    if (!query.exec("CREATE TABLE IF NOT EXISTS storage_targets ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                    "pool TEXT NOT NULL,"
+                    "path TEXT NOT NULL,"
+                    "quota_gb REAL,"
+                    "enabled INTEGER NOT NULL DEFAULT 1,"
+                    "UNIQUE (pool, path)"
+                    ")")) {
+        qDebug() << "Error creating storage_targets table:" << query.lastError().text();
+        return;
+    }
+
+    // Before pools, event clips went to the web server's folder, continuous
+    // segments to the storage root and closing footage to the working folder.
+    // The first two come from recording_settings, and are also where a pool
+    // whose targets were all removed writes to.
+    ContinuousRecorder::Settings settings = ContinuousRecorder::loadSettings(db);
+    QHash<QString, QString> roots = {
+        {eventsPool, settings.eventsRoot},
+        {continuousPool, settings.storageRoot},
+        {archivePool, "."}};
+    for (auto it = roots.begin(); it != roots.end(); ++it) {
+        *it = QDir::cleanPath(QDir(*it).absolutePath());
+    }
+
+    if (query.exec("SELECT COUNT(*) FROM storage_targets") && query.next() && query.value(0).toInt() == 0) {
+        const QList<QPair<QString, QString>> defaults = {
+            {eventsPool, roots.value(eventsPool)},
+            {continuousPool, roots.value(continuousPool)},
+            {archivePool, roots.value(archivePool)}};
+        for (const auto &target : defaults) {
+            query.prepare("INSERT INTO storage_targets (pool, path) VALUES (:pool, :path)");
+            query.bindValue(":pool", target.first);
+            query.bindValue(":path", target.second);
+            if (!query.exec()) {
+                qDebug() << "Error adding storage target" << target.second << ":" << query.lastError().text();
+            }
+        }
+    }
+
+    QVector<TargetState> loaded;
+    if (!query.exec("SELECT id, pool, path, quota_gb, enabled FROM storage_targets ORDER BY id")) {
+        qDebug() << "Error loading storage targets:" << query.lastError().text();
+        return;
+    }
+    while (query.next()) {
+        TargetState state;
+        state.target.id = query.value(0).toLongLong();
+        state.target.pool = query.value(1).toString();
+        state.target.path = QDir::cleanPath(QDir(query.value(2).toString()).absolutePath());
+        state.target.quotaBytes = static_cast<qint64>(std::max(0.0, query.value(3).toDouble()) * 1024 * 1024 * 1024);
+        state.target.enabled = query.value(4).toInt() != 0;
+
+        if (!QDir().mkpath(state.target.path)) {
+            qDebug() << "Storage target" << state.target.path << "cannot be created";
+        }
+        loaded.append(state);
+    }
+
+    // What the targets already hold counts against their quotas. Segments
+    // are catalogued with their sizes. Event clips and closing footage lie
+    // right in their target, beside whatever else shares the folder, and are
+    // measured on the scan thread.
+    QHash<int, qint64> segments = segmentsSize(db, loaded);
+    QStringList clipFolders;
+    for (int i = 0; i < loaded.size(); ++i) {
+        if (loaded[i].target.pool == continuousPool) {
+            loaded[i].usedBytes = segments.value(i);
+        } else if (!clipFolders.contains(loaded[i].target.path)) {
+            clipFolders.append(loaded[i].target.path);
+        }
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        // Until the scan is done a kept folder goes on with what it had
+        for (TargetState &state : loaded) {
+            for (const TargetState &previous : states) {
+                if (state.target.pool != continuousPool && previous.target.pool == state.target.pool
+                    && previous.target.path == state.target.path) {
+                    state.usedBytes = previous.usedBytes;
+                }
+            }
+        }
+        states = loaded;
+        defaultRoots = roots;
+        assignments.clear();
+        spaceCheckedAt = QDateTime();
+    }
+    refreshSpace();
+
+    {
+        QMutexLocker locker(&mutex);
+        for (const TargetState &state : states) {
+            qDebug() << "Storage target" << state.target.pool << state.target.path
+                     << "used" << state.usedBytes / (1024 * 1024) << "MB, free" << state.bytesAvailable / (1024 * 1024) << "MB";
+        }
+    }
+
+    scanPool.start([this, clipFolders]() {
+        QHash<QString, qint64> sizes;
+        for (const QString &folder : clipFolders) {
+            sizes.insert(folder, clipsSize(folder));
+        }
+
+        // By path, the targets may have been reloaded meanwhile
+        QMutexLocker locker(&mutex);
+        for (TargetState &state : states) {
+            auto it = sizes.constFind(state.target.path);
+            if (state.target.pool != continuousPool && it != sizes.constEnd()) {
+                state.usedBytes = *it;
+                qDebug() << "Storage target" << state.target.pool << state.target.path
+                         << "holds" << state.usedBytes / (1024 * 1024) << "MB of clips";
+            }
+        }
+    });
+}
+
+QString StorageManager::targetFor(const QString &pool, const QString &cameraName)
+{
+    refreshSpace();
+    QMutexLocker locker(&mutex);
+
+    QString key = assignmentKey(pool, cameraName);
+    int current = assignments.value(key, -1);
+    if (current >= 0 && current < states.size() && usable(states[current])) {
+        return states[current].target.path;
+    }
+
+    // Least loaded target: the bandwidth its cameras need, this one
+    // included, against the rate it has been writing at
+    double cameraRate = cameraRates.value(cameraName, defaultCameraRate);
+    int chosen = -1;
+    double chosenLoad = 0.0;
+    for (int i = 0; i < states.size(); ++i) {
+        if (states[i].target.pool != pool || !usable(states[i])) {
+            continue;
+        }
+        double writeRate = states[i].writeBps > 0 ? states[i].writeBps : defaultWriteRate;
+        double load = (assignedRate(i) + cameraRate) / writeRate;
+        if (chosen == -1 || load < chosenLoad
+            || (load == chosenLoad && states[i].bytesAvailable > states[chosen].bytesAvailable)) {
+            chosen = i;
+            chosenLoad = load;
+        }
+    }
+
+    // Every target is full or failing, a file on the emptiest disk beats none
+    if (chosen == -1) {
+        for (int i = 0; i < states.size(); ++i) {
+            if (states[i].target.pool == pool && states[i].target.enabled
+                && (chosen == -1 || states[i].bytesAvailable > states[chosen].bytesAvailable)) {
+                chosen = i;
+            }
+        }
+        if (chosen == -1) {
+            QString root = defaultRoots.value(pool);
+            qDebug() << "No storage target in pool" << pool << ", writing to" << root;
+            if (!root.isEmpty()) {
+                QDir().mkpath(root);
+            }
+            return root;
+        }
+        qDebug() << "No usable storage target in pool" << pool << ", writing to" << states[chosen].target.path;
+    }
+
+    if (chosen != current) {
+        qDebug() << "Storage:" << cameraName << pool << "recordings go to" << states[chosen].target.path;
+        assignments.insert(key, chosen);
+    }
+    return states[chosen].target.path;
+}
+
+void StorageManager::recordWrite(const QString &cameraName, const QString &filePath, qint64 bytes, qint64 mediaMs,
+                                 qint64 elapsedMs, bool ok)
+{
+    QMutexLocker locker(&mutex);
+    int index = stateFor(filePath);
+
+    if (ok && mediaMs > 0 && bytes > 0) {
+        double rate = bytes * 1000.0 / mediaMs;
+        double previous = cameraRates.value(cameraName, 0.0);
+        cameraRates.insert(cameraName, previous > 0 ? 0.8 * previous + 0.2 * rate : rate);
+    }
+
+    if (index == -1) {
+        return;
+    }
+    TargetState &state = states[index];
+    if (!ok) {
+        ++state.failures;
+        ++state.failedInARow;
+        state.lastFailure = QDateTime::currentDateTime();
+        qDebug() << "Storage: write failed on" << state.target.path << "(" << state.failedInARow << "in a row)";
+        return;
+    }
+
+    state.failedInARow = 0;
+    ++state.writes;
+    state.bytesWritten += bytes;
+    state.usedBytes += bytes;
+    if (state.bytesAvailable >= 0) {
+        state.bytesAvailable = std::max<qint64>(0, state.bytesAvailable - bytes);
+    }
+
+    // Encoding and writing together, what a camera on this target waits for
+    if (elapsedMs > 0) {
+        double rate = bytes * 1000.0 / elapsedMs;
+        state.writeBps = state.writeBps > 0 ? 0.8 * state.writeBps + 0.2 * rate : rate;
+    }
+}
+
+void StorageManager::recordRemoved(const QString &filePath, qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    int index = stateFor(filePath);
+    if (index == -1) {
+        return;
+    }
+    states[index].usedBytes = std::max<qint64>(0, states[index].usedBytes - bytes);
+    if (states[index].bytesAvailable >= 0) {
+        states[index].bytesAvailable += bytes;
+    }
+}
+
+QVector<StorageManager::Target> StorageManager::targets(const QString &pool) const
+{
+    QMutexLocker locker(&mutex);
+    QVector<Target> result;
+    for (const TargetState &state : states) {
+        if (pool.isEmpty() || state.target.pool == pool) {
+            result.append(state.target);
+        }
+    }
+    return result;
+}
+
+QVector<StorageManager::Metrics> StorageManager::metrics()
+{
+    refreshSpace();
+    QMutexLocker locker(&mutex);
+
+    QVector<Metrics> result;
+    for (int i = 0; i < states.size(); ++i) {
+        const TargetState &state = states[i];
+        Metrics metrics;
+        metrics.pool = state.target.pool;
+        metrics.path = state.target.path;
+        metrics.bytesAvailable = state.bytesAvailable;
+        metrics.usedBytes = state.usedBytes;
+        metrics.quotaBytes = state.target.quotaBytes;
+        metrics.writeMBps = state.writeBps / (1024 * 1024);
+        metrics.bytesWritten = state.bytesWritten;
+        metrics.writes = state.writes;
+        metrics.failures = state.failures;
+        metrics.cameras = static_cast<int>(std::count(assignments.cbegin(), assignments.cend(), i));
+        metrics.usable = usable(state);
+        result.append(metrics);
+    }
+    return result;
+}
+
+void StorageManager::logMetrics()
+{
+    for (const Metrics &target : metrics()) {
+        if (target.writes == 0 && target.failures == 0) {
+            continue;
+        }
+        qDebug().noquote() << QString("Storage %1 %2: %3 MB/s, %4 writes, %5 failed, %6 MB written, %7 cameras, %8 MB free%9")
+                                  .arg(target.pool, target.path)
+                                  .arg(target.writeMBps, 0, 'f', 1)
+                                  .arg(target.writes)
+                                  .arg(target.failures)
+                                  .arg(target.bytesWritten / (1024 * 1024))
+                                  .arg(target.cameras)
+                                  .arg(target.bytesAvailable / (1024 * 1024))
+                                  .arg(target.usable ? "" : ", not usable");
+    }
+}
+
+qint64 StorageManager::clipsSize(const QString &path)
+{
+    // Only finished clips, not the snapshots, thumbnails or staging folders
+    // that may share the folder, and not its subfolders
+    qint64 size = 0;
+    const QFileInfoList clips = QDir(path).entryInfoList({"*.mp4"}, QDir::Files);
+    for (const QFileInfo &clip : clips) {
+        size += clip.size();
+    }
+    return size;
+}
+
+QHash<int, qint64> StorageManager::segmentsSize(QSqlDatabase db, const QVector<TargetState> &targets)
+{
+    QHash<int, qint64> totals;
+    QSqlQuery query(db);
+    query.prepare("SELECT COALESCE(SUM(size_bytes), 0) FROM recording_segments WHERE substr(file_name, 1, :length) = :prefix");
+    for (int i = 0; i < targets.size(); ++i) {
+        if (targets[i].target.pool != continuousPool) {
+            continue;
+        }
+        query.bindValue(":length", targets[i].target.path.size() + 1);
+        query.bindValue(":prefix", targets[i].target.path + '/');
+        if (!query.exec() || !query.next()) {
+            qDebug() << "Error measuring segments in" << targets[i].target.path << ":" << query.lastError().text();
+            continue;
+        }
+        totals.insert(i, query.value(0).toLongLong());
+    }
+
+    // Segments under a nested target count for that one only, so each
+    // target gives up what its directly nested targets hold
+    auto inside = [&targets](int inner, int outer) {
+        return targets[inner].target.path.startsWith(targets[outer].target.path + '/');
+    };
+    QHash<int, qint64> sizes = totals;
+    for (auto outer = totals.cbegin(); outer != totals.cend(); ++outer) {
+        for (auto inner = totals.cbegin(); inner != totals.cend(); ++inner) {
+            if (!inside(inner.key(), outer.key())) {
+                continue;
+            }
+            bool direct = std::none_of(totals.keyBegin(), totals.keyEnd(), [&](int between) {
+                return inside(inner.key(), between) && inside(between, outer.key());
+            });
+            if (direct) {
+                sizes[outer.key()] -= inner.value();
+            }
+        }
+    }
+    return sizes;
+}
+
+void StorageManager::refreshSpace()
+{
+    // Free space moves with every other writer on the disk, so it is read
+    // again every few seconds. The disks are asked without the mutex held,
+    // a slow or unreachable mount must not hold up the other writers.
+    QStringList paths;
+    {
+        QMutexLocker locker(&mutex);
+        QDateTime now = QDateTime::currentDateTime();
+        if (spaceCheckedAt.isValid() && spaceCheckedAt.msecsTo(now) < spaceCheckMs) {
+            return;
+        }
+        spaceCheckedAt = now;
+        for (const TargetState &state : states) {
+            paths.append(state.target.path);
+        }
+    }
+
+    QHash<QString, qint64> available;
+    for (const QString &path : paths) {
+        QStorageInfo storage(path);
+        available.insert(path, storage.isValid() && storage.isReady() ? storage.bytesAvailable() : -1);
+    }
+
+    // By path, the targets may have been reloaded meanwhile
+    QMutexLocker locker(&mutex);
+    for (TargetState &state : states) {
+        auto it = available.constFind(state.target.path);
+        if (it != available.constEnd()) {
+            state.bytesAvailable = *it;
+        }
+    }
+}
+
+bool StorageManager::usable(const TargetState &state) const
+{
+    if (!state.target.enabled) {
+        return false;
+    }
+    if (state.failedInARow >= failuresBeforeSkip && state.lastFailure.secsTo(QDateTime::currentDateTime()) < failureBackoffSecs) {
+        return false;
+    }
+    if (state.bytesAvailable >= 0 && state.bytesAvailable < reserveBytes) {
+        return false;
+    }
+    return state.target.quotaBytes == 0 || state.usedBytes < state.target.quotaBytes;
+}
+
+int StorageManager::stateFor(const QString &filePath) const
+{
+    // The deepest target holding the file, targets may be nested
+    QString path = QDir::cleanPath(QFileInfo(filePath).absoluteFilePath());
+    int found = -1;
+    for (int i = 0; i < states.size(); ++i) {
+        const QString &root = states[i].target.path;
+        bool inside = path.startsWith(root + '/') || (root.endsWith('/') && path.startsWith(root));
+        if (inside && (found == -1 || root.size() > states[found].target.path.size())) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+double StorageManager::assignedRate(int index) const
+{
+    double rate = 0.0;
+    for (auto it = assignments.cbegin(); it != assignments.cend(); ++it) {
+        if (it.value() == index) {
+            rate += cameraRates.value(it.key().section('\n', 1), defaultCameraRate);
+        }
+    }
+    return rate;
+}
@@ -0,0 +1,119 @@
+#ifndef STORAGEMANAGER_H
+#define STORAGEMANAGER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+// Decides which disk each recording goes to. Targets are folders on any
+// mount, grouped into pools by what is written there (event clips,
+// continuous segments, the footage saved when a camera closes), and listed
+// in the storage_targets table of cameras.db with an optional quota each.
+// The camera settings add, remove and edit them.
+//
+// Every camera sticks to one target per pool so its files stay together. A
+// new camera, or one whose target filled up or started failing, goes to the
+// target whose measured throughput has the most bandwidth to spare. Writers
+// report each file with recordWrite(), which feeds the per target
+// throughput, the used bytes against the quota and the camera's own rate.
+// What a target already held comes from recording_segments, or for clips
+// that are not catalogued there, from a scan off the caller's thread.
+//
+// Thread-safe: recording threads, the continuous recorder and the janitor
+// share one instance.
+class StorageManager
+{
+public:
+    static const QString eventsPool;
+    static const QString continuousPool;
+    static const QString archivePool;
+
+    struct Target
+    {
+        qint64 id = 0;
+        QString pool;
+        QString path;
+        qint64 quotaBytes = 0; // 0 is no quota
+        bool enabled = true;
+    };
+
+    struct Metrics
+    {
+        QString pool;
+        QString path;
+        qint64 bytesAvailable = -1;
+        qint64 usedBytes = 0;
+        qint64 quotaBytes = 0;
+        double writeMBps = 0.0;  // Smoothed over recent writes
+        qint64 bytesWritten = 0; // Since startup
+        int writes = 0;
+        int failures = 0;
+        int cameras = 0;
+        bool usable = false;
+    };
+
+    StorageManager();
+    ~StorageManager();
+
+    // Creates storage_targets, seeding it with the folders used before pools
+    // existed, and reads the targets. Also called again after the targets
+    // were edited in the settings. Does not walk the disks itself.
+    void load(QSqlDatabase db);
+
+    // Folder for the camera's next file in the pool. Falls back to the
+    // target with the most free space when none is usable, and to the
+    // pool's root in recording_settings when it has no targets.
+    QString targetFor(const QString &pool, const QString &cameraName);
+
+    // A file finished writing: mediaMs of footage took elapsedMs to write
+    void recordWrite(const QString &cameraName, const QString &filePath, qint64 bytes, qint64 mediaMs, qint64 elapsedMs, bool ok);
+    void recordRemoved(const QString &filePath, qint64 bytes);
+
+    QVector<Target> targets(const QString &pool) const;
+    QVector<Metrics> metrics();
+    void logMetrics();
+
+private:
+    struct TargetState
+    {
+        Target target;
+        qint64 bytesAvailable = -1;
+        qint64 usedBytes = 0;
+        double writeBps = 0.0;
+        qint64 bytesWritten = 0;
+        int writes = 0;
+        int failures = 0;
+        int failedInARow = 0;
+        QDateTime lastFailure;
+    };
+
+    mutable QMutex mutex;
+    QVector<TargetState> states;
+    QHash<QString, int> assignments;    // pool + camera -> index into states
+    QHash<QString, double> cameraRates; // Bytes per second of footage, per camera
+    QHash<QString, QString> defaultRoots; // Per pool, used while it has no targets
+    QDateTime spaceCheckedAt;
+
+    static const qint64 reserveBytes = 1024LL * 1024 * 1024; // Kept free on every disk
+    static const int spaceCheckMs = 10000;
+    static const int failuresBeforeSkip = 3;
+    static const int failureBackoffSecs = 300;
+    static constexpr double defaultCameraRate = 250000.0;   // About 2 Mbit/s until measured
+    static constexpr double defaultWriteRate = 50000000.0;  // Until the target is measured
+
+    static qint64 clipsSize(const QString &path);
+    static QHash<int, qint64> segmentsSize(QSqlDatabase db, const QVector<TargetState> &targets);
+    void refreshSpace(); // Takes the mutex itself, not to be called with it held
+    bool usable(const TargetState &state) const;
+    int stateFor(const QString &filePath) const;
+    double assignedRate(int index) const;
+
+    QThreadPool scanPool; // Measures clip folders, last so it is waited for first
+};
+
+#endif // STORAGEMANAGER_H
@@ -0,0 +1,165 @@
+#include "timelinebar.h"
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+TimelineBar::TimelineBar(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumHeight(64);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    setCursor(Qt::PointingHandCursor);
+}
+
+void TimelineBar::setHistory(const HistoryView &view)
+{
+    history = view;
+    thumbnails.clear();
+    refresh();
+}
+
+void TimelineBar::setRange(int first, int last)
+{
+    if (first != firstIndex) {
+        thumbnails.clear();
+    }
+    firstIndex = first;
+    lastIndex = last;
+    from = history.timestamp(first);
+    to = history.timestamp(last);
+    refresh();
+}
+
+void TimelineBar::setPosition(int index)
+{
+    if (index == position) {
+        return;
+    }
+    position = index;
+    update();
+}
+
+void TimelineBar::refresh()
+{
+    if (lastIndex >= 0) {
+        to = history.timestamp(lastIndex);
+    }
+    heat.clear();
+    update();
+}
+
+QDateTime TimelineBar::timeAt(int x) const
+{
+    qint64 span = from.msecsTo(to);
+    return from.addMSecs(span * std::clamp(x, 0, width()) / std::max(1, width()));
+}
+
+int TimelineBar::xAt(const QDateTime &time) const
+{
+    qint64 span = std::max<qint64>(1, from.msecsTo(to));
+    return static_cast<int>(from.msecsTo(time) * width() / span);
+}
+
+QImage TimelineBar::thumbnailAt(const QDateTime &time)
+{
+    qint64 second = time.toSecsSinceEpoch();
+    auto it = thumbnails.constFind(second);
+    if (it != thumbnails.constEnd()) {
+        return it.value();
+    }
+
+    // Tiles land on other seconds as the range changes or grows, start over
+    // rather than keep every one ever shown
+    if (thumbnails.size() > maxThumbnails) {
+        thumbnails.clear();
+    }
+
+    QImage image;
+    cv::Mat thumbnail = history.thumbnailAt(time);
+    if (thumbnail.channels() == 3) {
+        cv::Mat rgb;
+        cv::cvtColor(thumbnail, rgb, cv::COLOR_BGR2RGB);
+        image = QImage(rgb.data, rgb.cols, rgb.rows, rgb.step, QImage::Format_RGB888).copy();
+    }
+    thumbnails.insert(second, image);
+    return image;
+}
+
+void TimelineBar::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    if (!from.isValid() || !to.isValid() || width() <= 0) {
+        return;
+    }
+
+    // Filmstrip, one 16:9 tile per slot showing the start of its time span
+    int stripHeight = height() - heatHeight;
+    int tileWidth = std::max(1, stripHeight * 16 / 9);
+    for (int x = 0; x < width(); x += tileWidth) {
+        QImage image = thumbnailAt(timeAt(x));
+        if (!image.isNull()) {
+            painter.drawImage(QRect(x, 0, tileWidth, stripHeight), image);
+        }
+    }
+
+    // Heatmap, scaled to the busiest column so quiet days still show
+    if (heat.size() != width()) {
+        heat = history.activity(from, to, width());
+    }
+    int peak = 1;
+    for (const QPair<int, int> &column : heat) {
+        peak = std::max(peak, column.first + column.second);
+    }
+    for (int x = 0; x < heat.size(); ++x) {
+        const QPair<int, int> &column = heat[x];
+        if (column.first == 0 && column.second == 0) {
+            continue;
+        }
+        int alpha = 60 + 195 * (column.first + column.second) / peak;
+        QColor colour = column.second > 0 ? QColor(255, 0, 0, alpha) : QColor(255, 140, 0, alpha);
+        painter.fillRect(QRect(x, stripHeight, 1, heatHeight), colour);
+    }
+
+    // Playhead
+    QDateTime playhead = history.timestamp(position);
+    if (playhead.isValid()) {
+        int x = xAt(playhead);
+        painter.setPen(QPen(Qt::white, 2));
+        painter.drawLine(x, 0, x, height());
+    }
+}
+
+void TimelineBar::mousePressEvent(QMouseEvent *event)
+{
+    seek(event->position().toPoint().x());
+}
+
+void TimelineBar::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() & Qt::LeftButton) {
+        seek(event->position().toPoint().x());
+    }
+}
+
+void TimelineBar::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    heat.clear();
+}
+
+void TimelineBar::seek(int x)
+{
+    if (firstIndex < 0 || lastIndex < firstIndex) {
+        return;
+    }
+    int index = history.indexAt(timeAt(x));
+    if (index < 0) {
+        return;
+    }
+    emit seekRequested(std::clamp(index, firstIndex, lastIndex));
+}
@@ -0,0 +1,62 @@
+#ifndef TIMELINEBAR_H
+#define TIMELINEBAR_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QVector>
+#include <QWidget>
+#include "framehistory.h"
+
+// Scrub bar over the rewind range: a filmstrip of the history's per-second
+// thumbnails with a heatmap of motion (orange) and faces (red) underneath
+// and the playhead on top. Clicking or dragging seeks.
+//
+// Everything comes from what the history gathered at capture time. Thumbnails
+// are only turned into QImages when a tile is first painted, then kept.
+class TimelineBar : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TimelineBar(QWidget *parent = nullptr);
+
+    void setHistory(const HistoryView &history);
+
+    // History indexes the bar covers, the rewind slider's range
+    void setRange(int first, int last);
+    void setPosition(int index);
+
+    // The history grew (live tail), re-read the activity
+    void refresh();
+
+signals:
+    void seekRequested(int index);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    HistoryView history;
+    int firstIndex = -1;
+    int lastIndex = -1;
+    int position = -1;
+    QDateTime from;
+    QDateTime to;
+
+    QVector<QPair<int, int>> heat;  // Per pixel column, empty until painted
+    QHash<qint64, QImage> thumbnails; // By secs since epoch
+
+    static const int heatHeight = 10;
+    static const int maxThumbnails = 512;
+
+    QDateTime timeAt(int x) const;
+    int xAt(const QDateTime &time) const;
+    QImage thumbnailAt(const QDateTime &time);
+    void seek(int x);
+};
+
+#endif // TIMELINEBAR_H
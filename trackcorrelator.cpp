@@ -0,0 +1,232 @@
+#include "trackcorrelator.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <algorithm>
+#include <limits>
+
+TrackCorrelator::TrackCorrelator(double matchThreshold, int maxGapSeconds, int closeAfterSeconds)
+    : matchThreshold(matchThreshold), maxGapSeconds(maxGapSeconds), closeAfterSeconds(closeAfterSeconds)
+{
+}
+
+void TrackCorrelator::loadAdjacency(QSqlDatabase db)
+{
+    adjacency.clear();
+
+    QSqlQuery query("SELECT camera_a, camera_b, min_seconds, max_seconds FROM camera_adjacency", db);
+    if (query.lastError().isValid()) {
+        qDebug() << "Error reading camera adjacency:" << query.lastError().text();
+        return;
+    }
+
+    // Walking is the same either way
+    while (query.next()) {
+        QString cameraA = query.value(0).toString();
+        QString cameraB = query.value(1).toString();
+        Transit transit{query.value(2).toInt(), query.value(3).toInt()};
+        adjacency[cameraA][cameraB] = transit;
+        adjacency[cameraB][cameraA] = transit;
+    }
+    qDebug() << "Camera adjacency loaded for" << adjacency.size() << "cameras";
+}
+
+QString TrackCorrelator::localKey(const QString &camera, int localTrackId)
+{
+    return camera + '\n' + QString::number(localTrackId);
+}
+
+bool TrackCorrelator::canFollow(const PersonTrack &person, const QString &camera, int localTrackId, const QDateTime &seenAt) const
+{
+    const Segment *last = nullptr;
+    for (const Segment &segment : person.segments) {
+        // Two faces on one camera at the same moment are two people
+        if (segment.camera == camera && segment.localTrackId != localTrackId && segment.end.msecsTo(seenAt) < 1000) {
+            return false;
+        }
+        if (!last || segment.end > last->end) {
+            last = &segment;
+        }
+    }
+    if (!last) {
+        return false;
+    }
+
+    qint64 gap = last->end.secsTo(seenAt);
+    if (gap > maxGapSeconds) {
+        return false;
+    }
+    if (last->camera == camera || adjacency.isEmpty()) {
+        return true;
+    }
+
+    auto from = adjacency.constFind(last->camera);
+    if (from == adjacency.constEnd()) {
+        return false;
+    }
+    auto transit = from->constFind(camera);
+    return transit != from->constEnd() && gap >= transit->minSeconds && gap <= transit->maxSeconds;
+}
+
+void TrackCorrelator::update(PersonTrack &person, const QString &camera, int localTrackId, const QDateTime &seenAt, qint64 matchedId)
+{
+    for (int i = person.segments.size() - 1; i >= 0; --i) {
+        Segment &segment = person.segments[i];
+        if (segment.camera == camera && segment.localTrackId == localTrackId) {
+            segment.end = std::max(segment.end, seenAt);
+            break;
+        }
+    }
+    person.lastSeen = std::max(person.lastSeen, seenAt);
+    if (matchedId != -1) {
+        person.matchedId = matchedId;
+    }
+}
+
+qint64 TrackCorrelator::observe(const QString &camera, int localTrackId, const QDateTime &seenAt,
+                                const dlib::matrix<float, 0, 1> &encoding, double quality, qint64 matchedId)
+{
+    QString key = localKey(camera, localTrackId);
+    double weight = std::max(quality, 0.05);
+
+    auto bound = localTracks.constFind(key);
+    if (bound != localTracks.constEnd()) {
+        PersonTrack &person = open[bound.value()];
+        update(person, camera, localTrackId, seenAt, matchedId);
+
+        // Quality weighted running mean, capped so the centroid keeps following
+        // the current view of the person
+        double total = std::min(person.weight, 20.0) + weight;
+        person.centroid = (person.centroid * static_cast<float>(total - weight) + encoding * static_cast<float>(weight))
+                          / static_cast<float>(total);
+        person.weight = total;
+        return person.id;
+    }
+
+    // Closest open person track the new camera track could belong to
+    qint64 bestId = -1;
+    double bestDistance = std::numeric_limits<double>::max();
+    for (auto it = open.cbegin(); it != open.cend(); ++it) {
+        const PersonTrack &person = it.value();
+        if (!canFollow(person, camera, localTrackId, seenAt)) {
+            continue;
+        }
+
+        double distance;
+        if (matchedId != -1 && person.matchedId != -1) {
+            // The gallery already decided
+            if (matchedId != person.matchedId) {
+                continue;
+            }
+            distance = 0.0;
+        } else {
+            distance = dlib::length(person.centroid - encoding);
+        }
+
+        if (distance < matchThreshold && distance < bestDistance) {
+            bestDistance = distance;
+            bestId = person.id;
+        }
+    }
+
+    if (bestId == -1) {
+        PersonTrack person;
+        person.id = nextId++;
+        person.centroid = encoding;
+        person.weight = weight;
+        person.firstSeen = seenAt;
+        person.lastSeen = seenAt;
+        bestId = person.id;
+        open.insert(bestId, person);
+    }
+
+    PersonTrack &person = open[bestId];
+    if (!person.segments.isEmpty()) {
+        double total = std::min(person.weight, 20.0) + weight;
+        person.centroid = (person.centroid * static_cast<float>(total - weight) + encoding * static_cast<float>(weight))
+                          / static_cast<float>(total);
+        person.weight = total;
+    }
+    person.segments.append({camera, localTrackId, seenAt, seenAt});
+    update(person, camera, localTrackId, seenAt, matchedId);
+    localTracks.insert(key, bestId);
+    return bestId;
+}
+
+bool TrackCorrelator::touch(const QString &camera, int localTrackId, const QDateTime &seenAt, qint64 matchedId)
+{
+    auto bound = localTracks.constFind(localKey(camera, localTrackId));
+    if (bound == localTracks.constEnd()) {
+        return false;
+    }
+    update(open[bound.value()], camera, localTrackId, seenAt, matchedId);
+    return true;
+}
+
+void TrackCorrelator::release(const PersonTrack &person)
+{
+    for (const Segment &segment : person.segments) {
+        localTracks.remove(localKey(segment.camera, segment.localTrackId));
+    }
+}
+
+QVector<TrackCorrelator::PersonTrack> TrackCorrelator::expire(const QDateTime &now)
+{
+    QVector<PersonTrack> closed;
+    for (auto it = open.begin(); it != open.end();) {
+        if (it->lastSeen.secsTo(now) > closeAfterSeconds) {
+            release(it.value());
+            closed.append(it.value());
+            it = open.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return closed;
+}
+
+QVector<TrackCorrelator::PersonTrack> TrackCorrelator::takeAll()
+{
+    QVector<PersonTrack> closed = open.values();
+    open.clear();
+    localTracks.clear();
+    return closed;
+}
+
+bool TrackCorrelator::logEvent(QSqlDatabase db, const PersonTrack &track)
+{
+    QStringList cameras;
+    QJsonArray timeline;
+    for (const Segment &segment : track.segments) {
+        if (!cameras.contains(segment.camera)) {
+            cameras.append(segment.camera);
+        }
+        QJsonObject entry;
+        entry["camera"] = segment.camera;
+        entry["start"] = segment.start.toString(Qt::ISODateWithMs);
+        entry["end"] = segment.end.toString(Qt::ISODateWithMs);
+        timeline.append(entry);
+    }
+
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO person_events (person_id, first_seen, last_seen, cameras, timeline) "
+                  "VALUES (:person_id, :first_seen, :last_seen, :cameras, :timeline)");
+    query.bindValue(":person_id", track.matchedId == -1 ? QVariant() : QVariant(track.matchedId));
+    query.bindValue(":first_seen", track.firstSeen.toString(Qt::ISODateWithMs));
+    query.bindValue(":last_seen", track.lastSeen.toString(Qt::ISODateWithMs));
+    query.bindValue(":cameras", cameras.join(","));
+    query.bindValue(":timeline", QString::fromUtf8(QJsonDocument(timeline).toJson(QJsonDocument::Compact)));
+
+    if (!query.exec()) {
+        qDebug() << "Error logging person event:" << query.lastError().text();
+        return false;
+    }
+    qDebug() << "Person event logged across" << cameras.join(", ") << "from"
+             << track.firstSeen.toString("hh:mm:ss") << "to" << track.lastSeen.toString("hh:mm:ss");
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef TRACKCORRELATOR_H
+#define TRACKCORRELATOR_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+
+#include <dlib/matrix.h>
+
+// Joins the per-camera face tracks into person tracks across cameras. A new
+// camera track joins the open person track with the closest embedding, as
+// long as the time since that person was last seen fits the transit window
+// between the two cameras (camera_adjacency in cameras.db). Without any
+// configured adjacency every camera may follow every other within maxGap.
+//
+// Input is streamed from the frame loop and each observation only looks at
+// the person tracks still open, so the cost stays flat with history. Person
+// tracks close after a quiet period and are logged once to person_events.
+class TrackCorrelator
+{
+public:
+    struct Segment
+    {
+        QString camera;
+        int localTrackId;
+        QDateTime start;
+        QDateTime end;
+    };
+
+    struct PersonTrack
+    {
+        qint64 id = 0;
+        qint64 matchedId = -1;            // Gallery id once any camera recognised them
+        dlib::matrix<float, 0, 1> centroid;
+        double weight = 0.0;
+        QDateTime firstSeen;
+        QDateTime lastSeen;
+        QVector<Segment> segments;        // Per camera timeline, in order of appearance
+    };
+
+    explicit TrackCorrelator(double matchThreshold = 0.5, int maxGapSeconds = 120, int closeAfterSeconds = 60);
+
+    void loadAdjacency(QSqlDatabase db);
+
+    // A camera track with a fresh embedding. Returns the person track id.
+    qint64 observe(const QString &camera, int localTrackId, const QDateTime &seenAt,
+                   const dlib::matrix<float, 0, 1> &encoding, double quality, qint64 matchedId);
+
+    // A camera track seen again without an embedding. False until the track
+    // has been observed once.
+    bool touch(const QString &camera, int localTrackId, const QDateTime &seenAt, qint64 matchedId = -1);
+
+    // Person tracks quiet for closeAfter, ready to be logged
+    QVector<PersonTrack> expire(const QDateTime &now);
+    QVector<PersonTrack> takeAll();
+
+    static bool logEvent(QSqlDatabase db, const PersonTrack &track);
+
+private:
+    struct Transit
+    {
+        int minSeconds;
+        int maxSeconds;
+    };
+
+    double matchThreshold;
+    int maxGapSeconds;
+    int closeAfterSeconds;
+    qint64 nextId = 1;
+
+    QHash<QString, QHash<QString, Transit>> adjacency;
+    QHash<QString, qint64> localTracks; // camera/local id -> person track
+    QHash<qint64, PersonTrack> open;
+
+    static QString localKey(const QString &camera, int localTrackId);
+    bool canFollow(const PersonTrack &person, const QString &camera, int localTrackId, const QDateTime &seenAt) const;
+    void update(PersonTrack &person, const QString &camera, int localTrackId, const QDateTime &seenAt, qint64 matchedId);
+    void release(const PersonTrack &person);
+};
+
+#endif // TRACKCORRELATOR_H
@@ -0,0 +1,526 @@
+#include "unknownclusterer.h"
+
+#include <QBuffer>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+QByteArray encodingToBytes(const dlib::matrix<float, 0, 1> &encoding)
+{
+    return QByteArray(reinterpret_cast<const char *>(encoding.begin()), encoding.size() * sizeof(float));
+}
+
+dlib::matrix<float, 0, 1> bytesToEncoding(const QByteArray &bytes)
+{
+    dlib::matrix<float, 0, 1> encoding;
+    encoding.set_size(bytes.size() / sizeof(float), 1);
+    std::memcpy(encoding.begin(), bytes.constData(), encoding.size() * sizeof(float));
+    return encoding;
+}
+
+QByteArray imageToJpeg(const QImage &image)
+{
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "JPG", 90);
+    return bytes;
+}
+
+QString timestamp(const QDateTime &dateTime)
+{
+    // ISO strings sort chronologically, so pruning is a plain comparison
+    return dateTime.toString(Qt::ISODateWithMs);
+}
+
+} // namespace
+
+UnknownClusterer::UnknownClusterer(const QString &databasePath, QObject *parent)
+    : QObject(parent), databasePath(databasePath)
+{
+}
+
+void UnknownClusterer::submit(const QString &cameraName, const QDateTime &seenAt, const dlib::matrix<float, 0, 1> &encoding,
+                              const QImage &chip, double quality)
+{
+    QMutexLocker locker(&pendingMutex);
+    if (pending.size() >= maxPending) {
+        pending.removeFirst();
+    }
+    pending.append({cameraName, seenAt, encoding, chip, quality});
+}
+
+void UnknownClusterer::start()
+{
+    // SQLite connections belong to the thread that opened them
+    connectionName = QString("unknown_clusterer_%1").arg(reinterpret_cast<quintptr>(QThread::currentThread()));
+    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(databasePath);
+
+    if (!db.open()) {
+        qDebug() << "UnknownClusterer: failed to open" << databasePath << db.lastError().text();
+        return;
+    }
+
+    QSqlQuery query(db);
+    // The UI reads the visitor list on its own connection while this thread writes
+    query.exec("PRAGMA journal_mode=WAL");
+    if (!query.exec("CREATE TABLE IF NOT EXISTS unknown_clusters ("
+                    "id INTEGER PRIMARY KEY,"
+                    "centroid BLOB NOT NULL,"
+                    "sightings INTEGER,"
+                    "visits INTEGER,"
+                    "cameras TEXT,"
+                    "first_seen TEXT,"
+                    "last_seen TEXT,"
+                    "chip BLOB,"
+                    "chip_quality REAL"
+                    ")")
+        || !query.exec("CREATE TABLE IF NOT EXISTS unknown_faces ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "cluster_id INTEGER,"
+                       "camera_name TEXT,"
+                       "seen_at TEXT,"
+                       "quality REAL,"
+                       "encoding BLOB"
+                       ")")
+        || !query.exec("CREATE INDEX IF NOT EXISTS unknown_faces_seen_at ON unknown_faces (seen_at)")
+        || !query.exec("CREATE INDEX IF NOT EXISTS unknown_faces_cluster ON unknown_faces (cluster_id)")) {
+        qDebug() << "UnknownClusterer: error creating tables:" << query.lastError().text();
+    }
+
+    loadClusters();
+
+    flushTimer = new QTimer(this);
+    connect(flushTimer, &QTimer::timeout, this, &UnknownClusterer::processPending);
+    flushTimer->start(2000);
+
+    maintenanceTimer = new QTimer(this);
+    connect(maintenanceTimer, &QTimer::timeout, this, &UnknownClusterer::maintain);
+    maintenanceTimer->start(60 * 60 * 1000);
+
+    maintain();
+}
+
+void UnknownClusterer::stop()
+{
+    if (flushTimer) {
+        flushTimer->stop();
+        maintenanceTimer->stop();
+    }
+
+    if (db.isOpen()) {
+        processPending();
+        db.close();
+    }
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+void UnknownClusterer::loadClusters()
+{
+    QSqlQuery query(db);
+    if (!query.exec("SELECT id, centroid, sightings, visits, cameras, first_seen, last_seen, chip_quality FROM unknown_clusters")) {
+        qDebug() << "UnknownClusterer: error loading clusters:" << query.lastError().text();
+        return;
+    }
+
+    while (query.next()) {
+        qint64 id = query.value(0).toLongLong();
+
+        Cluster cluster;
+        cluster.centroid = bytesToEncoding(query.value(1).toByteArray());
+        cluster.sightings = query.value(2).toInt();
+        cluster.visits = query.value(3).toInt();
+        const QStringList cameras = query.value(4).toString().split(',', Qt::SkipEmptyParts);
+        cluster.cameras = QSet<QString>(cameras.begin(), cameras.end());
+        cluster.firstSeen = QDateTime::fromString(query.value(5).toString(), Qt::ISODateWithMs);
+        cluster.lastSeen = QDateTime::fromString(query.value(6).toString(), Qt::ISODateWithMs);
+        cluster.chipQuality = query.value(7).toDouble();
+        cluster.persisted = true;
+
+        clusters.insert(id, cluster);
+        nextClusterId = std::max(nextClusterId, id + 1);
+    }
+
+    qDebug() << "UnknownClusterer: loaded" << clusters.size() << "clusters";
+}
+
+qint64 UnknownClusterer::nearestCluster(const dlib::matrix<float, 0, 1> &encoding, double &distance) const
+{
+    qint64 nearest = -1;
+    distance = std::numeric_limits<double>::max();
+
+    for (auto it = clusters.constBegin(); it != clusters.constEnd(); ++it) {
+        if (it->centroid.size() != encoding.size()) {
+            continue;
+        }
+        double candidate = dlib::length(it->centroid - encoding);
+        if (candidate < distance) {
+            distance = candidate;
+            nearest = it.key();
+        }
+    }
+    return nearest;
+}
+
+void UnknownClusterer::processPending()
+{
+    QVector<Pending> faces;
+    {
+        QMutexLocker locker(&pendingMutex);
+        faces.swap(pending);
+    }
+
+    if (faces.isEmpty() && deletedClusters.isEmpty()) {
+        return;
+    }
+
+    QVector<qint64> assignments;
+    assignments.reserve(faces.size());
+
+    for (const Pending &face : faces) {
+        double distance;
+        qint64 id = nearestCluster(face.encoding, distance);
+
+        if (id == -1 || distance >= assignThreshold) {
+            id = nextClusterId++;
+            Cluster cluster;
+            cluster.centroid = face.encoding;
+            cluster.firstSeen = face.seenAt;
+            clusters.insert(id, cluster);
+        }
+
+        Cluster &cluster = clusters[id];
+
+        // Running mean, capped so the centroid can still follow a face
+        // whose appearance changes over the week
+        float weight = 1.0f / std::min(cluster.sightings + 1, 50);
+        cluster.centroid += weight * (face.encoding - cluster.centroid);
+
+        if (!cluster.lastSeen.isValid() || cluster.lastSeen.secsTo(face.seenAt) > visitGapMinutes * 60) {
+            ++cluster.visits;
+        }
+        ++cluster.sightings;
+        if (!cluster.lastSeen.isValid() || face.seenAt > cluster.lastSeen) {
+            cluster.lastSeen = face.seenAt;
+        }
+        cluster.cameras.insert(face.cameraName);
+
+        if (face.quality > cluster.chipQuality) {
+            cluster.chipQuality = face.quality;
+            cluster.chipJpeg = imageToJpeg(face.chip);
+        }
+        cluster.dirty = true;
+
+        assignments.append(id);
+    }
+
+    evictClusters();
+    flush(faces, assignments);
+}
+
+void UnknownClusterer::evictClusters()
+{
+    if (clusters.size() <= maxClusters) {
+        return;
+    }
+
+    // Drop a few percent at once so a busy week does not evict on every face.
+    // Single sightings that have not come back go first.
+    struct Candidate
+    {
+        qint64 id;
+        int visits;
+        QDateTime lastSeen;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(clusters.size());
+    for (auto it = clusters.constBegin(); it != clusters.constEnd(); ++it) {
+        candidates.push_back({it.key(), it->visits, it->lastSeen});
+    }
+
+    size_t evictCount = clusters.size() - maxClusters * 95 / 100;
+    std::partial_sort(candidates.begin(), candidates.begin() + evictCount, candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.visits != b.visits ? a.visits < b.visits : a.lastSeen < b.lastSeen;
+    });
+
+    for (size_t i = 0; i < evictCount; ++i) {
+        if (clusters.value(candidates[i].id).persisted) {
+            deletedClusters.append(candidates[i].id);
+        }
+        clusters.remove(candidates[i].id);
+    }
+
+    qDebug() << "UnknownClusterer: evicted" << evictCount << "clusters";
+}
+
+void UnknownClusterer::flush(const QVector<Pending> &faces, const QVector<qint64> &assignments)
+{
+    if (!db.isOpen()) {
+        return;
+    }
+
+    db.transaction();
+    QSqlQuery query(db);
+
+    for (qint64 id : deletedClusters) {
+        query.prepare("DELETE FROM unknown_faces WHERE cluster_id = :id");
+        query.bindValue(":id", id);
+        query.exec();
+        query.prepare("DELETE FROM unknown_clusters WHERE id = :id");
+        query.bindValue(":id", id);
+        query.exec();
+    }
+    deletedClusters.clear();
+
+    QVector<qint64> forgotten;
+    for (auto it = clusters.begin(); it != clusters.end(); ++it) {
+        Cluster &cluster = *it;
+        if (!cluster.dirty) {
+            continue;
+        }
+
+        QStringList cameras(cluster.cameras.begin(), cluster.cameras.end());
+        cameras.sort();
+
+        if (cluster.persisted) {
+            query.prepare("UPDATE unknown_clusters SET centroid = :centroid, sightings = :sightings, visits = :visits, "
+                          "cameras = :cameras, last_seen = :last_seen, chip = COALESCE(:chip, chip), chip_quality = :chip_quality "
+                          "WHERE id = :id");
+        } else {
+            query.prepare("INSERT INTO unknown_clusters (id, centroid, sightings, visits, cameras, first_seen, last_seen, chip, chip_quality) "
+                          "VALUES (:id, :centroid, :sightings, :visits, :cameras, :first_seen, :last_seen, :chip, :chip_quality)");
+            query.bindValue(":first_seen", timestamp(cluster.firstSeen));
+        }
+        query.bindValue(":id", it.key());
+        query.bindValue(":centroid", encodingToBytes(cluster.centroid));
+        query.bindValue(":sightings", cluster.sightings);
+        query.bindValue(":visits", cluster.visits);
+        query.bindValue(":cameras", cameras.join(','));
+        query.bindValue(":last_seen", timestamp(cluster.lastSeen));
+        query.bindValue(":chip", cluster.chipJpeg.isEmpty() ? QVariant(QMetaType(QMetaType::QByteArray)) : QVariant(cluster.chipJpeg));
+        query.bindValue(":chip_quality", cluster.chipQuality);
+
+        if (!query.exec()) {
+            qDebug() << "UnknownClusterer: error saving cluster" << it.key() << query.lastError().text();
+            continue;
+        }
+
+        // Deleted from the UI after being enrolled
+        if (cluster.persisted && query.numRowsAffected() == 0) {
+            forgotten.append(it.key());
+            continue;
+        }
+
+        cluster.persisted = true;
+        cluster.dirty = false;
+        cluster.chipJpeg.clear();
+    }
+
+    for (qint64 id : forgotten) {
+        clusters.remove(id);
+    }
+
+    query.prepare("INSERT INTO unknown_faces (cluster_id, camera_name, seen_at, quality, encoding) "
+                  "VALUES (:cluster_id, :camera_name, :seen_at, :quality, :encoding)");
+    for (int i = 0; i < faces.size(); ++i) {
+        if (!clusters.contains(assignments[i])) {
+            continue;
+        }
+        query.bindValue(":cluster_id", assignments[i]);
+        query.bindValue(":camera_name", faces[i].cameraName);
+        query.bindValue(":seen_at", timestamp(faces[i].seenAt));
+        query.bindValue(":quality", faces[i].quality);
+        query.bindValue(":encoding", encodingToBytes(faces[i].encoding));
+        if (!query.exec()) {
+            qDebug() << "UnknownClusterer: error saving face:" << query.lastError().text();
+        }
+    }
+
+    if (!db.commit()) {
+        qDebug() << "UnknownClusterer: error committing:" << db.lastError().text();
+        db.rollback();
+    }
+}
+
+void UnknownClusterer::mergeClusters()
+{
+    const QList<qint64> ids = clusters.keys();
+    QSet<qint64> merged;
+
+    QSqlQuery query(db);
+    db.transaction();
+
+    for (int a = 0; a < ids.size(); ++a) {
+        if (merged.contains(ids[a])) {
+            continue;
+        }
+        for (int b = a + 1; b < ids.size(); ++b) {
+            if (merged.contains(ids[b])) {
+                continue;
+            }
+
+            Cluster &first = clusters[ids[a]];
+            Cluster &second = clusters[ids[b]];
+            if (first.centroid.size() != second.centroid.size() || dlib::length(first.centroid - second.centroid) >= mergeThreshold) {
+                continue;
+            }
+
+            // Fold the smaller cluster into the larger one
+            bool firstIsTarget = first.sightings >= second.sightings;
+            qint64 targetId = firstIsTarget ? ids[a] : ids[b];
+            qint64 sourceId = firstIsTarget ? ids[b] : ids[a];
+            Cluster &target = firstIsTarget ? first : second;
+            Cluster &source = firstIsTarget ? second : first;
+
+            float total = static_cast<float>(target.sightings + source.sightings);
+            target.centroid = (target.sightings / total) * target.centroid + (source.sightings / total) * source.centroid;
+            target.sightings += source.sightings;
+            target.visits += source.visits;
+            target.cameras.unite(source.cameras);
+            target.firstSeen = std::min(target.firstSeen, source.firstSeen);
+            target.lastSeen = std::max(target.lastSeen, source.lastSeen);
+
+            if (source.chipQuality > target.chipQuality) {
+                target.chipQuality = source.chipQuality;
+                if (!source.chipJpeg.isEmpty()) {
+                    target.chipJpeg = source.chipJpeg;
+                } else if (source.persisted) {
+                    query.prepare("SELECT chip FROM unknown_clusters WHERE id = :id");
+                    query.bindValue(":id", sourceId);
+                    if (query.exec() && query.next()) {
+                        target.chipJpeg = query.value(0).toByteArray();
+                    }
+                }
+            }
+            target.dirty = true;
+
+            if (source.persisted) {
+                query.prepare("UPDATE unknown_faces SET cluster_id = :target WHERE cluster_id = :source");
+                query.bindValue(":target", targetId);
+                query.bindValue(":source", sourceId);
+                query.exec();
+                deletedClusters.append(sourceId);
+            }
+
+            merged.insert(sourceId);
+            clusters.remove(sourceId);
+            if (sourceId == ids[a]) {
+                break;
+            }
+        }
+    }
+
+    db.commit();
+
+    if (!merged.isEmpty()) {
+        qDebug() << "UnknownClusterer: merged" << merged.size() << "clusters," << clusters.size() << "left";
+    }
+}
+
+void UnknownClusterer::maintain()
+{
+    if (!db.isOpen()) {
+        return;
+    }
+
+    processPending();
+
+    // Visitors enrolled from the UI since the last pass
+    QSqlQuery query(db);
+    if (query.exec("SELECT id FROM unknown_clusters")) {
+        QSet<qint64> stored;
+        while (query.next()) {
+            stored.insert(query.value(0).toLongLong());
+        }
+        for (auto it = clusters.begin(); it != clusters.end();) {
+            if (it->persisted && !stored.contains(it.key())) {
+                it = clusters.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Retention window
+    QDateTime cutoff = QDateTime::currentDateTime().addDays(-retentionDays);
+    query.prepare("DELETE FROM unknown_faces WHERE seen_at < :cutoff");
+    query.bindValue(":cutoff", timestamp(cutoff));
+    if (!query.exec()) {
+        qDebug() << "UnknownClusterer: error pruning faces:" << query.lastError().text();
+    }
+
+    for (auto it = clusters.begin(); it != clusters.end();) {
+        if (it->lastSeen.isValid() && it->lastSeen < cutoff) {
+            if (it->persisted) {
+                deletedClusters.append(it.key());
+            }
+            it = clusters.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    mergeClusters();
+    flush({}, {});
+}
+
+QVector<UnknownClusterer::Visitor> UnknownClusterer::frequentVisitors(QSqlDatabase db, int minVisits, int limit)
+{
+    QVector<Visitor> visitors;
+
+    QSqlQuery query(db);
+    query.prepare("SELECT id, sightings, visits, cameras, first_seen, last_seen, chip, centroid FROM unknown_clusters "
+                  "WHERE visits >= :min_visits ORDER BY visits DESC, last_seen DESC LIMIT :limit");
+    query.bindValue(":min_visits", minVisits);
+    query.bindValue(":limit", limit);
+
+    if (!query.exec()) {
+        qDebug() << "Error reading frequent visitors:" << query.lastError().text();
+        return visitors;
+    }
+
+    while (query.next()) {
+        Visitor visitor;
+        visitor.id = query.value(0).toLongLong();
+        visitor.sightings = query.value(1).toInt();
+        visitor.visits = query.value(2).toInt();
+        visitor.cameras = query.value(3).toString().split(',', Qt::SkipEmptyParts);
+        visitor.firstSeen = QDateTime::fromString(query.value(4).toString(), Qt::ISODateWithMs);
+        visitor.lastSeen = QDateTime::fromString(query.value(5).toString(), Qt::ISODateWithMs);
+        visitor.chip = QImage::fromData(query.value(6).toByteArray(), "JPG");
+        visitor.centroid = bytesToEncoding(query.value(7).toByteArray());
+        visitors.append(visitor);
+    }
+
+    return visitors;
+}
+
+bool UnknownClusterer::forget(QSqlDatabase db, qint64 clusterId)
+{
+    db.transaction();
+
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM unknown_faces WHERE cluster_id = :id");
+    query.bindValue(":id", clusterId);
+    bool ok = query.exec();
+
+    query.prepare("DELETE FROM unknown_clusters WHERE id = :id");
+    query.bindValue(":id", clusterId);
+    ok = query.exec() && ok;
+
+    if (!ok || !db.commit()) {
+        qDebug() << "Error removing visitor" << clusterId << ":" << query.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
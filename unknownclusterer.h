@@ -0,0 +1,115 @@
+#ifndef UNKNOWNCLUSTERER_H
+#define UNKNOWNCLUSTERER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include <dlib/matrix.h>
+
+// Groups the embeddings of unrecognised faces into visitors. Lives on its own
+// QThread: the frame loop hands faces over with submit() and the worker
+// clusters them online (nearest centroid within a threshold, otherwise a new
+// cluster), with an hourly pass that merges clusters which drifted together.
+//
+// Memory is bounded by the number of clusters, each holding only a centroid
+// and counters; chips and raw embeddings go straight to faces.db
+// (unknown_clusters, unknown_faces). Rows older than the retention window are
+// pruned, and past maxClusters the least visited cluster is evicted.
+class UnknownClusterer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Visitor
+    {
+        qint64 id = 0;
+        int sightings = 0;
+        int visits = 0;
+        QStringList cameras;
+        QDateTime firstSeen;
+        QDateTime lastSeen;
+        QImage chip;
+        dlib::matrix<float, 0, 1> centroid;
+    };
+
+    explicit UnknownClusterer(const QString &databasePath, QObject *parent = nullptr);
+
+    // Thread-safe. Drops the oldest pending face if the worker falls behind.
+    void submit(const QString &cameraName, const QDateTime &seenAt, const dlib::matrix<float, 0, 1> &encoding,
+                const QImage &chip, double quality);
+
+    // Read side for the UI, on the caller's own connection to faces.db
+    static QVector<Visitor> frequentVisitors(QSqlDatabase db, int minVisits = 3, int limit = 50);
+
+    // Removes a visitor once it has been enrolled
+    static bool forget(QSqlDatabase db, qint64 clusterId);
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void processPending();
+    void maintain();
+
+private:
+    struct Pending
+    {
+        QString cameraName;
+        QDateTime seenAt;
+        dlib::matrix<float, 0, 1> encoding;
+        QImage chip;
+        double quality;
+    };
+
+    struct Cluster
+    {
+        dlib::matrix<float, 0, 1> centroid;
+        int sightings = 0;
+        int visits = 0;
+        QSet<QString> cameras;
+        QDateTime firstSeen;
+        QDateTime lastSeen;
+        double chipQuality = -1.0;
+        QByteArray chipJpeg;    // Only held until the next flush
+        bool persisted = false;
+        bool dirty = false;
+    };
+
+    QString databasePath;
+    QString connectionName;
+    QSqlDatabase db;
+
+    QMutex pendingMutex;
+    QVector<Pending> pending;
+
+    QHash<qint64, Cluster> clusters;
+    QVector<qint64> deletedClusters;
+    qint64 nextClusterId = 1;
+
+    QTimer *flushTimer = nullptr;
+    QTimer *maintenanceTimer = nullptr;
+
+    static const int maxPending = 500;
+    static const int maxClusters = 5000;
+    static const int retentionDays = 7;
+    static const int visitGapMinutes = 10;
+    static constexpr double assignThreshold = 0.5;
+    static constexpr double mergeThreshold = 0.45;
+
+    void loadClusters();
+    qint64 nearestCluster(const dlib::matrix<float, 0, 1> &encoding, double &distance) const;
+    void evictClusters();
+    void mergeClusters();
+    void flush(const QVector<Pending> &faces, const QVector<qint64> &assignments);
+};
+
+#endif // UNKNOWNCLUSTERER_H